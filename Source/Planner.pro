@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui sql
 
 TARGET = Planner
 TEMPLATE = app
@@ -15,6 +15,29 @@ SOURCES += main.cpp\
     plannerwidget.cpp \
     plannerentry.cpp \
     abstractentry.cpp \
+    recurringentry.cpp \
+    stringpool.cpp \
+    plannerfile.cpp \
+    blockdevice.cpp \
+    atomicfile.cpp \
+    interchange.cpp \
+    storagebackend.cpp \
+    plafilebackend.cpp \
+    sqlitebackend.cpp \
+    reminderscheduler.cpp \
+    timeindex.cpp \
+    timecolumns.cpp \
+    scankernels.cpp \
+    roaringbitmap.cpp \
+    tagindex.cpp \
+    planstatistics.cpp \
+    entryarchive.cpp \
+    fuzzymatch.cpp \
+    availability.cpp \
+    trace.cpp \
+    memoryusage.cpp \
+    batch.cpp \
+    archivedialog.cpp \
     prefsdialog.cpp
 
 HEADERS  += \
@@ -22,6 +45,34 @@ HEADERS  += \
     plannerwidget.h \
     abstractentry.h \
     plannerentry.h \
+    recurringentry.h \
+    stringpool.h \
+    plannerfile.h \
+    blockdevice.h \
+    atomicfile.h \
+    interchange.h \
+    storagebackend.h \
+    plafilebackend.h \
+    sqlitebackend.h \
+    reminderscheduler.h \
+    timeindex.h \
+    timecolumns.h \
+    scankernels.h \
+    roaringbitmap.h \
+    tagindex.h \
+    planstatistics.h \
+    entryarchive.h \
+    fuzzymatch.h \
+    availability.h \
+    trace.h \
+    memoryusage.h \
+    batch.h \
+    archivedialog.h \
     prefsdialog.h
 
+# "qmake CONFIG+=tracing" builds in timing of Planner's operations (trace.h)
+tracing {
+    DEFINES += PLANNER_TRACING
+}
+
 FORMS +=
@@ -1,10 +1,101 @@
 #include "abstractentry.h"
+#include "scankernels.h"
 
 AbstractEntry::AbstractEntry(QString name, QString notes)
-    : _name(name), _notes(notes) {}
+    : _name(name), _notes(notes), _id(0) {}
 
 QString AbstractEntry::name() const { return _name; }
 QString AbstractEntry::notes() const { return _notes; }
 
 void AbstractEntry::setName(QString newName) { _name = newName; }
 void AbstractEntry::setNotes(QString newNotes) { _notes = newNotes; }
+
+// The tags in comma-separated text, trimmed, each once
+QStringList AbstractEntry::parseTags(const QString &text)
+{
+    QStringList tags;
+    QStringList parts = text.split(',', QString::SkipEmptyParts);
+    for (int i = 0; i < parts.size(); i++) {
+        QString tag = parts[i].trimmed();
+        if (!tag.isEmpty() && !tags.contains(tag)) tags.append(tag);
+    }
+    return tags;
+}
+
+qint64 AbstractEntry::startMSecs() const
+{
+    return startDateTime().toMSecsSinceEpoch();
+}
+qint64 AbstractEntry::endMSecs() const
+{
+    return endDateTime().toMSecsSinceEpoch();
+}
+qint64 AbstractEntry::whenAddedMSecs() const
+{
+    return whenAdded().toMSecsSinceEpoch();
+}
+
+/* Check if the entries' start-end intervals overlap, ends included, the
+   same test DT_conflict_in_list() scans the time columns with. If so,
+   "when" receives this entry's clashing interval. */
+bool AbstractEntry::conflictsWith(const AbstractEntry *other,
+                                  Occurrence *when) const
+{
+    // Let the recurring side intersect its rule with our single interval
+    if (other->isRecurring()) {
+        if (!other->conflictsWith(this)) return false;
+    }
+    else if (!Scan::meets(startMSecs(), endMSecs(), other->startMSecs(),
+                          other->endMSecs()))
+        return false;
+
+    if (when) *when = Occurrence(startDateTime(), endDateTime());
+    return true;
+}
+
+bool AbstractEntry::endedBy(qint64 msecs) const
+{
+    return endMSecs() <= msecs;
+}
+
+/* The start of the first occurrence starting after msecs, if there is one */
+bool AbstractEntry::nextStartAfter(qint64 msecs, qint64 &start) const
+{
+    start = startMSecs();
+    return start > msecs;
+}
+
+QList<Occurrence> AbstractEntry::occurrences(const QDateTime &from,
+                                             const QDateTime &to) const
+{
+    QList<Occurrence> list;
+    if (startDateTime() <= to && endDateTime() >= from)
+        list.append(Occurrence(startDateTime(), endDateTime()));
+    return list;
+}
+
+quint64 AbstractEntry::contentHash() const
+{
+    QString n = name(), text = notes(), tagText = _tags.join(",");
+    qint64 times[3] = { startMSecs(), endMSecs(), whenAddedMSecs() };
+    int sizes[3] = { n.size(), text.size(), tagText.size() };
+
+    quint64 hash = hashBytes(Q_UINT64_C(14695981039346656037), sizes,
+                             sizeof(sizes));
+    hash = hashBytes(hash, n.constData(), n.size() * sizeof(QChar));
+    hash = hashBytes(hash, text.constData(), text.size() * sizeof(QChar));
+    hash = hashBytes(hash, tagText.constData(),
+                     tagText.size() * sizeof(QChar));
+    return hashBytes(hash, times, sizeof(times));
+}
+
+// 64-bit FNV-1a, continuing from hash
+quint64 AbstractEntry::hashBytes(quint64 hash, const void *data, int size)
+{
+    const uchar *bytes = (const uchar*)data;
+    for (int i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    return hash;
+}
@@ -2,6 +2,12 @@
 #define ABSTRACTENTRY_H
 
 #include <QDateTime>
+#include <QList>
+#include <QPair>
+#include <QStringList>
+
+// One start/end interval of an entry
+typedef QPair<QDateTime, QDateTime> Occurrence;
 
 class AbstractEntry {
 
@@ -9,10 +15,21 @@ protected:
     AbstractEntry(QString name, QString notes);
     QString _name;
     QString _notes;
+    QStringList _tags;
+    quint64 _id;
 
 public:
     virtual ~AbstractEntry() {}
 
+    /* An independent copy. Its strings stay implicitly shared with ours
+       until either side changes them, so copies are cheap. */
+    virtual AbstractEntry *clone() const = 0;
+
+    /* Identifies the entry across edits, sorts and sessions; stored in the
+       file. Zero until the plan it's added to hands out an ID. */
+    quint64 id() const { return _id; }
+    void    setId(quint64 newId) { _id = newId; }
+
     virtual QString name() const;
     virtual QString notes() const;
     virtual QString email() const {}
@@ -20,11 +37,40 @@ public:
     virtual QDateTime endDateTime() const {}
     virtual QDateTime whenAdded() const {}
 
+    /* The same instants as milliseconds since the epoch, for comparisons
+       that shouldn't have to go through QDateTime. */
+    virtual qint64 startMSecs() const;
+    virtual qint64 endMSecs() const;
+    virtual qint64 whenAddedMSecs() const;
+
+    /* Categories, in the order given; each a trimmed, nonempty word or
+       phrase without commas. Filters pick entries by them. */
+    QStringList tags() const { return _tags; }
+    void        setTags(const QStringList &newTags) { _tags = newTags; }
+    static QStringList parseTags(const QString &text);
+
     virtual void setName(QString newName);
     virtual void setNotes(QString newNotes);
     virtual void setEmail(QString newEmail) {}
     virtual void setStartDateTime(QDateTime newDT) {}
     virtual void setEndDateTime(QDateTime newDT) {}
+
+    /* Single entries occupy one interval; recurring ones override these to
+       work on their rule without expanding every occurrence. */
+    virtual bool isRecurring() const { return false; }
+    virtual bool conflictsWith(const AbstractEntry *other,
+                               Occurrence *when = 0) const;
+    virtual bool endedBy(qint64 msecs) const;
+    virtual bool nextStartAfter(qint64 msecs, qint64 &start) const;
+    virtual QList<Occurrence> occurrences(const QDateTime &from,
+                                          const QDateTime &to) const;
+
+    /* A fingerprint of everything stored about the entry, for telling
+       whether two versions of it differ. */
+    virtual quint64 contentHash() const;
+
+protected:
+    static quint64 hashBytes(quint64 hash, const void *data, int size);
 };
 
 #endif // ABSTRACTENTRY_H
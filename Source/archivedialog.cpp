@@ -0,0 +1,101 @@
+#include <QApplication>
+#include <QBoxLayout>
+#include <QDateEdit>
+#include <QDialogButtonBox>
+#include <QHeaderView>
+#include <QLabel>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QTreeWidget>
+
+#include "archivedialog.h"
+#include "entryarchive.h"
+#include "abstractentry.h"
+
+ArchiveDialog::ArchiveDialog(EntryArchive *archive, QWidget *parent)
+    : QDialog(parent), archive(archive)
+{
+    fromDate = new QDateEdit(QDate::currentDate().addMonths(-1));
+    toDate = new QDateEdit(QDate::currentDate());
+    fromDate->setCalendarPopup(true);
+    toDate->setCalendarPopup(true);
+    showButton = new QPushButton(tr("&Show"));
+    showButton->setDefault(true);
+
+    QHBoxLayout *rangeLayout = new QHBoxLayout;
+    rangeLayout->addWidget(new QLabel(tr("From:")));
+    rangeLayout->addWidget(fromDate);
+    rangeLayout->addWidget(new QLabel(tr("To:")));
+    rangeLayout->addWidget(toDate);
+    rangeLayout->addWidget(showButton);
+    rangeLayout->addStretch();
+
+    entryTree = new QTreeWidget;
+    entryTree->setRootIsDecorated(false);
+    entryTree->setSortingEnabled(true);
+    entryTree->setHeaderLabels(QStringList() << tr("Name") << tr("Start")
+                               << tr("End") << tr("Tags"));
+
+    countLabel = new QLabel(tr("%n event(s) archived", "",
+                               archive->count()));
+
+    QDialogButtonBox *buttonBox =
+            new QDialogButtonBox(QDialogButtonBox::Close);
+    connect(buttonBox, SIGNAL(rejected()), this, SLOT(reject()));
+    connect(showButton, SIGNAL(clicked()), this, SLOT(showEntries()));
+
+    QVBoxLayout *mainLayout = new QVBoxLayout;
+    mainLayout->addLayout(rangeLayout);
+    mainLayout->addWidget(entryTree);
+    mainLayout->addWidget(countLabel);
+    mainLayout->addWidget(buttonBox);
+    setLayout(mainLayout);
+
+    setWindowTitle(tr("Archived Events"));
+    resize(640, 400);
+}
+
+/* Read the archived events between the two dates (inclusive), showing the
+   first MaxShown of them */
+void ArchiveDialog::showEntries()
+{
+    qint64 from = QDateTime(fromDate->date()).toMSecsSinceEpoch();
+    qint64 to = QDateTime(toDate->date().addDays(1)).toMSecsSinceEpoch() - 1;
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    std::vector<AbstractEntry*> found;
+    bool ok = archive->entries(from, to, found);
+    QApplication::restoreOverrideCursor();
+    if (!ok) {
+        QMessageBox::warning(this, tr("Planner"), archive->errorString());
+        return;
+    }
+
+    entryTree->setSortingEnabled(false);
+    entryTree->clear();
+    QList<QTreeWidgetItem*> items;
+    for (uint i = 0; i < found.size(); i++) {
+        AbstractEntry *e = found[i];
+        if (i < MaxShown) {
+            QTreeWidgetItem *item = new QTreeWidgetItem;
+            item->setText(0, e->name());
+            item->setText(1, e->startDateTime()
+                          .toString("yyyy-MM-dd hh:mm"));
+            item->setText(2, e->endDateTime()
+                          .toString("yyyy-MM-dd hh:mm"));
+            item->setText(3, e->tags().join(", "));
+            items.append(item);
+        }
+        delete e;
+    }
+    entryTree->addTopLevelItems(items);
+    entryTree->setSortingEnabled(true);
+    entryTree->sortByColumn(1, Qt::AscendingOrder);
+    entryTree->header()->resizeSections(QHeaderView::ResizeToContents);
+
+    if (found.size() > MaxShown)
+        countLabel->setText(tr("Showing the first %1 of %2 events")
+                            .arg(int(MaxShown)).arg(int(found.size())));
+    else
+        countLabel->setText(tr("%n event(s)", "", int(found.size())));
+}
@@ -0,0 +1,36 @@
+#ifndef ARCHIVEDIALOG_H
+#define ARCHIVEDIALOG_H
+
+#include <QDialog>
+
+class EntryArchive;
+class QDateEdit;
+class QLabel;
+class QPushButton;
+class QTreeWidget;
+
+/* Lists the events archived between two dates. The archive is only read
+   when Show is pressed, and only the part of it covering those dates. */
+class ArchiveDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    ArchiveDialog(EntryArchive *archive, QWidget *parent = 0);
+
+private slots:
+    void showEntries();
+
+private:
+    enum { MaxShown = 10000 };
+
+    EntryArchive *archive;  // not owned
+
+    QDateEdit *fromDate;
+    QDateEdit *toDate;
+    QPushButton *showButton;
+    QTreeWidget *entryTree;
+    QLabel *countLabel;
+};
+
+#endif // ARCHIVEDIALOG_H
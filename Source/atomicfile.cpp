@@ -0,0 +1,118 @@
+#include <QDir>
+#include <QFileInfo>
+
+#include "atomicfile.h"
+
+#include <errno.h>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+AtomicFile::AtomicFile(const QString &fileName, Durability durability)
+    : fileName(fileName), durability(durability),
+      temp(fileName + ".saving.XXXXXX"), committed(false) {}
+
+/* Anything not committed is thrown away (by the temporary file itself),
+   leaving the original as it was */
+AtomicFile::~AtomicFile()
+{
+    if (committed) temp.setAutoRemove(false);
+}
+
+/* The temporary file is created owner-only; it takes the original's
+   permissions, or a new file's usual ones. */
+bool AtomicFile::open()
+{
+    if (!temp.open()) {
+        error = temp.errorString();
+        return false;
+    }
+
+    if (QFile::exists(fileName))
+        temp.setPermissions(QFile::permissions(fileName));
+    else
+        temp.setPermissions(QFile::ReadOwner | QFile::WriteOwner
+                            | QFile::ReadGroup | QFile::ReadOther);
+    return true;
+}
+
+QIODevice *AtomicFile::device() { return &temp; }
+
+QString AtomicFile::errorString() const { return error; }
+
+bool AtomicFile::commit()
+{
+    if (!temp.flush()) {
+        error = temp.errorString();
+        return false;
+    }
+    if (durability != NoSync && !syncFile()) {
+        error = qt_error_string(errno);
+        return false;
+    }
+    temp.close();
+
+    if (!replaceOriginal()) return false;
+    committed = true;
+
+    /* The new contents are in place by now, but the rename might not be
+       on disk yet, so a save that asked for it isn't reported as done */
+    if (durability == SyncDirectory && !syncDirectory()) {
+        error = tr("The file was replaced, but a power cut could still undo "
+                   "it: %1").arg(qt_error_string(errno));
+        return false;
+    }
+    return true;
+}
+
+bool AtomicFile::syncFile()
+{
+#ifdef Q_OS_WIN
+    return _commit(temp.handle()) == 0;
+#else
+    return ::fsync(temp.handle()) == 0;
+#endif
+}
+
+/* QFile::rename() won't overwrite, so replace the original with the
+   platform's atomic rename instead. */
+bool AtomicFile::replaceOriginal()
+{
+#ifdef Q_OS_WIN
+    QString from = QDir::toNativeSeparators(temp.fileName());
+    QString to = QDir::toNativeSeparators(fileName);
+    if (MoveFileExW((const wchar_t*)from.utf16(), (const wchar_t*)to.utf16(),
+                    MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        return true;
+#else
+    if (::rename(QFile::encodeName(temp.fileName()).constData(),
+                 QFile::encodeName(fileName).constData()) == 0)
+        return true;
+#endif
+    error = tr("Could not replace %1 with the saved copy.").arg(fileName);
+    return false;
+}
+
+/* Make the rename itself durable. Windows has no directory handles to
+   flush, and MOVEFILE_WRITE_THROUGH already covers it there. */
+bool AtomicFile::syncDirectory()
+{
+#ifdef Q_OS_WIN
+    return true;
+#else
+    QString dir = QFileInfo(fileName).absolutePath();
+    int fd = ::open(QFile::encodeName(dir).constData(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    int syncError = errno;
+    ::close(fd);
+    errno = syncError;
+    return ok;
+#endif
+}
@@ -0,0 +1,46 @@
+#ifndef ATOMICFILE_H
+#define ATOMICFILE_H
+
+#include <QCoreApplication>
+#include <QTemporaryFile>
+
+/* Writes a file by way of a temporary file next to it, which only replaces
+   the original once everything has been written. A crash or a full disk
+   mid-save leaves the original untouched. Each save gets a temporary file
+   with a name of its own, so two Planners saving the same plan at once
+   can't write into each other's.
+
+   The durability policy says how much to sync before the original is
+   replaced. NoSync only orders the rename after the writes as far as the
+   OS guarantees; SyncFile fsyncs the new contents first; SyncDirectory
+   also fsyncs the directory so the rename itself survives a power cut.
+   If only that last sync fails, commit() returns false although the
+   original has already been replaced. */
+class AtomicFile
+{
+    Q_DECLARE_TR_FUNCTIONS(AtomicFile)
+
+public:
+    enum Durability { NoSync, SyncFile, SyncDirectory };
+
+    AtomicFile(const QString &fileName, Durability durability = SyncFile);
+    ~AtomicFile();
+
+    bool       open();
+    QIODevice *device();
+    bool       commit();
+    QString    errorString() const;
+
+private:
+    bool syncFile();
+    bool replaceOriginal();
+    bool syncDirectory();
+
+    QString fileName;
+    Durability durability;
+    QTemporaryFile temp;
+    bool committed;
+    QString error;
+};
+
+#endif // ATOMICFILE_H
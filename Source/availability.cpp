@@ -0,0 +1,183 @@
+#include <QtConcurrentMap>
+#include <algorithm>
+
+#include "availability.h"
+#include "timeindex.h"
+
+/* Loads one plan file into its BusyTime. Run on several files at once by
+   QtConcurrent; each call has its own backend, so nothing is shared. The
+   plans are other people's, so they're opened read-only, and only the times
+   of the entries in the window are read. */
+struct PlanLoader
+{
+    typedef BusyTime result_type;
+
+    PlanLoader(qint64 from, qint64 to, const StorageOptions &options)
+        : from(from), to(to), options(options) {}
+
+    BusyTime operator()(const QString &fileName) const
+    {
+        BusyTime busy;
+        busy.fileName = fileName;
+
+        std::vector<AbstractEntry*> entries;
+        StorageBackend *backend = StorageBackend::create(fileName, options,
+                                                         true);
+        if (backend->loadTimes(from, to, entries)) {
+            busy.add(entries, from, to);
+            busy.merge();
+        }
+        else busy.error = backend->errorString();
+        delete backend;
+
+        for (uint i = 0; i < entries.size(); i++) delete entries[i];
+        return busy;
+    }
+
+    qint64 from;
+    qint64 to;
+    StorageOptions options;
+};
+
+// The next busy interval of one plan, in freeSlots()'s merge
+struct PlanHead
+{
+    qint64 start;
+    int plan;
+    uint index;
+};
+
+struct StartsLater
+{
+    bool operator()(const PlanHead &a, const PlanHead &b) const
+    { return a.start > b.start; }
+};
+
+// Add the intervals of entries (and occurrences) that touch [from, to]
+void BusyTime::add(const std::vector<AbstractEntry*> &entries, qint64 from,
+                   qint64 to)
+{
+    QDateTime fromDT = QDateTime::fromMSecsSinceEpoch(from);
+    QDateTime toDT = QDateTime::fromMSecsSinceEpoch(to);
+
+    for (uint i = 0; i < entries.size(); i++) {
+        const AbstractEntry *e = entries[i];
+        if (!e->isRecurring()) {
+            Interval busy = { e->startMSecs(), e->endMSecs() };
+            if (busy.start <= to && busy.end >= from)
+                intervals.push_back(busy);
+            continue;
+        }
+
+        QList<Occurrence> occurrences = e->occurrences(fromDT, toDT);
+        for (int j = 0; j < occurrences.size(); j++) {
+            Interval busy = { occurrences[j].first.toMSecsSinceEpoch(),
+                              occurrences[j].second.toMSecsSinceEpoch() };
+            intervals.push_back(busy);
+        }
+    }
+}
+
+// Sort the intervals and join the ones that overlap
+void BusyTime::merge()
+{
+    std::sort(intervals.begin(), intervals.end());
+
+    uint joined = 0;
+    for (uint i = 1; i < intervals.size(); i++) {
+        if (intervals[i].start <= intervals[joined].end)
+            intervals[joined].end = qMax(intervals[joined].end,
+                                         intervals[i].end);
+        else intervals[++joined] = intervals[i];
+    }
+    if (!intervals.empty()) intervals.resize(joined + 1);
+}
+
+
+
+
+AvailabilityFinder::AvailabilityFinder(const QDateTime &from,
+                                       const QDateTime &to)
+    : from(from.toMSecsSinceEpoch()), to(to.toMSecsSinceEpoch()) {}
+
+QString AvailabilityFinder::errorString() const { return error; }
+
+// Add a plan that's already loaded, such as the one being edited
+void AvailabilityFinder::addPlan(const QString &name,
+                                 const std::vector<AbstractEntry*> &entries)
+{
+    BusyTime busy;
+    busy.fileName = name;
+    busy.add(entries, from, to);
+    busy.merge();
+    plans.append(busy);
+}
+
+/* Start loading the plans in fileNames on all cores, without waiting for
+   them. The results are handed to addLoaded() once they're all in. */
+QFuture<BusyTime> AvailabilityFinder::loadPlans(const QStringList &fileNames,
+                                                const StorageOptions &options)
+{
+    return QtConcurrent::mapped(fileNames, PlanLoader(from, to, options));
+}
+
+/* Add the plans loadPlans() read. If any couldn't be loaded, none are,
+   since free time that ignored someone's plan would be wrong. */
+bool AvailabilityFinder::addLoaded(const QList<BusyTime> &loaded)
+{
+    QStringList errors;
+    for (int i = 0; i < loaded.size(); i++) {
+        if (!loaded[i].error.isEmpty())
+            errors.append(loaded[i].error);
+    }
+    if (!errors.isEmpty()) {
+        error = errors.join("\n\n");
+        return false;
+    }
+
+    plans.append(loaded);
+    return true;
+}
+
+/* The earliest places, up to maxSlots of them and each in a different gap,
+   where something lasting duration fits without conflicting with any
+   entry of any plan. */
+QList<Occurrence> AvailabilityFinder::freeSlots(qint64 duration,
+                                                int maxSlots) const
+{
+    std::vector<PlanHead> heap;
+    for (int p = 0; p < plans.size(); p++) {
+        if (plans[p].intervals.empty()) continue;
+        PlanHead h = { plans[p].intervals[0].start, p, 0 };
+        heap.push_back(h);
+    }
+    std::make_heap(heap.begin(), heap.end(), StartsLater());
+
+    QList<Occurrence> found;
+    qint64 cursor = from;
+    while (cursor + duration <= to && found.size() < maxSlots) {
+        // No busy time left in any plan: the rest of the window is free
+        if (heap.empty()) {
+            found.append(Occurrence(QDateTime::fromMSecsSinceEpoch(cursor),
+                         QDateTime::fromMSecsSinceEpoch(cursor + duration)));
+            break;
+        }
+
+        std::pop_heap(heap.begin(), heap.end(), StartsLater());
+        PlanHead h = heap.back();
+        heap.pop_back();
+        const BusyTime::Interval &busy = plans[h.plan].intervals[h.index];
+
+        if (cursor + duration < busy.start)
+            found.append(Occurrence(QDateTime::fromMSecsSinceEpoch(cursor),
+                         QDateTime::fromMSecsSinceEpoch(cursor + duration)));
+        if (busy.end >= cursor) cursor = TimeIndex::freeAfter(busy.end);
+
+        if (++h.index < plans[h.plan].intervals.size()) {
+            h.start = plans[h.plan].intervals[h.index].start;
+            heap.push_back(h);
+            std::push_heap(heap.begin(), heap.end(), StartsLater());
+        }
+    }
+    return found;
+}
@@ -0,0 +1,62 @@
+#ifndef AVAILABILITY_H
+#define AVAILABILITY_H
+
+#include <QCoreApplication>
+#include <QFuture>
+#include <QList>
+#include <QStringList>
+#include <vector>
+
+#include "abstractentry.h"
+#include "storagebackend.h"
+
+/* The busy time of one plan within a window, as a compact list of
+   non-overlapping intervals sorted by start. Only the intervals are kept,
+   so dozens of big plans fit in memory at once. */
+struct BusyTime
+{
+    struct Interval {
+        qint64 start;
+        qint64 end;
+        bool operator<(const Interval &other) const
+        { return start < other.start; }
+    };
+
+    QString fileName;
+    std::vector<Interval> intervals;
+    QString error;      // if the plan couldn't be loaded
+
+    void add(const std::vector<AbstractEntry*> &entries, qint64 from,
+             qint64 to);
+    void merge();
+};
+
+/* Finds the time that's free in every one of several plans, such as the
+   plans of people who need to meet. Plan files are loaded concurrently in
+   the background, each reduced to its BusyTime over the window, and the
+   lists are then swept together in a k-way merge: the next busy interval
+   of any plan is always at the top of a min-heap of the lists' heads, so n
+   intervals in k plans cost O(n log k). */
+class AvailabilityFinder
+{
+    Q_DECLARE_TR_FUNCTIONS(AvailabilityFinder)
+
+public:
+    AvailabilityFinder(const QDateTime &from, const QDateTime &to);
+
+    void addPlan(const QString &name,
+                 const std::vector<AbstractEntry*> &entries);
+    QFuture<BusyTime> loadPlans(const QStringList &fileNames,
+                                const StorageOptions &options);
+    bool addLoaded(const QList<BusyTime> &loaded);
+    QList<Occurrence> freeSlots(qint64 duration, int maxSlots) const;
+    QString errorString() const;
+
+private:
+    qint64 from;
+    qint64 to;
+    QList<BusyTime> plans;
+    QString error;
+};
+
+#endif // AVAILABILITY_H
@@ -0,0 +1,114 @@
+#include <QCoreApplication>
+#include <QSet>
+#include <QTextStream>
+#include <stdio.h>
+
+#include "batch.h"
+#include "storagebackend.h"
+#include "abstractentry.h"
+#include "memoryusage.h"
+#include "planstatistics.h"
+#include "timecolumns.h"
+#include "timeindex.h"
+
+class Batch
+{
+    Q_DECLARE_TR_FUNCTIONS(Batch)
+
+public:
+    static int usage();
+    static int memory(const QString &fileName);
+    static int statistics(const QString &fileName);
+
+private:
+    static bool load(const QString &fileName,
+                     std::vector<AbstractEntry*> &entries);
+};
+
+int Batch::usage()
+{
+    QTextStream(stderr) << tr("Usage: Planner --memory FILE\n"
+                              "       Planner --stats FILE\n");
+    return 2;
+}
+
+/* Load fileName the way the window would and report what its entries and
+   the indexes built over them cost. The list items and the window's own
+   indexes only exist on screen, so the Memory Usage dialog shows those. */
+int Batch::memory(const QString &fileName)
+{
+    std::vector<AbstractEntry*> entries;
+    if (!load(fileName, entries)) return 1;
+
+    /* The index keeps entries by ID, so give those without one (from files
+       before IDs were saved) or with a taken one a fresh ID, as the window
+       does when it lists them */
+    QSet<quint64> used;
+    quint64 next = 1;
+    for (uint i = 0; i < entries.size(); i++) {
+        if (entries[i]->id() != 0 && !used.contains(entries[i]->id())) {
+            used.insert(entries[i]->id());
+            continue;
+        }
+        while (used.contains(next)) next++;
+        entries[i]->setId(next);
+        used.insert(next);
+    }
+
+    TimeIndex timeIndex;
+    timeIndex.build(entries);
+
+    MemoryUsage usage;
+    usage.addEntries(entries);
+    usage.add(tr("Entry vector"), qint64(entries.size()),
+              MemoryUsage::vectorBytes(entries));
+    usage.add(tr("Free time index"), qint64(entries.size()),
+              timeIndex.memoryUsed());
+    QTextStream(stdout) << fileName << '\n' << usage.report();
+
+    for (uint i = 0; i < entries.size(); i++) delete entries[i];
+    return 0;
+}
+
+/* The same statistics as the Statistics dialog, with the hours per week
+   and per day it shows under Show Details */
+int Batch::statistics(const QString &fileName)
+{
+    std::vector<AbstractEntry*> entries;
+    if (!load(fileName, entries)) return 1;
+
+    TimeColumns columns;
+    for (uint i = 0; i < entries.size(); i++) columns.set(int(i), entries[i]);
+    QTextStream(stdout) << fileName << '\n'
+                        << PlanStatistics::compute(columns, entries).report();
+
+    for (uint i = 0; i < entries.size(); i++) delete entries[i];
+    return 0;
+}
+
+/* Read fileName without changing it: a database isn't created if it's
+   missing, or upgraded if it's old */
+bool Batch::load(const QString &fileName, std::vector<AbstractEntry*> &entries)
+{
+    StorageOptions options;
+    options.compressed = false;     // only affects saving
+    options.durability = AtomicFile::SyncFile;
+
+    StorageBackend *backend = StorageBackend::create(fileName, options,
+                                                     true);
+    bool loaded = backend->load(entries);
+    if (!loaded)
+        QTextStream(stderr) << tr("Cannot read file %1:\n%2.\n")
+                               .arg(fileName).arg(backend->errorString());
+    delete backend;
+    return loaded;
+}
+
+int runBatch(const QStringList &arguments)
+{
+    if (arguments.size() == 3 && arguments[1] == "--memory")
+        return Batch::memory(arguments[2]);
+    if (arguments.size() == 3 && arguments[1] == "--stats")
+        return Batch::statistics(arguments[2]);
+    return Batch::usage();
+}
@@ -0,0 +1,16 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <QStringList>
+
+/* Planner's command line mode, for running without a window (e.g. on a
+   server sizing machines for big plans):
+
+       Planner --memory FILE    print the memory FILE's entries take
+       Planner --stats FILE     print how busy FILE's plan is, with hours
+                                booked per week and per day
+
+   Returns the process's exit status. */
+int runBatch(const QStringList &arguments);
+
+#endif // BATCH_H
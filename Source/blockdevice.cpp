@@ -0,0 +1,155 @@
+#include <QDataStream>
+#include <QtEndian>
+#include <cstring>
+
+#include "blockdevice.h"
+
+BlockWriter::BlockWriter(QIODevice *target, bool compress, int blockSize)
+    : target(target), compress(compress), blockSize(blockSize), records(0),
+      failed(false) {}
+
+qint64 BlockWriter::readData(char *, qint64) { return -1; }
+
+qint64 BlockWriter::writeData(const char *data, qint64 size)
+{
+    buffer.append(data, int(size));
+    return size;
+}
+
+/* Blocks only end between records (or string table strings), so every
+   block holds whole records. A block is closed once it reaches blockSize. */
+void BlockWriter::endRecord()
+{
+    records++;
+    if (buffer.size() >= blockSize) flushBlock();
+}
+
+// Close the current block early, so the next record starts a new one
+void BlockWriter::endBlock()
+{
+    if (!buffer.isEmpty()) flushBlock();
+}
+
+// Write out what's left and the end marker. Returns false on write errors.
+bool BlockWriter::finish()
+{
+    endBlock();
+    writeBlock(QByteArray());
+    return !failed;
+}
+
+QList<qint64>  BlockWriter::blockOffsets() const      { return offsets; }
+QList<quint32> BlockWriter::blockRecordCounts() const { return recordCounts; }
+
+void BlockWriter::flushBlock()
+{
+    offsets.append(target->pos());
+    recordCounts.append(records);
+    QByteArray stored = compress ? qCompress(buffer) : buffer;
+    if (buffer.size() > MaxBlockSize || stored.size() > MaxBlockSize)
+        failed = true;
+    else writeBlock(stored);
+    buffer.clear();
+    records = 0;
+}
+
+bool BlockWriter::writeBlock(const QByteArray &bytes)
+{
+    QDataStream out(target);
+    out << quint32(bytes.size());
+    if (out.status() != QDataStream::Ok
+            || target->write(bytes) != bytes.size())
+        failed = true;
+    return !failed;
+}
+
+
+
+
+BlockReader::BlockReader(QIODevice *source, bool compressed)
+    : source(source), compressed(compressed), pos(0), finished(false),
+      failed(false) {}
+
+bool BlockReader::hasError() const { return failed; }
+
+bool BlockReader::atEnd() const
+{
+    return pos >= block.size() && finished;
+}
+
+qint64 BlockReader::bytesAvailable() const
+{
+    return block.size() - pos + QIODevice::bytesAvailable();
+}
+
+qint64 BlockReader::writeData(const char *, qint64) { return -1; }
+
+qint64 BlockReader::readData(char *data, qint64 maxSize)
+{
+    qint64 done = 0;
+    while (done < maxSize) {
+        if (pos >= block.size() && (finished || !nextBlock())) break;
+
+        qint64 n = qMin(maxSize - done, qint64(block.size() - pos));
+        memcpy(data + done, block.constData() + pos, size_t(n));
+        pos += int(n);
+        done += n;
+    }
+
+    /* Look ahead at the next block header, so atEnd() is accurate as soon
+       as the last record has been read */
+    if (pos >= block.size() && !finished) nextBlock();
+
+    if (done == 0 && failed) return -1;
+    return done;
+}
+
+bool BlockReader::nextBlock()
+{
+    quint32 size;
+    QDataStream in(source);
+    in >> size;
+
+    block.clear();
+    pos = 0;
+    if (in.status() != QDataStream::Ok) {
+        failed = finished = true;
+        return false;
+    }
+    if (size == 0) {
+        finished = true;
+        return false;
+    }
+
+    /* Don't let a damaged byte count allocate more than the writer could
+       have stored, or more than is left of the file */
+    if (size > quint32(BlockWriter::MaxBlockSize) || (!source->isSequential()
+            && qint64(size) > source->size() - source->pos())) {
+        failed = finished = true;
+        return false;
+    }
+
+    QByteArray stored = source->read(size);
+    if (stored.size() != int(size)) {
+        failed = finished = true;
+        return false;
+    }
+
+    block = compressed ? uncompress(stored) : stored;
+    if (block.isEmpty()) {
+        failed = finished = true;
+        return false;
+    }
+    return true;
+}
+
+/* qUncompress() allocates whatever length the first four bytes claim, so
+   check it against what BlockWriter writes first. Empty if it's damaged. */
+QByteArray BlockReader::uncompress(const QByteArray &stored)
+{
+    if (stored.size() < 4) return QByteArray();
+    quint32 length = qFromBigEndian<quint32>(
+                reinterpret_cast<const uchar*>(stored.constData()));
+    if (length > quint32(BlockWriter::MaxBlockSize)) return QByteArray();
+    return qUncompress(stored);
+}
@@ -0,0 +1,86 @@
+#ifndef BLOCKDEVICE_H
+#define BLOCKDEVICE_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QList>
+
+/* The body of a version 5+ .pla file is a sequence of blocks, each a
+   quint32 byte count followed by that many bytes, and ended by an empty
+   block. In compressed files each block is a separate qCompress() buffer,
+   so any block can be decoded without the others.
+
+   BlockWriter and BlockReader sit between a QDataStream and the file, so
+   only one block is ever held in memory. BlockWriter also remembers where
+   each block went and how many records it holds, for the block index that
+   lets PlannerFile decode blocks in parallel. */
+
+class BlockWriter : public QIODevice
+{
+
+public:
+    /* Blocks only end between records, so they can run past blockSize,
+       but neither the stored nor the decoded bytes of a block may pass
+       MaxBlockSize, which readers rely on before allocating anything */
+    enum { DefaultBlockSize = 256 * 1024, MaxBlockSize = 64 * 1024 * 1024 };
+
+    BlockWriter(QIODevice *target, bool compress,
+                int blockSize = DefaultBlockSize);
+
+    void endRecord();
+    void endBlock();
+    bool finish();
+
+    QList<qint64>  blockOffsets() const;
+    QList<quint32> blockRecordCounts() const;
+
+    virtual bool isSequential() const { return true; }
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 size);
+
+private:
+    void flushBlock();
+    bool writeBlock(const QByteArray &bytes);
+
+    QIODevice *target;
+    bool compress;
+    int blockSize;
+    QByteArray buffer;
+    quint32 records;                // in buffer
+    QList<qint64> offsets;          // of each written block's byte count
+    QList<quint32> recordCounts;
+    bool failed;
+};
+
+class BlockReader : public QIODevice
+{
+
+public:
+    BlockReader(QIODevice *source, bool compressed);
+
+    bool hasError() const;
+
+    static QByteArray uncompress(const QByteArray &stored);
+
+    virtual bool isSequential() const { return true; }
+    virtual bool atEnd() const;
+    virtual qint64 bytesAvailable() const;
+
+protected:
+    virtual qint64 readData(char *data, qint64 maxSize);
+    virtual qint64 writeData(const char *data, qint64 size);
+
+private:
+    bool nextBlock();
+
+    QIODevice *source;
+    bool compressed;
+    QByteArray block;
+    int pos;
+    bool finished;
+    bool failed;
+};
+
+#endif // BLOCKDEVICE_H
@@ -0,0 +1,317 @@
+#include <QBuffer>
+#include <QDataStream>
+#include <QFile>
+
+#include "entryarchive.h"
+#include "plannerfile.h"
+#include "recurringentry.h"
+#include "trace.h"
+
+#include <string.h>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+EntryArchive::EntryArchive(const QString &fileName,
+                           AtomicFile::Durability durability)
+    : name(fileName), durability(durability), validSize(0), keysRead(0) {}
+
+// Where the plan saved as planFile archives its past entries
+QString EntryArchive::fileNameFor(const QString &planFile)
+{
+    return planFile + ".archive";
+}
+
+QString EntryArchive::fileName() const    { return name; }
+QString EntryArchive::errorString() const { return error; }
+
+/* Write entries (which stay the caller's) to the end of the archive as one
+   segment, leaving out any already archived as they are. A plan's cleared
+   entries stay in its file until it's saved, so discarding the changes (or
+   a failed save, or a crash) brings them back to be cleared again. Nothing
+   is added if any of it can't be written.
+
+   Other Planners may append to the same file (plans live on shared
+   folders), so the file is locked, and any segments they added since it
+   was last read are indexed before ours is written after them. */
+bool EntryArchive::append(const std::vector<AbstractEntry*> &entries)
+{
+    if (entries.empty()) return true;
+    TRACE_SCOPE("EntryArchive::append");
+
+    QFile file(name);
+    if (!file.open(QIODevice::ReadWrite)) {
+        error = tr("Cannot write file %1:\n%2.").arg(name)
+                                               .arg(file.errorString());
+        return false;
+    }
+    if (!lockFile(file)) {
+        error = tr("Cannot lock file %1:\n%2.").arg(name)
+                                              .arg(qt_error_string());
+        return false;
+    }
+    if (!scan(file) || !readKeys(file)) return false;
+
+    // Entries without an ID can't be told apart, so are always written
+    std::vector<AbstractEntry*> fresh;
+    std::vector<Key> keys;
+    for (uint i = 0; i < entries.size(); i++) {
+        Key key(entries[i]->id(), entries[i]->contentHash());
+        if (key.first != 0 && archivedKeys.contains(key)) continue;
+        fresh.push_back(entries[i]);
+        keys.push_back(key);
+    }
+    TRACE_COUNT(fresh.size());
+    if (fresh.empty()) return true;
+
+    Segment segment;
+    segment.entries = quint32(fresh.size());
+    segment.firstStart = fresh[0]->startMSecs();
+    segment.lastEnd = fresh[0]->endMSecs();
+    for (uint i = 0; i < fresh.size(); i++) {
+        const AbstractEntry *e = fresh[i];
+        qint64 end = e->isRecurring()
+                ? static_cast<const RecurringEntry*>(e)->lastEndMSecs()
+                : e->endMSecs();
+        segment.firstStart = qMin(segment.firstStart, e->startMSecs());
+        segment.lastEnd = qMax(segment.lastEnd, end);
+    }
+
+    QBuffer body;
+    body.open(QIODevice::WriteOnly);
+    PlannerFile plannerFile;
+    plannerFile.setCompressed(true);
+    if (!plannerFile.write(&body, fresh)) {
+        error = plannerFile.errorString();
+        return false;
+    }
+    segment.bytes = quint32(body.size());
+
+    /* Start a new file with its header. With the lock held and every
+       whole segment indexed, anything past them was cut short by a writer
+       that crashed, and is dropped so the new segment follows the last
+       whole one. */
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_1);
+    qint64 oldSize = validSize;
+    bool ok = true;
+    if (validSize == 0) {
+        ok = file.resize(0) && file.seek(0);
+        out << quint32(ArchiveMagicNumber) << quint16(ArchiveFormatVersion);
+        validSize = HeaderSize;
+    }
+    else if (file.size() != validSize) ok = file.resize(validSize);
+
+    segment.keysOffset = validSize + SegmentHeaderSize;
+    segment.offset = segment.keysOffset + KeySize * qint64(segment.entries);
+    ok = ok && file.seek(validSize);
+    if (ok) {
+        out << segment.bytes << segment.entries << segment.firstStart
+            << segment.lastEnd;
+        for (uint i = 0; i < keys.size(); i++)
+            out << keys[i].first << keys[i].second;
+        ok = out.writeRawData(body.data().constData(), int(segment.bytes))
+             == int(segment.bytes);
+    }
+
+    ok = ok && out.status() == QDataStream::Ok && file.flush()
+         && (durability == AtomicFile::NoSync || syncFile(file));
+    if (!ok) {
+        error = tr("Cannot write file %1:\n%2.").arg(name)
+                                               .arg(file.errorString());
+        file.resize(oldSize);
+        validSize = oldSize;
+        return false;
+    }
+
+    segments.append(segment);
+    keysRead = segments.size();
+    for (uint i = 0; i < keys.size(); i++) archivedKeys.insert(keys[i]);
+    validSize = segment.offset + segment.bytes;
+    return true;
+}
+
+/* Append to "found" every archived entry with an occurrence between from
+   and to, in the order they were archived. Segments that ended before from
+   or started after to are passed over without being read. Nothing is
+   appended if a segment can't be read. */
+bool EntryArchive::entries(qint64 from, qint64 to,
+                           std::vector<AbstractEntry*> &found)
+{
+    TRACE_SCOPE("EntryArchive::entries");
+    QFile file(name);
+    if (!file.exists()) return true;
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = tr("Cannot read file %1:\n%2.").arg(name)
+                                              .arg(file.errorString());
+        return false;
+    }
+    if (!scan(file)) return false;
+
+    QDateTime fromDT = QDateTime::fromMSecsSinceEpoch(from);
+    QDateTime toDT = QDateTime::fromMSecsSinceEpoch(to);
+    std::vector<AbstractEntry*> loaded, matched;
+    for (int i = 0; i < segments.size(); i++) {
+        if (segments[i].lastEnd < from || segments[i].firstStart > to)
+            continue;
+
+        loaded.clear();
+        if (!readSegment(file, segments[i], loaded)) {
+            for (uint k = 0; k < matched.size(); k++) delete matched[k];
+            return false;
+        }
+        for (uint k = 0; k < loaded.size(); k++) {
+            if (loaded[k]->occurrences(fromDT, toDT).isEmpty())
+                delete loaded[k];
+            else matched.push_back(loaded[k]);
+        }
+    }
+    TRACE_COUNT(matched.size());
+    found.insert(found.end(), matched.begin(), matched.end());
+    return true;
+}
+
+// How many entries have been archived in all
+int EntryArchive::count()
+{
+    QFile file(name);
+    if (file.open(QIODevice::ReadOnly)) scan(file);
+
+    int total = 0;
+    for (int i = 0; i < segments.size(); i++) total += segments[i].entries;
+    return total;
+}
+
+/* Index the headers of the segments added since the archive was last
+   looked at, by this Planner or another, seeking from one to the next. A
+   file cut short before its header is an empty archive, and a segment that
+   isn't all there (still being written, or cut short) is left out. */
+bool EntryArchive::scan(QFile &file)
+{
+    qint64 size = file.size();
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_1);
+
+    if (validSize == 0) {
+        if (size < HeaderSize) return true;
+
+        quint32 magic;
+        quint16 version;
+        file.seek(0);
+        in >> magic >> version;
+        if (in.status() != QDataStream::Ok || magic != ArchiveMagicNumber) {
+            error = tr("%1 is not a Planner archive.").arg(name);
+            return false;
+        }
+        if (version > ArchiveFormatVersion) {
+            error = tr("%1 was written by a newer version of Planner.")
+                    .arg(name);
+            return false;
+        }
+        validSize = HeaderSize;
+    }
+
+    while (validSize + SegmentHeaderSize <= size && file.seek(validSize)) {
+        Segment segment;
+        in >> segment.bytes >> segment.entries >> segment.firstStart
+           >> segment.lastEnd;
+        segment.keysOffset = validSize + SegmentHeaderSize;
+        segment.offset = segment.keysOffset
+                         + KeySize * qint64(segment.entries);
+        if (in.status() != QDataStream::Ok
+                || segment.offset + segment.bytes > size)
+            break;
+
+        segments.append(segment);
+        validSize = segment.offset + segment.bytes;
+    }
+    return true;
+}
+
+/* Read the IDs and content hashes of the entries in segments indexed since
+   the last append. Only appends need them, to leave out entries that are
+   already archived. */
+bool EntryArchive::readKeys(QFile &file)
+{
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_1);
+    for (; keysRead < segments.size(); keysRead++) {
+        const Segment &segment = segments[keysRead];
+        if (!file.seek(segment.keysOffset)) break;
+        for (quint32 i = 0; i < segment.entries; i++) {
+            Key key;
+            in >> key.first >> key.second;
+            archivedKeys.insert(key);
+        }
+        if (in.status() != QDataStream::Ok) break;
+    }
+
+    if (keysRead < segments.size()) {
+        error = tr("Cannot read file %1:\n%2.").arg(name)
+                                              .arg(file.errorString());
+        return false;
+    }
+    return true;
+}
+
+bool EntryArchive::readSegment(QFile &file, const Segment &segment,
+                               std::vector<AbstractEntry*> &loaded)
+{
+    QByteArray bytes;
+    if (file.seek(segment.offset)) bytes = file.read(segment.bytes);
+    if (bytes.size() != int(segment.bytes)) {
+        error = tr("Cannot read file %1:\n%2.").arg(name)
+                                              .arg(file.errorString());
+        return false;
+    }
+
+    QBuffer body(&bytes);
+    body.open(QIODevice::ReadOnly);
+    PlannerFile plannerFile;
+    if (!plannerFile.read(&body, loaded)) {
+        error = tr("%1 is damaged:\n%2").arg(name)
+                                        .arg(plannerFile.errorString());
+        return false;
+    }
+    return true;
+}
+
+/* Wait for an exclusive lock on the file, released when it's closed.
+   Only a byte far past the end is locked, so it keeps other writers out
+   without stopping anyone from reading. */
+bool EntryArchive::lockFile(QFile &file)
+{
+#ifdef Q_OS_WIN
+    OVERLAPPED overlapped;
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.OffsetHigh = 0x7FFFFFFF;
+    HANDLE handle = (HANDLE)_get_osfhandle(file.handle());
+    return LockFileEx(handle, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped);
+#else
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = 0x7FFFFFFF;     // locks are only advisory here
+    lock.l_len = 1;
+    int result;
+    do result = ::fcntl(file.handle(), F_SETLKW, &lock);
+    while (result == -1 && errno == EINTR);
+    return result == 0;
+#endif
+}
+
+bool EntryArchive::syncFile(QFile &file)
+{
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
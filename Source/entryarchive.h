@@ -0,0 +1,83 @@
+#ifndef ENTRYARCHIVE_H
+#define ENTRYARCHIVE_H
+
+#include <QCoreApplication>
+#include <QList>
+#include <QPair>
+#include <QSet>
+#include <vector>
+
+#include "atomicfile.h"
+
+class AbstractEntry;
+class QFile;
+
+// Arbitrary fixed 32-bit integer that starts every archive file
+#define ArchiveMagicNumber 0x37406D6D
+#define ArchiveFormatVersion 1
+
+/* Past entries moved out of a plan, kept in a file of their own next to it
+   (the plan's name plus ".archive") instead of being deleted. The file is
+   only ever appended to: each archiving adds one segment, a small header
+   (entry count, earliest start, latest end, body size), each entry's ID
+   and content hash, then the entries written as a compressed .pla body by
+   PlannerFile. The IDs and hashes let an entry that's cleared again (say,
+   after the plan's changes were discarded) be recognized and left out.
+
+   Nothing is read until the archive is first queried or appended to. Then
+   only the segment headers are read, by seeking from one to the next (and
+   later only those of segments added since), and a query decodes just the
+   segments whose time span it overlaps. Appends lock the file, so several
+   Planners can share it. A segment cut short by a crash is ignored, and
+   written over by the next append. */
+class EntryArchive
+{
+    Q_DECLARE_TR_FUNCTIONS(EntryArchive)
+
+public:
+    EntryArchive(const QString &fileName,
+                 AtomicFile::Durability durability = AtomicFile::SyncFile);
+
+    static QString fileNameFor(const QString &planFile);
+
+    QString fileName() const;
+    bool    append(const std::vector<AbstractEntry*> &entries);
+    bool    entries(qint64 from, qint64 to,
+                    std::vector<AbstractEntry*> &found);
+    int     count();
+    QString errorString() const;
+
+private:
+    typedef QPair<quint64, quint64> Key;   // an entry's ID and content hash
+
+    struct Segment {
+        qint64  keysOffset; // of the entries' keys
+        qint64  offset;     // of the body
+        quint32 bytes;
+        quint32 entries;
+        qint64  firstStart;
+        qint64  lastEnd;
+    };
+
+    enum { HeaderSize = 4 + 2 };
+    enum { SegmentHeaderSize = 4 + 4 + 8 + 8 };
+    enum { KeySize = 8 + 8 };
+
+    bool scan(QFile &file);
+    bool readKeys(QFile &file);
+    bool readSegment(QFile &file, const Segment &segment,
+                     std::vector<AbstractEntry*> &loaded);
+    bool lockFile(QFile &file);
+    bool syncFile(QFile &file);
+
+    QString name;
+    AtomicFile::Durability durability;
+    QList<Segment> segments;
+    qint64 validSize;       // bytes up to the end of the last whole segment
+                            // indexed; 0 before the header is read
+    int keysRead;           // segments whose keys are in archivedKeys
+    QSet<Key> archivedKeys;
+    QString error;
+};
+
+#endif // ENTRYARCHIVE_H
@@ -0,0 +1,143 @@
+#include <QtConcurrentMap>
+#include <algorithm>
+
+#include "fuzzymatch.h"
+#include "abstractentry.h"
+
+// Closest first, then earliest in the name, then shortest name
+bool FuzzyMatch::operator<(const FuzzyMatch &other) const
+{
+    if (distance != other.distance) return distance < other.distance;
+    if (position != other.position) return position < other.position;
+    if (length != other.length) return length < other.length;
+    return index < other.index;
+}
+
+static inline ushort foldCase(ushort c)
+{
+    if (c < 128) return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    return QChar(c).toLower().unicode();
+}
+
+FuzzyMatcher::FuzzyMatcher(const QString &pattern)
+{
+    length = qMin(pattern.size(), 64);
+    errors = length / 4;
+
+    for (int c = 0; c < 128; c++) asciiMasks[c] = 0;
+    for (int i = 0; i < length; i++) {
+        ushort c = foldCase(pattern.at(i).unicode());
+        if (c < 128) asciiMasks[c] |= Q_UINT64_C(1) << i;
+        else otherMasks[c] |= Q_UINT64_C(1) << i;
+    }
+}
+
+inline quint64 FuzzyMatcher::charMask(ushort c) const
+{
+    c = foldCase(c);
+    if (c < 128) return asciiMasks[c];
+    return otherMasks.value(c);
+}
+
+/* The fewest edits that turn the pattern into some substring of text, and
+   where that substring ends. The bit vectors hold the vertical deltas of
+   the current column (Pv: +1, Mv: -1); "score" follows the table's last
+   row, which is the distance of a match ending at the current character.
+   Horizontal deltas get no carry into row 0, since a match may start
+   anywhere in text. */
+bool FuzzyMatcher::match(const QString &text, FuzzyMatch *found) const
+{
+    if (length == 0) return false;
+
+    const quint64 last = Q_UINT64_C(1) << (length - 1);
+    quint64 pv = ~Q_UINT64_C(0), mv = 0;
+    int score = length, best = length, bestEnd = -1;
+    const QChar *chars = text.constData();
+
+    for (int j = 0; j < text.size(); j++) {
+        quint64 eq = charMask(chars[j].unicode());
+        quint64 xv = eq | mv;
+        quint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+        quint64 ph = mv | ~(xh | pv);
+        quint64 mh = pv & xh;
+        if (ph & last) score++;
+        else if (mh & last) score--;
+        ph <<= 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+
+        if (score < best) {
+            best = score;
+            bestEnd = j;
+            if (best == 0) break;   // can't do better, nor sooner
+        }
+    }
+
+    if (best > errors) return false;
+    if (found) {
+        found->distance = best;
+        found->position = qMax(0, bestEnd - length + 1);
+        found->length = text.size();
+    }
+    return true;
+}
+
+// Matches a range of entries' names, on one of QtConcurrent's threads
+struct ChunkMatcher
+{
+    typedef std::vector<FuzzyMatch> result_type;
+
+    ChunkMatcher(const FuzzyMatcher *matcher,
+                 const std::vector<AbstractEntry*> *entries)
+        : matcher(matcher), entries(entries) {}
+
+    std::vector<FuzzyMatch> operator()(int begin) const
+    {
+        std::vector<FuzzyMatch> matches;
+        int end = qMin(begin + int(ChunkSize), int(entries->size()));
+        FuzzyMatch m;
+        for (int i = begin; i < end; i++) {
+            if (matcher->match((*entries)[i]->name(), &m)) {
+                m.index = i;
+                matches.push_back(m);
+            }
+        }
+        return matches;
+    }
+
+    enum { ChunkSize = 8 * 1024 };
+    const FuzzyMatcher *matcher;
+    const std::vector<AbstractEntry*> *entries;
+};
+
+/* Every entry whose name matches, best first. Big plans are split into
+   chunks matched in parallel; the entries mustn't change meanwhile. */
+std::vector<FuzzyMatch> FuzzyMatcher::search(
+        const std::vector<AbstractEntry*> &entries) const
+{
+    ChunkMatcher matchChunk(this, &entries);
+    std::vector<FuzzyMatch> matches;
+
+    if (entries.size() < uint(ParallelThreshold)) {
+        for (uint begin = 0; begin < entries.size();
+             begin += ChunkMatcher::ChunkSize) {
+            std::vector<FuzzyMatch> chunk = matchChunk(int(begin));
+            matches.insert(matches.end(), chunk.begin(), chunk.end());
+        }
+    }
+    else {
+        QList<int> chunks;
+        for (uint begin = 0; begin < entries.size();
+             begin += ChunkMatcher::ChunkSize)
+            chunks.append(int(begin));
+        QList<std::vector<FuzzyMatch> > found =
+                QtConcurrent::blockingMapped<QList<std::vector<FuzzyMatch> > >(
+                    chunks, matchChunk);
+        for (int i = 0; i < found.size(); i++)
+            matches.insert(matches.end(), found[i].begin(), found[i].end());
+    }
+
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
@@ -0,0 +1,52 @@
+#ifndef FUZZYMATCH_H
+#define FUZZYMATCH_H
+
+#include <QHash>
+#include <QString>
+#include <vector>
+
+class AbstractEntry;
+
+// Where a name matched the pattern, and how closely
+struct FuzzyMatch
+{
+    int index;      // of the entry, in the vector searched
+    int distance;   // edits (insertions, deletions, substitutions) needed
+    int position;   // roughly where in the name the match starts
+    int length;     // of the name
+
+    bool operator<(const FuzzyMatch &other) const;
+};
+
+/* Finds names that contain the pattern with a few typos, ignoring case.
+   Uses Myers' bit-parallel edit distance: the pattern's columns of the
+   dynamic programming table are packed into one 64-bit word, so each
+   character of a name costs a handful of word operations and names are
+   scored at millions per second. Patterns longer than 64 characters are
+   matched on their first 64.
+
+   A name matches if some part of it is within maxErrors() edits of the
+   pattern; that allows one typo for each four characters typed, so
+   "Quartely review" finds "Quarterly review". */
+class FuzzyMatcher
+{
+public:
+    explicit FuzzyMatcher(const QString &pattern);
+
+    int  maxErrors() const { return errors; }
+    bool match(const QString &text, FuzzyMatch *match) const;
+    std::vector<FuzzyMatch> search(
+            const std::vector<AbstractEntry*> &entries) const;
+
+private:
+    enum { ParallelThreshold = 32 * 1024 };  // entries; then use all cores
+
+    quint64 charMask(ushort c) const;
+
+    int length;
+    int errors;
+    quint64 asciiMasks[128];        // bit i set where pattern[i] is c
+    QHash<ushort, quint64> otherMasks;
+};
+
+#endif // FUZZYMATCH_H
@@ -0,0 +1,957 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QIODevice>
+#include <QThread>
+#include <QtConcurrentMap>
+#include <climits>
+#include <cstring>
+
+#include "interchange.h"
+#include "plannerentry.h"
+#include "recurringentry.h"
+
+static const char *CsvColumns = "Name,Start,End,Notes,Created,Repeat,Tags";
+static const char *CsvDateTimeFormat = "yyyy-MM-dd HH:mm:ss";
+
+// Longest .ics line in octets, not counting the line break (RFC 5545)
+static const int IcsLineOctets = 75;
+
+InterchangeFormat formatForFile(const QString &fileName)
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    if (suffix == "ics" || suffix == "ical") return ICalendarFormat;
+    return CsvFormat;
+}
+
+
+
+
+/******************************************************************************
+    FIELD CONVERSIONS
+******************************************************************************/
+
+// Quote a CSV field if it holds anything that would otherwise split it
+static QString csvField(const QString &s)
+{
+    bool quote = false;
+    for (int i = 0; i < s.size() && !quote; i++) {
+        ushort c = s[i].unicode();
+        quote = (c == ',' || c == '"' || c == '\n' || c == '\r');
+    }
+    if (!quote) return s;
+
+    QString quoted = s;
+    quoted.replace('"', "\"\"");
+    return QString("\"%1\"").arg(quoted);
+}
+
+// Escape TEXT values: backslashes, semicolons, commas and line breaks
+static QString icsEscape(const QString &s)
+{
+    QString escaped;
+    escaped.reserve(s.size());
+    for (int i = 0; i < s.size(); i++) {
+        switch (s[i].unicode()) {
+        case '\\': escaped += "\\\\"; break;
+        case ';':  escaped += "\\;";  break;
+        case ',':  escaped += "\\,";  break;
+        case '\n': escaped += "\\n";  break;
+        case '\r': break;
+        default:   escaped += s[i];
+        }
+    }
+    return escaped;
+}
+
+// Local ("floating") times, as Planner keeps them
+static QString icsLocal(const QDateTime &dt)
+{
+    return dt.date().toString("yyyyMMdd") + 'T' + dt.time().toString("HHmmss");
+}
+
+static QString icsUtc(const QDateTime &dt)
+{
+    return icsLocal(dt.toUTC()) + 'Z';
+}
+
+
+
+
+/******************************************************************************
+    EXPORTING
+******************************************************************************/
+
+EntryExporter::EntryExporter(InterchangeFormat format) : format(format) {}
+
+QString EntryExporter::errorString() const { return error; }
+
+bool EntryExporter::write(QIODevice *device,
+                          const std::vector<AbstractEntry*> &entries)
+{
+    QTextStream out(device);
+    out.setCodec("UTF-8");
+
+    if (format == CsvFormat) {
+        out << CsvColumns << "\r\n";
+        for (uint i = 0; i < entries.size(); i++)
+            writeCsvRecord(out, entries[i]);
+    }
+    else {
+        QString stamp = icsUtc(QDateTime::currentDateTime());
+        writeIcsLine(out, "BEGIN:VCALENDAR");
+        writeIcsLine(out, "VERSION:2.0");
+        writeIcsLine(out, "PRODID:-//MSF091886//Planner//EN");
+        for (uint i = 0; i < entries.size(); i++)
+            writeIcsEvent(out, entries[i], stamp);
+        writeIcsLine(out, "END:VCALENDAR");
+    }
+    out.flush();
+
+    QFile *file = qobject_cast<QFile*>(device);
+    if (out.status() != QTextStream::Ok
+        || (file && file->error() != QFile::NoError)) {
+        error = file ? file->errorString() : tr("Could not write the data.");
+        return false;
+    }
+    return true;
+}
+
+void EntryExporter::writeCsvRecord(QTextStream &out,
+                                   const AbstractEntry *entry)
+{
+    out << csvField(entry->name()) << ','
+        << entry->startDateTime().toString(CsvDateTimeFormat) << ','
+        << entry->endDateTime().toString(CsvDateTimeFormat) << ','
+        << csvField(entry->notes()) << ','
+        << entry->whenAdded().toString(CsvDateTimeFormat) << ',';
+    if (entry->isRecurring())
+        out << static_cast<const RecurringEntry*>(entry)->ruleString();
+    out << ',' << csvField(entry->tags().join(",")) << "\r\n";
+}
+
+void EntryExporter::writeIcsEvent(QTextStream &out, const AbstractEntry *entry,
+                                  const QString &stamp)
+{
+    /* The entry's ID keeps the UID the same from one export to the next,
+       and brings the ID back on import. */
+    writeIcsLine(out, "BEGIN:VEVENT");
+    writeIcsLine(out, QString("UID:%1@planner")
+                      .arg(entry->id(), 16, 16, QChar('0')));
+    writeIcsLine(out, "DTSTAMP:" + stamp);
+    writeIcsLine(out, "CREATED:" + icsUtc(entry->whenAdded()));
+    writeIcsLine(out, "DTSTART:" + icsLocal(entry->startDateTime()));
+    writeIcsLine(out, "DTEND:" + icsLocal(entry->endDateTime()));
+    writeIcsLine(out, "SUMMARY:" + icsEscape(entry->name()));
+    if (!entry->notes().isEmpty())
+        writeIcsLine(out, "DESCRIPTION:" + icsEscape(entry->notes()));
+    if (entry->isRecurring())
+        writeIcsLine(out, "RRULE:" + static_cast<const RecurringEntry*>(entry)
+                                     ->ruleString());
+    if (!entry->tags().isEmpty()) {
+        QStringList tags = entry->tags();
+        for (int i = 0; i < tags.size(); i++) tags[i] = icsEscape(tags[i]);
+        writeIcsLine(out, "CATEGORIES:" + tags.join(","));
+    }
+    writeIcsLine(out, "END:VEVENT");
+}
+
+/* Write a content line, folding it onto continuation lines (which start
+   with a space) so none is longer than 75 octets of UTF-8. */
+void EntryExporter::writeIcsLine(QTextStream &out, const QString &line)
+{
+    int octets = 0, start = 0;
+    for (int i = 0; i < line.size(); i++) {
+        ushort c = line[i].unicode();
+        int width;
+        if (c < 0x80) width = 1;
+        else if (c < 0x800) width = 2;
+        else if (QChar::isHighSurrogate(c)) width = 4;
+        else if (QChar::isLowSurrogate(c)) width = 0;  // counted with its pair
+        else width = 3;
+
+        if (octets + width > IcsLineOctets) {
+            out << line.mid(start, i - start) << "\r\n ";
+            start = i;
+            octets = 1;
+        }
+        octets += width;
+    }
+    out << line.mid(start) << "\r\n";
+}
+
+
+
+
+/******************************************************************************
+    TOKENIZING
+******************************************************************************/
+
+static const qint64 MSecsPerDay = Q_INT64_C(86400000);
+static const qint64 MSecsPerHour = Q_INT64_C(3600000);
+static const int EpochJulianDay = 2440588;  // 1970-01-01
+
+// Inputs at least this big are split into chunks parsed concurrently
+static const qint64 ParallelThreshold = 8 * 1024 * 1024;
+
+static inline char upper(char c)
+{
+    return (c >= 'a' && c <= 'z') ? char(c - 'a' + 'A') : c;
+}
+
+/* A range of the input's bytes. Tokens are spans of the mapped file, so
+   nothing is copied or decoded until a record is accepted as an entry. */
+struct Span
+{
+    const char *begin;
+    const char *end;
+
+    Span() : begin(0), end(0) {}
+    Span(const char *begin, const char *end) : begin(begin), end(end) {}
+
+    int  size() const    { return int(end - begin); }
+    bool isEmpty() const { return begin == end; }
+
+    Span trimmed() const
+    {
+        const char *b = begin, *e = end;
+        while (b < e && (*b == ' ' || *b == '\t')) b++;
+        while (e > b && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) e--;
+        return Span(b, e);
+    }
+
+    // Equal to the ASCII literal s, ignoring case
+    bool is(const char *s) const
+    {
+        const char *p = begin;
+        for (; *s; s++, p++)
+            if (p == end || upper(*p) != upper(*s)) return false;
+        return p == end;
+    }
+};
+
+static QString decode(const Span &s)
+{
+    if (s.isEmpty()) return QString();
+    return QString::fromUtf8(s.begin, s.size());
+}
+
+// A TEXT value with its backslash escapes undone
+static QString icsText(const Span &s)
+{
+    if (s.isEmpty() || !memchr(s.begin, '\\', s.size())) return decode(s);
+
+    QByteArray text;
+    text.reserve(s.size());
+    for (const char *p = s.begin; p < s.end; p++) {
+        if (*p == '\\' && p + 1 < s.end) {
+            p++;
+            text += (*p == 'n' || *p == 'N') ? '\n' : *p;
+        }
+        else text += *p;
+    }
+    return QString::fromUtf8(text);
+}
+
+// A CSV field with doubled quotes undone and CRLFs inside it made LFs
+static QString csvText(const Span &s)
+{
+    if (s.isEmpty() || (!memchr(s.begin, '"', s.size())
+                        && !memchr(s.begin, '\r', s.size())))
+        return decode(s);
+
+    QByteArray text;
+    text.reserve(s.size());
+    for (const char *p = s.begin; p < s.end; p++) {
+        if (*p == '"' && p + 1 < s.end && p[1] == '"') p++;
+        else if (*p == '\r' && p + 1 < s.end && p[1] == '\n') continue;
+        text += *p;
+    }
+    return QString::fromUtf8(text);
+}
+
+static bool number(const char *p, int digits, int &value)
+{
+    value = 0;
+    for (int i = 0; i < digits; i++) {
+        if (p[i] < '0' || p[i] > '9') return false;
+        value = value * 10 + (p[i] - '0');
+    }
+    return true;
+}
+
+// Julian day number of a Gregorian date
+static int julianDay(int y, int m, int d)
+{
+    int a = (14 - m) / 12;
+    int yy = y + 4800 - a;
+    int mm = m + 12 * a - 3;
+    return d + (153 * mm + 2) / 5 + 365 * yy + yy / 4 - yy / 100 + yy / 400
+           - 32045;
+}
+
+// A DURATION such as "PT1H30M" or "P2D" in seconds, or -1 if malformed
+static qint64 icsDurationSecs(const Span &value)
+{
+    Span v = value.trimmed();
+    const char *p = v.begin;
+    if (p < v.end && *p == '+') p++;
+    if (p == v.end || upper(*p) != 'P') return -1;
+
+    qint64 secs = 0, n = 0;
+    bool digits = false;
+    for (p++; p < v.end; p++) {
+        if (*p >= '0' && *p <= '9') {
+            n = n * 10 + (*p - '0');
+            digits = true;
+            continue;
+        }
+        if (upper(*p) == 'T') continue;
+        if (!digits) return -1;
+
+        switch (upper(*p)) {
+        case 'W': secs += n * 7 * 86400; break;
+        case 'D': secs += n * 86400;     break;
+        case 'H': secs += n * 3600;      break;
+        case 'M': secs += n * 60;        break;
+        case 'S': secs += n;             break;
+        default:  return -1;
+        }
+        n = 0;
+        digits = false;
+    }
+    return digits ? -1 : secs;
+}
+
+/* Turns local wall clock times into milliseconds since the epoch. QDateTime
+   asks the C library for every conversion; the UTC offset only changes on
+   the hour (at DST switches), so it's looked up once per hour and cached.
+   Not thread-safe: every parser has its own. */
+class LocalClock
+{
+
+public:
+    LocalClock()
+    {
+        for (int i = 0; i < Slots; i++) hours[i] = -1;
+    }
+
+    qint64 toMSecs(int julian, int msecsOfDay)
+    {
+        qint64 wall = qint64(julian - EpochJulianDay) * MSecsPerDay
+                      + msecsOfDay;
+        qint64 hour = qint64(julian) * 24 + msecsOfDay / MSecsPerHour;
+        int slot = int(hour & (Slots - 1));
+
+        if (hours[slot] != hour) {
+            int h = int(msecsOfDay / MSecsPerHour);
+            QDateTime local(QDate::fromJulianDay(julian), QTime(h, 0));
+            offsets[slot] = (wall - msecsOfDay + h * MSecsPerHour)
+                            - local.toMSecsSinceEpoch();
+            hours[slot] = hour;
+        }
+        return wall - offsets[slot];
+    }
+
+private:
+    enum { Slots = 256 };
+    qint64 hours[Slots];
+    qint64 offsets[Slots];
+};
+
+// The entry ID in a UID written by Planner ("<16 hex digits>@planner"), or 0
+static quint64 plannerId(const Span &uid)
+{
+    if (uid.size() != 24 || !Span(uid.begin + 16, uid.end).is("@planner"))
+        return 0;
+
+    quint64 id = 0;
+    for (const char *p = uid.begin; p < uid.begin + 16; p++) {
+        char c = upper(*p);
+        if (c >= '0' && c <= '9') id = id << 4 | quint64(c - '0');
+        else if (c >= 'A' && c <= 'F') id = id << 4 | quint64(c - 'A' + 10);
+        else return 0;
+    }
+    return id;
+}
+
+/* Whether an RRULE part that RecurringEntry has no use for changes nothing,
+   because it only names what the start already implies, as many calendars
+   write for weekly (BYDAY), monthly (BYMONTHDAY) and yearly (BYMONTH)
+   rules. WKST only matters alongside BYDAY. */
+static bool impliedByStart(const QString &part,
+                           RecurringEntry::Frequency frequency,
+                           const QDate &start)
+{
+    static const char *days[] = { "MO", "TU", "WE", "TH", "FR", "SA", "SU" };
+    QString key = part.section('=', 0, 0);
+    QString value = part.section('=', 1);
+
+    if (key == "WKST") return true;
+    if (key == "BYDAY" && frequency == RecurringEntry::Weekly)
+        return value == days[start.dayOfWeek() - 1];
+    if (key == "BYMONTHDAY" && frequency != RecurringEntry::Daily
+            && frequency != RecurringEntry::Weekly)
+        return value.toInt() == start.day();
+    if (key == "BYMONTH" && frequency == RecurringEntry::Yearly)
+        return value.toInt() == start.month();
+    return false;
+}
+
+/* The entry, recurring if it has a rule. A rule with parts that can't be
+   represented (such as several weekdays) keeps the rest, and one that
+   repeats more often than daily is dropped; either way simplified is set,
+   so the import can say so. */
+static AbstractEntry *makeEntry(const QString &name, qint64 start,
+                                qint64 end, const QString &notes,
+                                qint64 whenAdded, const Span &rule,
+                                bool &simplified)
+{
+    RecurringEntry::Frequency frequency;
+    int interval, count;
+    QDate until;
+    QStringList ignored;
+    simplified = false;
+    if (rule.trimmed().isEmpty())
+        return new PlannerEntry(name, start, end, notes, whenAdded);
+
+    if (!RecurringEntry::parseRule(decode(rule), frequency, interval, count,
+                                   until, &ignored)) {
+        simplified = true;
+        return new PlannerEntry(name, start, end, notes, whenAdded);
+    }
+
+    QDateTime startDT = QDateTime::fromMSecsSinceEpoch(start);
+    for (int i = 0; i < ignored.size() && !simplified; i++)
+        simplified = !impliedByStart(ignored[i], frequency, startDT.date());
+    return new RecurringEntry(name, startDT,
+                              QDateTime::fromMSecsSinceEpoch(end), notes,
+                              QDateTime::fromMSecsSinceEpoch(whenAdded),
+                              frequency, interval, count, until);
+}
+
+/* Parses records in place from a range of the input. One is used for the
+   whole input, or one per chunk when chunks are parsed concurrently. */
+class RecordParser
+{
+
+public:
+    explicit RecordParser(InterchangeFormat format);
+
+    bool readHeader(const char *&pos, const char *end, QString &error);
+    int  parse(const char *&pos, const char *end,
+               std::vector<AbstractEntry*> &entries, int maxEntries);
+    int  skipped() const { return skippedRecords; }
+    int  simplified() const { return simplifiedRules; }
+
+private:
+    bool physicalLine(const char *&pos, const char *end, Span &line);
+    bool icsLine(const char *&pos, const char *end, Span &line);
+    void csvRecord(const char *&pos, const char *end);
+    Span field(int column) const;
+    bool dateTime(const Span &span, qint64 &msecs, bool *dateOnly = 0);
+
+    AbstractEntry *csvEntry();
+    AbstractEntry *icsEvent(const char *&pos, const char *end);
+
+    InterchangeFormat format;
+    int nameColumn, startColumn, endColumn;
+    int notesColumn, createdColumn, repeatColumn, tagsColumn;
+    QVector<Span> fields;       // of the current CSV record
+    QList<QByteArray> unfolded; // joined copies of the current event's
+                                // folded lines
+    LocalClock clock;
+    int skippedRecords;
+    int simplifiedRules;
+};
+
+RecordParser::RecordParser(InterchangeFormat format)
+    : format(format), nameColumn(-1), startColumn(-1), endColumn(-1),
+      notesColumn(-1), createdColumn(-1), repeatColumn(-1), tagsColumn(-1),
+      skippedRecords(0), simplifiedRules(0) {}
+
+/* CSV files start with a record naming the columns, of which only Name,
+   Start and End are required; .ics files with BEGIN:VCALENDAR. */
+bool RecordParser::readHeader(const char *&pos, const char *end,
+                              QString &error)
+{
+    if (format == ICalendarFormat) {
+        Span line;
+        while (physicalLine(pos, end, line) && line.trimmed().isEmpty()) {}
+        if (!line.trimmed().is("BEGIN:VCALENDAR")) {
+            error = EntryImporter::tr("This is not an iCalendar file.");
+            return false;
+        }
+        return true;
+    }
+
+    if (pos >= end) {
+        error = EntryImporter::tr("The file is empty.");
+        return false;
+    }
+
+    csvRecord(pos, end);
+    for (int i = 0; i < fields.size(); i++) {
+        Span column = fields[i].trimmed();
+        if (column.is("name")) nameColumn = i;
+        else if (column.is("start")) startColumn = i;
+        else if (column.is("end")) endColumn = i;
+        else if (column.is("notes")) notesColumn = i;
+        else if (column.is("created")) createdColumn = i;
+        else if (column.is("repeat")) repeatColumn = i;
+        else if (column.is("tags")) tagsColumn = i;
+    }
+
+    if (nameColumn < 0 || startColumn < 0 || endColumn < 0) {
+        error = EntryImporter::tr("The file needs Name, Start and End "
+                                  "columns.");
+        return false;
+    }
+    return true;
+}
+
+/* Parse up to maxEntries entries from pos on, appending them to entries
+   and advancing pos past them. Returns how many were added. */
+int RecordParser::parse(const char *&pos, const char *end,
+                        std::vector<AbstractEntry*> &entries, int maxEntries)
+{
+    int added = 0;
+    Span line;
+    while (added < maxEntries && pos < end) {
+        AbstractEntry *e;
+        if (format == CsvFormat) {
+            csvRecord(pos, end);
+            if (fields.size() == 1 && fields[0].trimmed().isEmpty())
+                continue;   // blank line
+            e = csvEntry();
+        }
+        else {
+            physicalLine(pos, end, line);
+            if (!line.trimmed().is("BEGIN:VEVENT")) continue;
+            e = icsEvent(pos, end);
+        }
+
+        if (e == NULL) {
+            skippedRecords++;
+            continue;
+        }
+        entries.push_back(e);
+        added++;
+    }
+    return added;
+}
+
+bool RecordParser::physicalLine(const char *&pos, const char *end, Span &line)
+{
+    if (pos >= end) return false;
+
+    const char *nl = (const char*)memchr(pos, '\n', end - pos);
+    const char *lineEnd = nl ? nl : end;
+    if (lineEnd > pos && lineEnd[-1] == '\r') lineEnd--;
+    line = Span(pos, lineEnd);
+    pos = nl ? nl + 1 : end;
+    return true;
+}
+
+/* The next content line. Lines are folded by starting continuations with
+   a space or tab; only those are joined, into a copy that lasts until the
+   next event. */
+bool RecordParser::icsLine(const char *&pos, const char *end, Span &line)
+{
+    if (!physicalLine(pos, end, line)) return false;
+    if (pos >= end || (*pos != ' ' && *pos != '\t')) return true;
+
+    QByteArray joined(line.begin, line.size());
+    Span piece;
+    while (pos < end && (*pos == ' ' || *pos == '\t')) {
+        physicalLine(pos, end, piece);
+        joined.append(piece.begin + 1, piece.size() - 1);
+    }
+    unfolded.append(joined);
+
+    const char *data = unfolded.last().constData();
+    line = Span(data, data + joined.size());
+    return true;
+}
+
+/* Split the next record into fields. A quoted field may hold commas,
+   doubled quotes and line breaks; its span excludes the outer quotes. */
+void RecordParser::csvRecord(const char *&pos, const char *end)
+{
+    fields.clear();
+    const char *p = pos;
+    forever {
+        if (p < end && *p == '"') {
+            const char *begin = ++p;
+            while (p < end && (*p != '"' || (p + 1 < end && p[1] == '"')))
+                p += (*p == '"') ? 2 : 1;
+            fields.append(Span(begin, p));
+
+            // Skip the closing quote and anything up to the separator
+            while (p < end && *p != ',' && *p != '\n') p++;
+        }
+        else {
+            const char *begin = p;
+            while (p < end && *p != ',' && *p != '\n') p++;
+
+            const char *fieldEnd = p;
+            if (fieldEnd > begin && fieldEnd[-1] == '\r'
+                && (p == end || *p == '\n'))
+                fieldEnd--;
+            fields.append(Span(begin, fieldEnd));
+        }
+
+        if (p >= end) break;
+        if (*p++ == '\n') break;
+    }
+    pos = p;
+}
+
+Span RecordParser::field(int column) const
+{
+    return (column >= 0 && column < fields.size()) ? fields[column] : Span();
+}
+
+/* The fixed-width forms both formats use, without going through
+   QDateTime::fromString(): "yyyyMMdd[THHmmss]" (iCalendar) and
+   "yyyy-MM-dd[ HH:mm[:ss]]" with a space or T (CSV), each optionally
+   ending in Z for UTC. Anything else falls back to Qt's ISO parser.
+   dateOnly is set for values without a time of day. */
+bool RecordParser::dateTime(const Span &span, qint64 &msecs, bool *dateOnly)
+{
+    Span s = span.trimmed();
+    const char *p = s.begin;
+    int n = s.size();
+    bool utc = n > 0 && upper(s.end[-1]) == 'Z';
+    if (utc) n--;
+
+    int y, mo, d, h = 0, mi = 0, sec = 0;
+    bool ok;
+    if (n >= 8 && number(p, 4, y) && number(p + 4, 2, mo)
+        && number(p + 6, 2, d))
+        ok = n == 8 || (n == 15 && upper(p[8]) == 'T'
+                        && number(p + 9, 2, h) && number(p + 11, 2, mi)
+                        && number(p + 13, 2, sec));
+    else if (n >= 10 && p[4] == '-' && p[7] == '-' && number(p, 4, y)
+             && number(p + 5, 2, mo) && number(p + 8, 2, d))
+        ok = n == 10 || ((n == 16 || n == 19)
+                         && (p[10] == ' ' || upper(p[10]) == 'T')
+                         && p[13] == ':' && number(p + 11, 2, h)
+                         && number(p + 14, 2, mi)
+                         && (n == 16 || (p[16] == ':'
+                                         && number(p + 17, 2, sec))));
+    else ok = false;
+
+    if (!ok || !QDate::isValid(y, mo, d) || h > 23 || mi > 59 || sec > 59) {
+        QDateTime dt = QDateTime::fromString(decode(s), Qt::ISODate);
+        if (!dt.isValid()) return false;
+        msecs = dt.toMSecsSinceEpoch();
+        if (dateOnly) *dateOnly = false;
+        return true;
+    }
+
+    int julian = julianDay(y, mo, d);
+    int msecsOfDay = ((h * 60 + mi) * 60 + sec) * 1000;
+    if (utc) msecs = qint64(julian - EpochJulianDay) * MSecsPerDay
+                     + msecsOfDay;
+    else msecs = clock.toMSecs(julian, msecsOfDay);
+
+    if (dateOnly) *dateOnly = (n == 8 || n == 10);
+    return true;
+}
+
+AbstractEntry *RecordParser::csvEntry()
+{
+    qint64 start, end, created;
+    Span name = field(nameColumn).trimmed();
+    if (name.isEmpty() || !dateTime(field(startColumn), start)
+        || !dateTime(field(endColumn), end) || start > end)
+        return NULL;
+
+    if (!dateTime(field(createdColumn), created))
+        created = QDateTime::currentMSecsSinceEpoch();
+
+    bool simplified;
+    AbstractEntry *entry = makeEntry(csvText(name), start, end,
+                                     csvText(field(notesColumn)), created,
+                                     field(repeatColumn), simplified);
+    if (simplified) simplifiedRules++;
+    Span tags = field(tagsColumn);
+    if (!tags.isEmpty())
+        entry->setTags(AbstractEntry::parseTags(csvText(tags)));
+    return entry;
+}
+
+/* Read the rest of a VEVENT, up to its END line. Properties of components
+   nested inside it (such as a VALARM's DESCRIPTION) are ignored. */
+AbstractEntry *RecordParser::icsEvent(const char *&pos, const char *end)
+{
+    Span name, notes, rule, uid, line;
+    QString categories;
+    qint64 start = 0, finish = 0, created = 0, stamp = 0, duration = -1;
+    bool haveStart = false, haveEnd = false;
+    bool haveCreated = false, haveStamp = false;
+    bool startIsDate = false, endIsDate = false, ended = false;
+    int depth = 0;
+    unfolded.clear();
+
+    while (!ended && icsLine(pos, end, line)) {
+        // Split "NAME;PARAM=...:value" at the first colon outside quotes
+        const char *colon = 0;
+        bool quoted = false;
+        for (const char *p = line.begin; p < line.end && !colon; p++) {
+            if (*p == '"') quoted = !quoted;
+            else if (*p == ':' && !quoted) colon = p;
+        }
+        if (!colon) continue;
+
+        const char *semi = (const char*)memchr(line.begin, ';',
+                                               colon - line.begin);
+        Span property(line.begin, semi ? semi : colon);
+        Span value(colon + 1, line.end);
+
+        if (property.is("BEGIN")) depth++;
+        else if (property.is("END")) {
+            if (depth == 0) ended = true;
+            else depth--;
+        }
+        else if (depth > 0) continue;
+        else if (property.is("SUMMARY")) name = value;
+        else if (property.is("DESCRIPTION")) notes = value;
+        else if (property.is("DTSTART"))
+            haveStart = dateTime(value, start, &startIsDate);
+        else if (property.is("DTEND"))
+            haveEnd = dateTime(value, finish, &endIsDate);
+        else if (property.is("DURATION")) duration = icsDurationSecs(value);
+        else if (property.is("CREATED"))
+            haveCreated = dateTime(value, created);
+        else if (property.is("DTSTAMP")) haveStamp = dateTime(value, stamp);
+        else if (property.is("RRULE")) rule = value;
+        else if (property.is("UID")) uid = value;
+        else if (property.is("CATEGORIES"))
+            categories += ',' + icsText(value);
+    }
+
+    if (!ended || !haveStart) return NULL;
+
+    if (!haveEnd) {
+        if (duration >= 0) finish = start + duration * 1000;
+        else if (startIsDate)
+            finish = QDateTime::fromMSecsSinceEpoch(start).addDays(1)
+                     .toMSecsSinceEpoch();
+        else finish = start;
+    }
+
+    /* A date-only end is exclusive (midnight after the last day), but an
+       entry includes its end time, so stop a second short of it. */
+    if ((startIsDate || endIsDate) && finish > start) finish -= 1000;
+    if (start > finish) return NULL;
+
+    if (!haveCreated)
+        created = haveStamp ? stamp : QDateTime::currentMSecsSinceEpoch();
+
+    QString entryName = icsText(name.trimmed());
+    if (entryName.isEmpty()) entryName = EntryImporter::tr("Untitled");
+
+    bool simplified;
+    AbstractEntry *entry = makeEntry(entryName, start, finish, icsText(notes),
+                                     created, rule, simplified);
+    if (simplified) simplifiedRules++;
+    if (entry) {
+        entry->setId(plannerId(uid.trimmed()));
+        entry->setTags(AbstractEntry::parseTags(categories));
+    }
+    return entry;
+}
+
+/* Split [begin, end) into about count chunks, each starting on a record
+   boundary: a BEGIN:VEVENT line, or a CSV line break outside quotes (found
+   by following the quotes from the start, since a quoted field can span
+   lines). */
+static QList<Span> splitIntoChunks(const char *begin, const char *end,
+                                   int count, InterchangeFormat format)
+{
+    QList<Span> chunks;
+    qint64 step = (end - begin) / count + 1;
+    const char *chunkStart = begin, *p = begin;
+    bool quoted = false;
+
+    for (int i = 1; i < count; i++) {
+        const char *target = begin + step * i;
+        const char *cut = 0;
+
+        if (format == ICalendarFormat) {
+            const char *q = qMax(target, chunkStart);
+            while (!cut && q < end) {
+                const char *nl = (const char*)memchr(q, '\n', end - q);
+                if (!nl) break;
+                q = nl + 1;
+                if (end - q >= 12 && memcmp(q, "BEGIN:VEVENT", 12) == 0)
+                    cut = q;
+            }
+        }
+        else {
+            for (; !cut && p < end; p++) {
+                if (*p == '"') quoted = !quoted;
+                else if (*p == '\n' && !quoted && p >= target) cut = p + 1;
+            }
+        }
+
+        if (!cut || cut >= end) break;
+        chunks.append(Span(chunkStart, cut));
+        chunkStart = cut;
+    }
+    chunks.append(Span(chunkStart, end));
+    return chunks;
+}
+
+struct ParsedChunk
+{
+    std::vector<AbstractEntry*> entries;
+    int skipped;
+    int simplified;
+};
+
+/* Parses one chunk with its own copy of the parser, which has already read
+   the header. Run on several chunks at once by QtConcurrent. */
+struct ChunkParser
+{
+    typedef ParsedChunk result_type;
+
+    ChunkParser(const RecordParser *prototype) : prototype(prototype) {}
+
+    ParsedChunk operator()(const Span &chunk) const
+    {
+        RecordParser parser(*prototype);
+        ParsedChunk result;
+        const char *pos = chunk.begin;
+        parser.parse(pos, chunk.end, result.entries, INT_MAX);
+        result.skipped = parser.skipped() - prototype->skipped();
+        result.simplified = parser.simplified() - prototype->simplified();
+        return result;
+    }
+
+    const RecordParser *prototype;
+};
+
+
+
+
+/******************************************************************************
+    IMPORTING
+******************************************************************************/
+
+EntryImporter::EntryImporter(QIODevice *device, InterchangeFormat format)
+    : device(device), format(format), parser(new RecordParser(format)),
+      map(0), pos(0), end(0), started(false), parallel(true), handedOut(0),
+      skippedRecords(0), simplifiedRules(0) {}
+
+// Entries parsed but never handed out are still ours
+EntryImporter::~EntryImporter()
+{
+    while (!parsed.isEmpty()) {
+        std::vector<AbstractEntry*> &chunk = parsed.first();
+        for (uint i = handedOut; i < chunk.size(); i++) delete chunk[i];
+        parsed.removeFirst();
+        handedOut = 0;
+    }
+    delete parser;
+
+    QFile *file = qobject_cast<QFile*>(device);
+    if (map && file) file->unmap(map);
+}
+
+/* Whether big inputs may be split into chunks that are parsed on all
+   cores. On by default. */
+void EntryImporter::setParallel(bool parallel)
+{
+    this->parallel = parallel;
+}
+
+bool    EntryImporter::hasError() const    { return !error.isEmpty(); }
+QString EntryImporter::errorString() const { return error; }
+
+// Records that couldn't be made into entries so far
+int EntryImporter::skipped() const
+{
+    return skippedRecords + parser->skipped();
+}
+
+/* Entries imported so far whose repeat rule had to be simplified, since it
+   had parts Planner can't represent */
+int EntryImporter::simplified() const
+{
+    return simplifiedRules + parser->simplified();
+}
+
+/* Append up to maxEntries entries to batch, owned by the caller. Returns
+   false once there are no more (or on error, see hasError()). */
+bool EntryImporter::readBatch(std::vector<AbstractEntry*> &batch,
+                              int maxEntries)
+{
+    if (!started && !start()) return false;
+    if (hasError()) return false;
+
+    int added = 0;
+    while (added < maxEntries && !parsed.isEmpty()) {
+        std::vector<AbstractEntry*> &chunk = parsed.first();
+        while (added < maxEntries && handedOut < chunk.size()) {
+            batch.push_back(chunk[handedOut++]);
+            added++;
+        }
+        if (handedOut == chunk.size()) {
+            parsed.removeFirst();
+            handedOut = 0;
+        }
+    }
+
+    added += parser->parse(pos, end, batch, maxEntries - added);
+    return added > 0;
+}
+
+/* Map the file, so the parser works on the page cache directly, or read a
+   device that can't be mapped into memory. Then check the header. */
+bool EntryImporter::start()
+{
+    started = true;
+
+    QFile *file = qobject_cast<QFile*>(device);
+    if (file && file->size() > 0) map = file->map(0, file->size());
+
+    if (map) {
+        pos = (const char*)map;
+        end = pos + file->size();
+    }
+    else {
+        buffer = device->readAll();
+        pos = buffer.constData();
+        end = pos + buffer.size();
+    }
+
+    if (end - pos >= 3 && memcmp(pos, "\xEF\xBB\xBF", 3) == 0)
+        pos += 3;   // UTF-8 byte order mark
+    if (!parser->readHeader(pos, end, error)) return false;
+
+    if (parallel && end - pos >= ParallelThreshold
+        && QThread::idealThreadCount() > 1)
+        parseInParallel();
+    return true;
+}
+
+/* Parse everything after the header at once, a chunk per task; readBatch()
+   then hands the results out in order. */
+void EntryImporter::parseInParallel()
+{
+    QList<Span> chunks = splitIntoChunks(pos, end,
+                                         QThread::idealThreadCount() * 4,
+                                         format);
+    QList<ParsedChunk> results =
+            QtConcurrent::blockingMapped<QList<ParsedChunk> >(chunks,
+                                                        ChunkParser(parser));
+
+    for (int i = 0; i < results.size(); i++) {
+        parsed.append(results[i].entries);
+        skippedRecords += results[i].skipped;
+        simplifiedRules += results[i].simplified;
+    }
+    pos = end;
+}
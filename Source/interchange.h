@@ -0,0 +1,89 @@
+#ifndef INTERCHANGE_H
+#define INTERCHANGE_H
+
+#include <QCoreApplication>
+#include <QList>
+#include <QTextStream>
+#include <vector>
+
+class QIODevice;
+class AbstractEntry;
+
+// Formats shared with other calendar programs
+enum InterchangeFormat { CsvFormat, ICalendarFormat };
+
+InterchangeFormat formatForFile(const QString &fileName);
+
+/* Writes entries as CSV or iCalendar (.ics). Each entry goes straight to the
+   device through a QTextStream, which hands it fixed-size chunks, so memory
+   use is the same for ten entries or a million.
+
+   Times are written as local ("floating") times, as Planner stores them.
+   Recurring entries become an RRULE in .ics files and a Repeat column in
+   CSV files; tags become CATEGORIES and a Tags column. */
+class EntryExporter
+{
+    Q_DECLARE_TR_FUNCTIONS(EntryExporter)
+
+public:
+    explicit EntryExporter(InterchangeFormat format);
+
+    bool    write(QIODevice *device,
+                  const std::vector<AbstractEntry*> &entries);
+    QString errorString() const;
+
+private:
+    void writeCsvRecord(QTextStream &out, const AbstractEntry *entry);
+    void writeIcsEvent(QTextStream &out, const AbstractEntry *entry,
+                       const QString &stamp);
+    void writeIcsLine(QTextStream &out, const QString &line);
+
+    InterchangeFormat format;
+    QString error;
+};
+
+class RecordParser;
+
+/* Reads CSV files (with at least Name, Start and End columns, in any order)
+   or the VEVENTs of iCalendar files, handing back a batch of entries at a
+   time. Files are memory-mapped and tokenized in place; a field is only
+   decoded into a QString once its record has been accepted as an entry.
+   Big files are split at record boundaries and parsed on all cores.
+   Records that can't be made into entries are skipped and counted, as are
+   repeat rules that could only be imported in part. */
+class EntryImporter
+{
+    Q_DECLARE_TR_FUNCTIONS(EntryImporter)
+
+public:
+    EntryImporter(QIODevice *device, InterchangeFormat format);
+    ~EntryImporter();
+
+    void    setParallel(bool parallel);
+    bool    readBatch(std::vector<AbstractEntry*> &batch, int maxEntries);
+    bool    hasError() const;
+    QString errorString() const;
+    int     skipped() const;
+    int     simplified() const;
+
+private:
+    bool start();
+    void parseInParallel();
+
+    QIODevice *device;
+    InterchangeFormat format;
+    RecordParser *parser;
+    QByteArray buffer;      // the input, if the device couldn't be mapped
+    uchar *map;
+    const char *pos;
+    const char *end;
+    bool started;
+    bool parallel;
+    QList<std::vector<AbstractEntry*> > parsed; // by parseInParallel()
+    uint handedOut;         // entries of parsed.first() already handed out
+    int skippedRecords;
+    int simplifiedRules;
+    QString error;
+};
+
+#endif // INTERCHANGE_H
@@ -1,10 +1,31 @@
 #include <QtGui/QApplication>
+#include <QDateTime>
 #include "plannermainwindow.h"
+#include "trace.h"
+#include "batch.h"
 
 int main(int argc, char *argv[])
 {
+    // Options select the command line mode, which needs no display
+    if (argc > 1 && qstrncmp(argv[1], "--", 2) == 0) {
+        QCoreApplication app(argc, argv);
+        return runBatch(app.arguments());
+    }
+
     QApplication a(argc, argv);
+
+    // Entry IDs are random, so no two sessions may share a sequence
+    qsrand(uint(QDateTime::currentMSecsSinceEpoch())
+           ^ uint(QCoreApplication::applicationPid()));
+
     PlannerMainWindow w;
     w.show();
-    return a.exec();
+    int status = a.exec();
+
+#ifdef PLANNER_TRACING
+    // PLANNER_TRACE=file.json saves the session's timings on exit
+    QString traceFile = QString::fromLocal8Bit(qgetenv("PLANNER_TRACE"));
+    if (!traceFile.isEmpty()) Trace::writeJson(traceFile);
+#endif
+    return status;
 }
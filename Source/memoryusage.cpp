@@ -0,0 +1,108 @@
+#include "memoryusage.h"
+#include "plannerentry.h"
+#include "recurringentry.h"
+
+/* QString's header in front of its characters, whose size depends on the
+   pointer size. The type is private, but reachable through the public
+   DataPtr typedef. Its last member holds the first character, so with
+   the terminating null, a string takes its capacity plus one. */
+static const int StringHeader = int(sizeof(*QString::DataPtr(0)));
+
+static QString formatBytes(qint64 bytes)
+{
+    if (bytes >= 10 * 1024 * 1024)
+        return MemoryUsage::tr("%1 MB").arg(bytes / (1024.0 * 1024.0), 0,
+                                            'f', 1);
+    if (bytes >= 10 * 1024)
+        return MemoryUsage::tr("%1 KB").arg(bytes / 1024);
+    return MemoryUsage::tr("%1 bytes").arg(bytes);
+}
+
+void MemoryUsage::add(const QString &subsystem, qint64 objects, qint64 bytes)
+{
+    Line line = { subsystem, objects, bytes };
+    lines.append(line);
+}
+
+/* The entries themselves, and the characters of their names, notes and
+   tags. Strings shared between entries (such as interned ones) count once. */
+void MemoryUsage::addEntries(const std::vector<AbstractEntry*> &entries)
+{
+    qint64 entryBytes = 0, stringBytesTotal = 0;
+    QSet<const QChar*> seen;
+
+    for (uint i = 0; i < entries.size(); i++) {
+        const AbstractEntry *e = entries[i];
+        entryBytes += block(e->isRecurring() ? sizeof(RecurringEntry)
+                                             : sizeof(PlannerEntry));
+
+        QStringList strings = e->tags();
+        if (!strings.isEmpty())     // the list's own array of pointers
+            entryBytes += block(sizeof(QListData::Data)
+                                + (strings.size() - 1) * sizeof(void*));
+        strings << e->name() << e->notes();
+        for (int j = 0; j < strings.size(); j++) {
+            if (strings[j].capacity() == 0
+                    || seen.contains(strings[j].constData()))
+                continue;
+            seen.insert(strings[j].constData());
+            stringBytesTotal += stringBytes(strings[j]);
+        }
+    }
+
+    add(tr("Entries"), qint64(entries.size()), entryBytes);
+    add(tr("Names, notes and tags"), seen.size(), stringBytesTotal);
+}
+
+qint64 MemoryUsage::total() const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < lines.size(); i++) bytes += lines[i].bytes;
+    return bytes;
+}
+
+QString MemoryUsage::report() const
+{
+    QString text;
+    for (int i = 0; i < lines.size(); i++) {
+        text += QString("%1 %2 %3\n")
+                .arg(lines[i].subsystem, -24)
+                .arg(lines[i].objects, 10)
+                .arg(formatBytes(lines[i].bytes), 12);
+    }
+    text += QString("%1 %2 %3\n").arg(tr("Total"), -24).arg("", 10)
+            .arg(formatBytes(total()), 12);
+    return text;
+}
+
+QString MemoryUsage::reportHtml() const
+{
+    QString html = "<table cellspacing=\"4\">";
+    html += tr("<tr><th align=\"left\">Part</th><th align=\"right\">Count"
+               "</th><th align=\"right\">Memory</th></tr>");
+    for (int i = 0; i < lines.size(); i++) {
+        html += QString("<tr><td>%1</td><td align=\"right\">%2</td>"
+                        "<td align=\"right\">%3</td></tr>")
+                .arg(lines[i].subsystem).arg(lines[i].objects)
+                .arg(formatBytes(lines[i].bytes));
+    }
+    html += QString("<tr><td><b>%1</b></td><td></td>"
+                    "<td align=\"right\"><b>%2</b></td></tr></table>")
+            .arg(tr("Total")).arg(formatBytes(total()));
+    return html;
+}
+
+/* What malloc really takes for a block of size bytes: a header word, then
+   rounding up to 16 bytes, with a minimum of four words. */
+qint64 MemoryUsage::block(qint64 size)
+{
+    qint64 chunk = (size + qint64(sizeof(void*)) + 15) & ~Q_INT64_C(15);
+    return qMax(chunk, qint64(4 * sizeof(void*)));
+}
+
+// The heap block behind s (nothing for the shared empty strings)
+qint64 MemoryUsage::stringBytes(const QString &s)
+{
+    if (s.capacity() == 0) return 0;
+    return block(StringHeader + s.capacity() * qint64(sizeof(QChar)));
+}
@@ -0,0 +1,60 @@
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include <QCoreApplication>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <vector>
+
+class AbstractEntry;
+
+/* Heap memory used by a plan, broken down by subsystem (entries, strings,
+   list items, each index...), for the Memory Usage dialog and for
+   "Planner --memory". The figures are estimates made by walking the
+   structures on request and allowing for the allocator's header and
+   rounding on each block, so nothing is counted while Planner runs. */
+class MemoryUsage
+{
+    Q_DECLARE_TR_FUNCTIONS(MemoryUsage)
+
+public:
+    void    add(const QString &subsystem, qint64 objects, qint64 bytes);
+    void    addEntries(const std::vector<AbstractEntry*> &entries);
+    qint64  total() const;
+    QString report() const;
+    QString reportHtml() const;
+
+    static qint64 block(qint64 size);
+    static qint64 stringBytes(const QString &s);
+
+    template <class Key, class T>
+    static qint64 hashBytes(const QHash<Key, T> &hash)
+    {
+        return block(sizeof(QHashData)) + hash.capacity() * qint64(sizeof(void*))
+               + hash.size() * block(sizeof(QHashNode<Key, T>));
+    }
+
+    template <class T>
+    static qint64 setBytes(const QSet<T> &set)
+    {
+        return block(sizeof(QHashData)) + set.capacity() * qint64(sizeof(void*))
+               + set.size() * block(sizeof(QHashNode<T, QHashDummyValue>));
+    }
+
+    template <class T>
+    static qint64 vectorBytes(const std::vector<T> &v)
+    {
+        return v.capacity() ? block(v.capacity() * sizeof(T)) : 0;
+    }
+
+private:
+    struct Line {
+        QString subsystem;
+        qint64 objects;
+        qint64 bytes;
+    };
+    QList<Line> lines;
+};
+
+#endif // MEMORYUSAGE_H
@@ -0,0 +1,46 @@
+#include <QFile>
+
+#include "plafilebackend.h"
+#include "plannerfile.h"
+
+PlaFileBackend::PlaFileBackend(const QString &fileName,
+                               const StorageOptions &options)
+    : name(fileName), options(options) {}
+
+QString PlaFileBackend::fileName() const    { return name; }
+QString PlaFileBackend::errorString() const { return error; }
+
+bool PlaFileBackend::load(std::vector<AbstractEntry*> &entries)
+{
+    QFile file(name);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = tr("Cannot read file %1:\n%2.").arg(name)
+                                              .arg(file.errorString());
+        return false;
+    }
+
+    PlannerFile plannerFile;
+    if (!plannerFile.read(&file, entries)) {
+        error = plannerFile.errorString();
+        return false;
+    }
+    return true;
+}
+
+/* Save through a temporary file, so the old file survives a failed save */
+bool PlaFileBackend::save(const std::vector<AbstractEntry*> &entries)
+{
+    AtomicFile file(name, options.durability);
+    PlannerFile plannerFile;
+    plannerFile.setCompressed(options.compressed);
+
+    QString reason;
+    if (!file.open()) reason = file.errorString();
+    else if (!plannerFile.write(file.device(), entries))
+        reason = plannerFile.errorString();
+    else if (!file.commit()) reason = file.errorString();
+    else return true;
+
+    error = tr("Cannot write file %1:\n%2.").arg(name).arg(reason);
+    return false;
+}
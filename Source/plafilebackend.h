@@ -0,0 +1,26 @@
+#ifndef PLAFILEBACKEND_H
+#define PLAFILEBACKEND_H
+
+#include "storagebackend.h"
+
+/* Stores a document as a .pla file (see PlannerFile). Loading reads the
+   whole file; saving rewrites it through an AtomicFile. */
+class PlaFileBackend : public StorageBackend
+{
+    Q_DECLARE_TR_FUNCTIONS(PlaFileBackend)
+
+public:
+    PlaFileBackend(const QString &fileName, const StorageOptions &options);
+
+    virtual QString fileName() const;
+    virtual bool    load(std::vector<AbstractEntry*> &entries);
+    virtual bool    save(const std::vector<AbstractEntry*> &entries);
+    virtual QString errorString() const;
+
+private:
+    QString name;
+    StorageOptions options;
+    QString error;
+};
+
+#endif // PLAFILEBACKEND_H
@@ -1,27 +1,48 @@
-#include <QDebug>
 #include "plannerentry.h"
 
 PlannerEntry::PlannerEntry(QString name, QDateTime startDateTime, QDateTime endDateTime,
              QString notes, QDateTime whenAdded)
-    : AbstractEntry(name, notes), _startDateTime(startDateTime), _endDateTime(endDateTime),
-      _whenAdded(whenAdded) {}
+    : AbstractEntry(name, notes),
+      _startMSecs(startDateTime.toMSecsSinceEpoch()),
+      _endMSecs(endDateTime.toMSecsSinceEpoch()),
+      _whenAddedMSecs(whenAdded.toMSecsSinceEpoch()) {}
 
-PlannerEntry::~PlannerEntry()
+PlannerEntry::PlannerEntry(QString name, qint64 startMSecs, qint64 endMSecs,
+             QString notes, qint64 whenAddedMSecs)
+    : AbstractEntry(name, notes), _startMSecs(startMSecs), _endMSecs(endMSecs),
+      _whenAddedMSecs(whenAddedMSecs) {}
+
+PlannerEntry::~PlannerEntry() {}
+
+AbstractEntry *PlannerEntry::clone() const
+{
+    return new PlannerEntry(*this);
+}
+
+QDateTime PlannerEntry::startDateTime() const
+{
+    return QDateTime::fromMSecsSinceEpoch(_startMSecs);
+}
+QDateTime PlannerEntry::endDateTime() const
+{
+    return QDateTime::fromMSecsSinceEpoch(_endMSecs);
+}
+QDateTime PlannerEntry::whenAdded() const
 {
-    qDebug() << "in PlannerEntry dtor";
+    return QDateTime::fromMSecsSinceEpoch(_whenAddedMSecs);
 }
 
-QDateTime PlannerEntry::startDateTime() const  { return _startDateTime; }
-QDateTime PlannerEntry::endDateTime() const    { return _endDateTime; }
-QDateTime PlannerEntry::whenAdded() const      { return _whenAdded; }
+qint64 PlannerEntry::startMSecs() const     { return _startMSecs; }
+qint64 PlannerEntry::endMSecs() const       { return _endMSecs; }
+qint64 PlannerEntry::whenAddedMSecs() const { return _whenAddedMSecs; }
 
 
 
 void PlannerEntry::setStartDateTime(QDateTime newDT)
 {
-    _startDateTime = newDT;
+    _startMSecs = newDT.toMSecsSinceEpoch();
 }
 void PlannerEntry::setEndDateTime(QDateTime newDT)
 {
-    _endDateTime = newDT;
+    _endMSecs = newDT.toMSecsSinceEpoch();
 }
@@ -3,25 +3,36 @@
 
 #include "abstractentry.h"
 
+/* Date/times are kept as milliseconds since the epoch and only turned into
+   (local time) QDateTimes for the interface. Every entry is entered in local
+   time, so no time spec needs storing alongside. */
 class PlannerEntry : public AbstractEntry
 {
 
 public:
     PlannerEntry(QString name, QDateTime startDateTime, QDateTime endDateTime,
           QString notes, QDateTime whenAdded);
+    PlannerEntry(QString name, qint64 startMSecs, qint64 endMSecs,
+          QString notes, qint64 whenAddedMSecs);
     virtual ~PlannerEntry();
 
+    virtual AbstractEntry *clone() const;
+
     virtual QDateTime startDateTime() const;
     virtual QDateTime endDateTime() const;
     virtual QDateTime whenAdded() const;
 
+    virtual qint64 startMSecs() const;
+    virtual qint64 endMSecs() const;
+    virtual qint64 whenAddedMSecs() const;
+
     virtual void setStartDateTime(QDateTime newDT);
     virtual void setEndDateTime(QDateTime newDT);
 
 private:
-    QDateTime       _startDateTime;
-    QDateTime       _endDateTime;
-    const QDateTime _whenAdded;
+    qint64       _startMSecs;
+    qint64       _endMSecs;
+    const qint64 _whenAddedMSecs;
 };
 
 #endif // PLANNERENTRY_H
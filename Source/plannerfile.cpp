@@ -0,0 +1,460 @@
+#include <QDataStream>
+#include <QFile>
+#include <QIODevice>
+#include <QtConcurrentMap>
+#include <QtEndian>
+
+#include "plannerfile.h"
+#include "blockdevice.h"
+#include "plannerentry.h"
+#include "recurringentry.h"
+
+/* What one block of a version 6 file decodes to */
+struct DecodedBlock
+{
+    std::vector<AbstractEntry*> entries;
+    QVector<QString> strings;
+    bool ok;
+};
+
+/* Decodes one block straight out of the memory-mapped file. Run on several
+   blocks at once by QtConcurrent, so it only reads shared state. */
+struct BlockDecoder
+{
+    typedef DecodedBlock result_type;
+
+    BlockDecoder(const PlannerFile *plannerFile, const uchar *map,
+                 qint64 size, bool compressed)
+        : plannerFile(plannerFile), map(map), size(size),
+          compressed(compressed) {}
+
+    DecodedBlock operator()(const PlannerFile::BlockSpan &span) const
+    {
+        DecodedBlock result;
+        result.ok = false;
+        if (span.offset < 0 || span.offset + 4 > size) return result;
+
+        quint32 stored = qFromBigEndian<quint32>(map + span.offset);
+        if (stored == 0 || stored > quint32(BlockWriter::MaxBlockSize)
+                || span.offset + 4 + stored > size)
+            return result;
+
+        QByteArray bytes = QByteArray::fromRawData(
+                    (const char*)map + span.offset + 4, int(stored));
+        if (compressed) bytes = BlockReader::uncompress(bytes);
+
+        QDataStream in(bytes);
+        in.setVersion(QDataStream::Qt_4_1);
+        if (span.first) {
+            quint32 count;
+            in >> count;
+        }
+
+        for (quint32 i = 0; i < span.records
+                            && in.status() == QDataStream::Ok; i++) {
+            if (span.strings) {
+                QString s;
+                in >> s;
+                result.strings.append(s);
+            }
+            else result.entries.push_back(plannerFile->getEntryFromStream(in));
+        }
+
+        result.ok = in.status() == QDataStream::Ok && in.atEnd();
+        if (!result.ok) {
+            for (uint i = 0; i < result.entries.size(); i++)
+                delete result.entries[i];
+            result.entries.clear();
+        }
+        return result;
+    }
+
+    const PlannerFile *plannerFile;
+    const uchar *map;
+    qint64 size;
+    bool compressed;
+};
+
+PlannerFile::PlannerFile() : version(FileFormatVersion), compressed(false) {}
+
+// Whether write() compresses the file body
+void PlannerFile::setCompressed(bool compress) { compressed = compress; }
+
+QString PlannerFile::errorString() const { return error; }
+
+bool PlannerFile::write(QIODevice *device,
+                        const std::vector<AbstractEntry*> &entries)
+{
+    QDataStream header(device);
+    header.setVersion(QDataStream::Qt_4_1);
+    header << quint32(VersionedMagicNumber) << quint16(FileFormatVersion)
+           << quint8(compressed ? CompressedFlag : 0);
+
+    BlockWriter blocks(device, compressed);
+    blocks.open(QIODevice::WriteOnly | QIODevice::Unbuffered);
+    QDataStream out(&blocks);
+    out.setVersion(QDataStream::Qt_4_1);
+
+    buildStringTable(entries);
+    out << quint32(stringTable.size());
+    for (int i = 0; i < stringTable.size(); i++) {
+        out << stringTable[i];
+        blocks.endRecord();
+    }
+    blocks.endBlock();
+    int stringBlocks = blocks.blockOffsets().size();
+
+    std::vector<AbstractEntry*>::const_iterator it;
+    for (it = entries.begin(); it != entries.end(); it++) {
+        sendEntryToStream(*it, out);
+        blocks.endRecord();
+    }
+
+    if (header.status() != QDataStream::Ok || out.status() != QDataStream::Ok
+            || !blocks.finish() || !writeIndex(device, blocks, stringBlocks)) {
+        error = device->errorString();
+        return false;
+    }
+    return true;
+}
+
+/* Appends the file's entries to "entries". Nothing is appended if the file
+   can't be read completely. */
+bool PlannerFile::read(QIODevice *device, std::vector<AbstractEntry*> &entries)
+{
+    QDataStream header(device);
+    header.setVersion(QDataStream::Qt_4_1);
+
+    quint32 magic;
+    quint8 flags = 0;
+    version = 1;
+    header >> magic;
+    if (magic == VersionedMagicNumber) header >> version;
+    else if (magic != MagicNumber) {
+        error = tr("The file is not a Planner file.");
+        return false;
+    }
+
+    if (version > FileFormatVersion) {
+        error = tr("The file was saved by a newer version of Planner.");
+        return false;
+    }
+    if (version >= 5) header >> flags;
+
+    /* Anything the parallel reader can't handle (no index, a device that
+       can't be mapped) is read again from the start of the body */
+    std::vector<AbstractEntry*> loaded;
+    bool ok = false;
+    if (header.status() == QDataStream::Ok && version >= 6
+            && !device->isSequential()) {
+        qint64 bodyStart = device->pos();
+        ok = readParallel(device, flags, loaded);
+        if (!ok) device->seek(bodyStart);
+    }
+    if (!ok && header.status() == QDataStream::Ok)
+        ok = readSequential(device, flags, loaded);
+
+    if (!ok) {
+        error = tr("The file is damaged or incomplete.");
+        return false;
+    }
+
+    entries.insert(entries.end(), loaded.begin(), loaded.end());
+    return true;
+}
+
+bool PlannerFile::readSequential(QIODevice *device, quint8 flags,
+                                 std::vector<AbstractEntry*> &loaded)
+{
+    /* Version 5 files keep the body in blocks, older ones store it as is */
+    BlockReader blocks(device, flags & CompressedFlag);
+    QDataStream in(device);
+    if (version >= 5) {
+        blocks.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        in.setDevice(&blocks);
+    }
+    in.setVersion(QDataStream::Qt_4_1);
+
+    stringTable.clear();
+    if (version >= 4) {
+        quint32 count;
+        in >> count;
+        QString s;
+        for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+            in >> s;
+            stringTable.append(s);
+        }
+    }
+
+    while (!in.atEnd() && in.status() == QDataStream::Ok)
+        loaded.push_back(getEntryFromStream(in));
+
+    if (in.status() != QDataStream::Ok || blocks.hasError()) {
+        for (uint i = 0; i < loaded.size(); i++) delete loaded[i];
+        loaded.clear();
+        return false;
+    }
+    return true;
+}
+
+/* Decode the string table blocks concurrently, then the entry blocks, which
+   need the table. QtConcurrent keeps results in block order. */
+bool PlannerFile::readParallel(QIODevice *device, quint8 flags,
+                               std::vector<AbstractEntry*> &loaded)
+{
+    QFile *file = qobject_cast<QFile*>(device);
+    QList<BlockSpan> spans;
+    if (!file || !readIndex(device, spans)) return false;
+
+    uchar *map = file->map(0, file->size());
+    if (!map) return false;
+
+    QList<BlockSpan> stringSpans, entrySpans;
+    for (int i = 0; i < spans.size(); i++)
+        (spans[i].strings ? stringSpans : entrySpans).append(spans[i]);
+
+    BlockDecoder decoder(this, map, file->size(), flags & CompressedFlag);
+    bool ok = true;
+
+    QList<DecodedBlock> strings =
+            QtConcurrent::blockingMapped<QList<DecodedBlock> >(stringSpans,
+                                                               decoder);
+    stringTable.clear();
+    for (int i = 0; i < strings.size(); i++) {
+        ok = ok && strings[i].ok;
+        stringTable += strings[i].strings;
+    }
+
+    if (ok) {
+        QList<DecodedBlock> blocks =
+                QtConcurrent::blockingMapped<QList<DecodedBlock> >(entrySpans,
+                                                                   decoder);
+        for (int i = 0; i < blocks.size(); i++) {
+            ok = ok && blocks[i].ok;
+            loaded.insert(loaded.end(), blocks[i].entries.begin(),
+                          blocks[i].entries.end());
+        }
+    }
+
+    file->unmap(map);
+    if (!ok) {
+        for (uint i = 0; i < loaded.size(); i++) delete loaded[i];
+        loaded.clear();
+    }
+    return ok;
+}
+
+
+
+
+/******************************************************************************
+    BLOCK INDEX
+******************************************************************************/
+
+/* The index is a quint32 block count and string table block count, then a
+   qint64 offset and quint32 record count per block, then its own offset. */
+bool PlannerFile::writeIndex(QIODevice *device, const BlockWriter &blocks,
+                             int stringBlocks)
+{
+    QList<qint64> offsets = blocks.blockOffsets();
+    QList<quint32> records = blocks.blockRecordCounts();
+    qint64 indexOffset = device->pos();
+
+    QDataStream out(device);
+    out.setVersion(QDataStream::Qt_4_1);
+    out << quint32(offsets.size()) << quint32(stringBlocks);
+    for (int i = 0; i < offsets.size(); i++)
+        out << offsets[i] << records[i];
+    out << indexOffset;
+
+    return out.status() == QDataStream::Ok;
+}
+
+bool PlannerFile::readIndex(QIODevice *device, QList<BlockSpan> &spans)
+{
+    qint64 size = device->size();
+    if (size < 8 || !device->seek(size - 8)) return false;
+
+    QDataStream in(device);
+    in.setVersion(QDataStream::Qt_4_1);
+    qint64 indexOffset;
+    in >> indexOffset;
+    if (indexOffset < 0 || indexOffset > size - 16
+            || !device->seek(indexOffset))
+        return false;
+
+    quint32 count, stringBlocks;
+    in >> count >> stringBlocks;
+    if (stringBlocks == 0 || stringBlocks > count
+            || count > (size - indexOffset) / 12)
+        return false;
+
+    for (quint32 i = 0; i < count; i++) {
+        BlockSpan span;
+        in >> span.offset >> span.records;
+        span.strings = i < stringBlocks;
+        span.first = i == 0;
+        spans.append(span);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+
+
+
+/******************************************************************************
+    STRING TABLE
+******************************************************************************/
+
+/* Distinct strings are found by data pointer first, which catches strings
+   interned in the same StringPool without hashing their contents. */
+void PlannerFile::buildStringTable(const std::vector<AbstractEntry*> &entries)
+{
+    stringTable.clear();
+    dataIndex.clear();
+    textIndex.clear();
+
+    std::vector<AbstractEntry*>::const_iterator it;
+    for (it = entries.begin(); it != entries.end(); it++) {
+        addToStringTable((*it)->name());
+        addToStringTable((*it)->notes());
+        QStringList tags = (*it)->tags();
+        for (int i = 0; i < tags.size(); i++) addToStringTable(tags[i]);
+    }
+}
+
+void PlannerFile::addToStringTable(const QString &s)
+{
+    if (dataIndex.contains(s.constData())) return;
+
+    QHash<QString, quint32>::const_iterator it = textIndex.constFind(s);
+    if (it != textIndex.constEnd()) {
+        dataIndex.insert(s.constData(), it.value());
+        return;
+    }
+
+    quint32 index = stringTable.size();
+    stringTable.append(s);
+    textIndex.insert(s, index);
+    dataIndex.insert(stringTable.last().constData(), index);
+}
+
+quint32 PlannerFile::stringIndex(const QString &s) const
+{
+    QHash<const QChar*, quint32>::const_iterator it =
+            dataIndex.constFind(s.constData());
+    if (it != dataIndex.constEnd()) return it.value();
+    return textIndex.value(s);
+}
+
+
+
+
+/******************************************************************************
+    RECORDS
+******************************************************************************/
+
+void PlannerFile::sendEntryToStream(AbstractEntry *entry,
+                                    QDataStream &outStream)
+{
+    outStream << quint8(entry->isRecurring() ? RecurringRecord : SingleRecord)
+              << entry->id()
+              << stringIndex(entry->name())
+              << entry->startMSecs()
+              << entry->endMSecs()
+              << stringIndex(entry->notes())
+              << entry->whenAddedMSecs();
+
+    QStringList tags = entry->tags();
+    outStream << quint16(tags.size());
+    for (int i = 0; i < tags.size(); i++) outStream << stringIndex(tags[i]);
+
+    /* Recurring entries are stored as their rule, never as occurrences */
+    if (entry->isRecurring()) {
+        RecurringEntry *r = static_cast<RecurringEntry*>(entry);
+        outStream << quint8(r->frequency())
+                  << qint32(r->interval())
+                  << qint32(r->count())
+                  << r->until();
+    }
+}
+
+/* Version 1 files (plain MagicNumber) hold untagged single entries,
+   versions before 3 store QDateTimes rather than milliseconds, and versions
+   before 4 store strings inline rather than in the string table. Entries
+   of files before version 7 have no ID yet (zero), and those of files
+   before version 8 have no tags. */
+// The string at index in the table; an index past its end marks a corrupt file
+QString PlannerFile::tableString(QDataStream &inStream, quint32 index) const
+{
+    if (index >= quint32(stringTable.size())) {
+        inStream.setStatus(QDataStream::ReadCorruptData);
+        return QString();
+    }
+    return stringTable.at(index);
+}
+
+AbstractEntry* PlannerFile::getEntryFromStream(QDataStream &inStream) const
+{
+    QString name, notes;
+    QStringList tags;
+    qint64 start, end, whenAdded;
+    quint8 type = SingleRecord;
+    quint64 id = 0;
+
+    if (version >= 2) inStream >> type;
+    if (version >= 7) inStream >> id;
+    if (version >= 4) {
+        quint32 nameIndex, notesIndex;
+        inStream >> nameIndex >> start >> end >> notesIndex >> whenAdded;
+        name = tableString(inStream, nameIndex);
+        notes = tableString(inStream, notesIndex);
+    }
+    else if (version == 3)
+        inStream >> name >> start >> end >> notes >> whenAdded;
+    else {
+        QDateTime startDT, endDT, whenAddedDT;
+        inStream >> name >> startDT >> endDT >> notes >> whenAddedDT;
+        start = startDT.toMSecsSinceEpoch();
+        end = endDT.toMSecsSinceEpoch();
+        whenAdded = whenAddedDT.toMSecsSinceEpoch();
+    }
+
+    if (version >= 8) {
+        quint16 tagCount;
+        quint32 tagIndex;
+        inStream >> tagCount;
+        for (int i = 0; i < tagCount && inStream.status() == QDataStream::Ok;
+             i++) {
+            inStream >> tagIndex;
+            tags.append(tableString(inStream, tagIndex));
+        }
+    }
+
+    if (type == RecurringRecord) {
+        quint8 frequency;
+        qint32 interval, count;
+        QDate until;
+        inStream >> frequency >> interval >> count >> until;
+        /* The caller drops what was read once the stream is marked corrupt,
+           but the entry is still built, so keep the frequency in range */
+        if (frequency > RecurringEntry::Yearly) {
+            inStream.setStatus(QDataStream::ReadCorruptData);
+            frequency = RecurringEntry::Daily;
+        }
+        RecurringEntry *r = new RecurringEntry(
+                    name, QDateTime::fromMSecsSinceEpoch(start),
+                    QDateTime::fromMSecsSinceEpoch(end), notes,
+                    QDateTime::fromMSecsSinceEpoch(whenAdded),
+                    RecurringEntry::Frequency(frequency),
+                    interval, count, until);
+        r->setId(id);
+        r->setTags(tags);
+        return r;
+    }
+
+    PlannerEntry *entry = new PlannerEntry(name, start, end, notes, whenAdded);
+    entry->setId(id);
+    entry->setTags(tags);
+    return entry;
+}
@@ -0,0 +1,89 @@
+#ifndef PLANNERFILE_H
+#define PLANNERFILE_H
+
+#include <QCoreApplication>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <vector>
+
+// Arbitrary fixed 32-bit integers. Files starting with VersionedMagicNumber
+// are followed by a quint16 format version.
+#define MagicNumber 0x37406D6B
+#define VersionedMagicNumber 0x37406D6C
+#define FileFormatVersion 8
+
+class QIODevice;
+class QDataStream;
+class AbstractEntry;
+class BlockWriter;
+
+/* Reads and writes the .pla format. Since version 4, names and notes are
+   written once to a table of distinct strings that the records refer to by
+   index, so repeated strings cost four bytes per use on disk and are shared
+   in memory once loaded.
+
+   Since version 5, the header is followed by a flags byte and the string
+   table and records are stored in blocks (see BlockWriter), which can be
+   compressed.
+
+   Since version 6, the string table and the records never share a block,
+   and the blocks are followed by an index of block offsets and record
+   counts, then by the index's own offset as the file's last eight bytes.
+   Files on disk are then read by decoding all blocks concurrently and
+   joining the results in order.
+
+   Since version 7, each record's type is followed by its entry's 64-bit ID.
+
+   Since version 8, each record's creation time is followed by a quint16
+   count of the entry's tags and their string table indexes. */
+class PlannerFile
+{
+    Q_DECLARE_TR_FUNCTIONS(PlannerFile)
+
+public:
+    PlannerFile();
+
+    void    setCompressed(bool compress);
+    bool    write(QIODevice *device, const std::vector<AbstractEntry*> &entries);
+    bool    read(QIODevice *device, std::vector<AbstractEntry*> &entries);
+    QString errorString() const;
+
+private:
+    friend struct BlockDecoder;
+
+    enum { SingleRecord = 0, RecurringRecord = 1 };
+    enum { CompressedFlag = 0x01 };
+
+    struct BlockSpan {
+        qint64  offset;     // of the block's byte count
+        quint32 records;
+        bool    strings;    // a string table block, not an entry block
+        bool    first;      // starts with the string table size
+    };
+
+    bool readSequential(QIODevice *device, quint8 flags,
+                        std::vector<AbstractEntry*> &loaded);
+    bool readParallel(QIODevice *device, quint8 flags,
+                      std::vector<AbstractEntry*> &loaded);
+    bool readIndex(QIODevice *device, QList<BlockSpan> &spans);
+    bool writeIndex(QIODevice *device, const BlockWriter &blocks,
+                    int stringBlocks);
+
+    void    buildStringTable(const std::vector<AbstractEntry*> &entries);
+    quint32 stringIndex(const QString &s) const;
+    void    addToStringTable(const QString &s);
+
+    void sendEntryToStream(AbstractEntry *entry, QDataStream &outStream);
+    AbstractEntry *getEntryFromStream(QDataStream &inStream) const;
+    QString tableString(QDataStream &inStream, quint32 index) const;
+
+    quint16 version;
+    bool compressed;
+    QVector<QString> stringTable;
+    QHash<const QChar*, quint32> dataIndex;
+    QHash<QString, quint32> textIndex;
+    QString error;
+};
+
+#endif // PLANNERFILE_H
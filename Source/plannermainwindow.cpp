@@ -7,41 +7,291 @@
 #include <QApplication>
 #include <QFileDialog>
 #include <QSettings>
+#include <QTimer>
+#include <QFileSystemWatcher>
+#include <QDesktopServices>
+#include <QCryptographicHash>
+#include <QtConcurrentRun>
 #include <QDebug>
+#include <climits>
 
 #include "plannermainwindow.h"
 #include "plannerwidget.h"
 #include "prefsdialog.h"
+#include "atomicfile.h"
+#include "plafilebackend.h"
+#include "interchange.h"
+#include "availability.h"
+#include "trace.h"
+#include "memoryusage.h"
+#include "planstatistics.h"
+#include "entryarchive.h"
+#include "archivedialog.h"
+
+/* Runs on a worker thread: write a snapshot of the entries, which the plan
+   leaves alone until autoSaveFinished() releases it */
+static bool writeRecoveryFile(std::vector<AbstractEntry*> snapshot,
+                              QString fileName, bool compress)
+{
+    StorageOptions options;
+    options.compressed = compress;
+    options.durability = AtomicFile::NoSync;
+    return PlaFileBackend(fileName, options).save(snapshot);
+}
+
+/* Runs on a worker thread: a hash of the file's contents, or an empty one
+   if it can't be read */
+static QByteArray fileDigest(QString fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QByteArray chunk;
+    while (!(chunk = file.read(1024 * 1024)).isEmpty()) hash.addData(chunk);
+    return hash.result();
+}
+
+/* Runs on a worker thread: whether each of fileNames exists. A stat can
+   take a long time on a network share, so it's kept off the GUI thread. */
+static QHash<QString, bool> checkFilesExist(QStringList fileNames)
+{
+    QHash<QString, bool> exists;
+    for (int i = 0; i < fileNames.size(); i++)
+        exists.insert(fileNames[i], QFile::exists(fileNames[i]));
+    return exists;
+}
+
+// What startup's background load of the auto-load file came back with
+struct StartupLoad
+{
+    bool ok;
+    QString error;
+    std::vector<AbstractEntry*> entries;
+    int expired;            // entries that ended by clearBefore
+    qint64 clearBefore;
+};
+
+/* Runs on a worker thread: read the auto-load file with a backend of its
+   own, counting the entries that are over while they're at hand, so the
+   prompt to clear them needs no pass of its own. */
+static StartupLoad loadInBackground(QString fileName, StorageOptions options,
+                                    bool countExpired)
+{
+    TRACE_SCOPE("startup: load");
+    StartupLoad loaded;
+    loaded.expired = 0;
+    loaded.clearBefore = QDateTime::currentMSecsSinceEpoch();
+
+    StorageBackend *source = StorageBackend::create(fileName, options);
+    loaded.ok = source->load(loaded.entries);
+    if (!loaded.ok) loaded.error = source->errorString();
+    delete source;
+
+    for (uint i = 0; countExpired && i < loaded.entries.size(); i++) {
+        if (loaded.entries[i]->endedBy(loaded.clearBefore)) loaded.expired++;
+    }
+    TRACE_COUNT(loaded.entries.size());
+    return loaded;
+}
 
 PlannerMainWindow::PlannerMainWindow(QWidget *parent) :
     QMainWindow(parent)
 {
+    startupBegan = TRACE_NOW();
+    TRACE_SCOPE("startup: window");
     appName = tr("Planner");
     fileExt = tr(".pla");
+    dbExt = tr(".plandb");
+    backend = NULL;
+    archive = NULL;
 
     createActions();
     createMenus();
+    recentFilesWatcher = new QFutureWatcher<QHash<QString, bool> >(this);
+    connect(recentFilesWatcher, SIGNAL(finished()), this,
+            SLOT(recentFilesChecked()));
     readSettings();
 
     pw = new PlannerWidget();
     setCentralWidget(pw);
 
-    /* Instantiate prefsDialog and load its associated saved settings */
-    prefsDialog = new PrefsDialog(this);
-    if (prefsDialog->autoLoadChecked())
-        readFile(prefsDialog->autoFileNameString());
-    else setCurrentFile("");
+    autoSavedChanges = 0;
+    autoSaveWatcher = new QFutureWatcher<bool>(this);
+    connect(autoSaveWatcher, SIGNAL(finished()), this,
+            SLOT(autoSaveFinished()));
+    autoSaveTimer = new QTimer(this);
+    connect(autoSaveTimer, SIGNAL(timeout()), this, SLOT(autoSave()));
+    autoSaveTimer->start(AutoSaveInterval);
 
-    if (prefsDialog->autoClearOldChecked()) clearOld();
+    /* Changes to the file are picked up once its writer has had a moment
+       to finish */
+    syncedSize = -1;
+    fileWatcher = new QFileSystemWatcher(this);
+    connect(fileWatcher, SIGNAL(fileChanged(QString)), this,
+            SLOT(fileChanged(QString)));
+    reloadTimer = new QTimer(this);
+    reloadTimer->setSingleShot(true);
+    reloadTimer->setInterval(ReloadDelay);
+    connect(reloadTimer, SIGNAL(timeout()), this, SLOT(reloadChangedFile()));
+    digestWatcher = new QFutureWatcher<QByteArray>(this);
+    connect(digestWatcher, SIGNAL(finished()), this, SLOT(digestComputed()));
+
+    trayIcon = NULL;
+    connect(pw, SIGNAL(reminder(QString, QDateTime)), this,
+            SLOT(showReminder(QString, QDateTime)));
+
+    /* The preferences are read from the saved settings; their dialog is
+       only built when it's first opened */
+    prefsDialog = NULL;
+    applyPrefs();
+
+    /* Nothing that depends on the plan's size happens before the window is
+       shown: the auto-load file is read on a worker thread once the event
+       loop is running (see startUp()) */
+    startupWatcher = new QFutureWatcher<StartupLoad>(this);
+    connect(startupWatcher, SIGNAL(finished()), this, SLOT(startupLoaded()));
+    startupPending = false;
+    isLoading = false;
+    commonTimeWatcher = new QFutureWatcher<BusyTime>(this);
+    connect(commonTimeWatcher, SIGNAL(finished()), this,
+            SLOT(commonTimeLoaded()));
+    commonTimeFinder = NULL;
+    commonTimeMinutes = 0;
+    setCurrentFile("");
+    QTimer::singleShot(0, this, SLOT(startUp()));
 
     pw->clearFields();
 }
 
-PlannerMainWindow::~PlannerMainWindow() {}
+/* Don't let a recovery save outlive the entries' owner, or entries loaded
+   at startup go unclaimed */
+PlannerMainWindow::~PlannerMainWindow()
+{
+    autoSaveWatcher->waitForFinished();
+    if (startupPending) {
+        startupWatcher->waitForFinished();
+        StartupLoad loaded = startupWatcher->result();
+        for (uint i = 0; i < loaded.entries.size(); i++)
+            delete loaded.entries[i];
+    }
+    commonTimeWatcher->waitForFinished();
+    delete commonTimeFinder;
+    pw->setBackend(NULL);
+    pw->setArchive(NULL);
+    delete backend;
+    delete archive;
+}
+
+/* Called from the event loop's first pass, once the window is on screen:
+   start reading the auto-load file in the background. The plan can't be
+   changed (or replaced) until its entries are in. */
+void PlannerMainWindow::startUp()
+{
+    TRACE_SPAN("startup: first frame", startupBegan);
+    if (!PrefsDialog::autoLoadChecked()) {
+        offerRecovery();
+        TRACE_SPAN("startup", startupBegan);
+        return;
+    }
+
+    startupFile = PrefsDialog::autoFileNameString();
+    setLoading(true);
+    statusBar()->showMessage(tr("Loading %1...")
+                             .arg(strippedName(startupFile)));
+    startupPending = true;
+    startupWatcher->setFuture(QtConcurrent::run(loadInBackground,
+                              startupFile, storageOptions(),
+                              PrefsDialog::autoClearOldChecked()));
+}
+
+/* Show the auto-load file's entries, leaving out the old ones if the user
+   agrees to clear them (moving them to the archive in one append, if past
+   events are archived). The rest are listed by listStartupBatch(). */
+void PlannerMainWindow::startupLoaded()
+{
+    startupPending = false;
+    StartupLoad loaded = startupWatcher->result();
+
+    if (!loaded.ok) {
+        setLoading(false);
+        statusBar()->clearMessage();
+        QMessageBox::warning(this, appName, loaded.error);
+        offerRecovery();
+        TRACE_SPAN("startup", startupBegan);
+        return;
+    }
+
+    TRACE_SCOPE("startup: entries");
+    TRACE_COUNT(loaded.entries.size());
+    setBackend(StorageBackend::create(startupFile, storageOptions()));
+    setCurrentFile(startupFile);
+    bool clearOld = loaded.expired > 0 && pw->confirmClearOld();
+    pw->loadEntries(loaded.entries, clearOld, loaded.clearBefore);
+    startupListed = 0;
+    startupTotal = int(loaded.entries.size());
+    listStartupBatch();
+}
+
+/* List StartupBatchSize more of the loaded entries, then come back from
+   the event loop for the next batch, so the window keeps painting and
+   responding however big the plan is. The plan stays read-only until the
+   last batch is in. */
+void PlannerMainWindow::listStartupBatch()
+{
+    if (!pw->loadMore(StartupBatchSize)) {
+        startupListed += StartupBatchSize;
+        statusBar()->showMessage(tr("Loading %1... %2%")
+                                 .arg(strippedName(startupFile))
+                                 .arg(qint64(startupListed) * 100
+                                      / qMax(startupTotal, 1)));
+        QTimer::singleShot(0, this, SLOT(listStartupBatch()));
+        return;
+    }
+
+    setLoading(false);
+    statusBar()->clearMessage();
+    offerRecovery();
+    TRACE_SPAN("startup", startupBegan);
+}
+
+/* Keep the plan from being edited, saved or replaced while it loads.
+   Afterwards every action goes back to how it was, so one that was
+   disabled for its own reasons stays disabled. */
+void PlannerMainWindow::setLoading(bool loading)
+{
+    if (loading == isLoading) return;
+    isLoading = loading;
+
+    QList<QAction*> actions;
+    actions << newAction << openAction << saveAction << saveAsAction
+            << importAction << exportAction << sortByDateAction
+            << sortByDateAddedAction << sortByNameAction
+            << sortInReverseAction << clearOldAction << archiveAction
+            << commonTimeAction << statisticsAction;
+    for (int i = 0; i < MaxRecentFiles; i++)
+        actions << recentFileActions[i];
+
+    if (loading) {
+        enabledBeforeLoading.clear();
+        for (int i = 0; i < actions.size(); i++) {
+            enabledBeforeLoading.append(actions[i]->isEnabled());
+            actions[i]->setEnabled(false);
+        }
+        enabledBeforeLoading.append(pw->isEnabled());
+        pw->setEnabled(false);
+    }
+    else {
+        for (int i = 0; i < actions.size(); i++)
+            actions[i]->setEnabled(enabledBeforeLoading[i]);
+        pw->setEnabled(enabledBeforeLoading.last());
+    }
+}
 
 void PlannerMainWindow::closeEvent(QCloseEvent *event)
 {
     if (okToContinue()) {
+        removeRecoveryFile();
         writeSettings();
         event->accept();
     }
@@ -79,6 +329,12 @@ void PlannerMainWindow::createActions()
     saveAsAction = new QAction(tr("Save As..."), this);
     connect(saveAsAction, SIGNAL(triggered()), this, SLOT(saveAs()));
 
+    importAction = new QAction(tr("&Import..."), this);
+    connect(importAction, SIGNAL(triggered()), this, SLOT(importEntries()));
+
+    exportAction = new QAction(tr("&Export..."), this);
+    connect(exportAction, SIGNAL(triggered()), this, SLOT(exportEntries()));
+
     quitAction = new QAction(tr("Quit"), this);
     quitAction->setShortcut(tr("Ctrl+Q"));
     connect(quitAction, SIGNAL(triggered()), this, SLOT(close()));
@@ -101,6 +357,17 @@ void PlannerMainWindow::createActions()
     clearOldAction->setShortcut(tr("Ctrl+R"));
     connect(clearOldAction, SIGNAL(triggered()), this, SLOT(clearOld()));
 
+    archiveAction = new QAction(tr("Archived events..."), this);
+    connect(archiveAction, SIGNAL(triggered()), this, SLOT(showArchive()));
+
+    commonTimeAction = new QAction(tr("Find common free time..."), this);
+    connect(commonTimeAction, SIGNAL(triggered()), this,
+            SLOT(findCommonTime()));
+
+    statisticsAction = new QAction(tr("Statistics..."), this);
+    connect(statisticsAction, SIGNAL(triggered()), this,
+            SLOT(showStatistics()));
+
     prefsAction = new QAction(tr("Preferences"), this);
     prefsAction->setShortcut(tr("Ctrl+P"));
     connect(prefsAction, SIGNAL(triggered()), this, SLOT(prefs()));
@@ -108,6 +375,14 @@ void PlannerMainWindow::createActions()
     aboutAction = new QAction(tr("About"), this);
     connect(aboutAction, SIGNAL(triggered()), this, SLOT(about()));
 
+    memoryAction = new QAction(tr("Memory Usage..."), this);
+    connect(memoryAction, SIGNAL(triggered()), this, SLOT(showMemoryUsage()));
+
+#ifdef PLANNER_TRACING
+    saveTraceAction = new QAction(tr("Save Trace..."), this);
+    connect(saveTraceAction, SIGNAL(triggered()), this, SLOT(saveTrace()));
+#endif
+
     for (int i = 0; i < MaxRecentFiles; ++i) {
         recentFileActions[i] = new QAction(this);
         recentFileActions[i]->setVisible(false);
@@ -123,6 +398,9 @@ void PlannerMainWindow::createMenus()
     fileMenu->addAction(openAction);
     fileMenu->addAction(saveAction);
     fileMenu->addAction(saveAsAction);
+    fileMenu->addSeparator();
+    fileMenu->addAction(importAction);
+    fileMenu->addAction(exportAction);
 
     separatorAction = fileMenu->addSeparator();
     for (int i = 0; i < MaxRecentFiles; ++i)
@@ -137,22 +415,134 @@ void PlannerMainWindow::createMenus()
     sortSubmenu->addAction(sortByDateAction);
     sortSubmenu->addAction(sortByDateAddedAction);
     editMenu->addAction(clearOldAction);
+    editMenu->addAction(archiveAction);
+    editMenu->addAction(commonTimeAction);
+    editMenu->addAction(statisticsAction);
     editMenu->addAction(prefsAction);
 
     helpMenu = menuBar()->addMenu(tr("&Help"));
     helpMenu->addAction(aboutAction);
+    helpMenu->addAction(memoryAction);
+#ifdef PLANNER_TRACING
+    helpMenu->addAction(saveTraceAction);
+#endif
 }
 
+/* The archive lives next to the plan's file, so an untitled plan has to be
+   saved before its past events can be archived rather than deleted */
 void PlannerMainWindow::clearOld()
 {
+    if (PrefsDialog::archiveOldChecked() && !archive) {
+        QMessageBox::information(this, appName,
+                                 tr("Save the plan first, so its past "
+                                    "events can be archived next to it."));
+        return;
+    }
     pw->clearOldEntries(QDateTime::currentDateTime());
 }
 
+// Browse the current plan's archived events
+void PlannerMainWindow::showArchive()
+{
+    if (currentFile.isEmpty()) {
+        QMessageBox::information(this, appName,
+                                 tr("An untitled plan has no archive."));
+        return;
+    }
+
+    /* Past events may have been archived before archiving was last turned
+       off, so look even without a current archive */
+    EntryArchive *shown = archive;
+    if (!shown)
+        shown = new EntryArchive(EntryArchive::fileNameFor(currentFile));
+    ArchiveDialog dialog(shown, this);
+    dialog.exec();
+    if (shown != archive) delete shown;
+}
+
+/* Find when this plan and the chosen others are all free for as long as
+   asked, over the next CommonTimeDays days. The other plans are read in the
+   background, and the search carries on in commonTimeLoaded(). */
+void PlannerMainWindow::findCommonTime()
+{
+    if (commonTimeWatcher->isRunning()) return;
+
+    QStringList fileNames = QFileDialog::getOpenFileNames(this,
+                               tr("Find Common Free Time"), ".",
+                               tr("%1 files (*%2 *%3)").arg(appName)
+                                               .arg(fileExt).arg(dbExt));
+    if (fileNames.isEmpty()) return;
+    fileNames.removeAll(currentFile);
+
+    bool ok;
+    int minutes = QInputDialog::getInt(this, tr("Find Common Free Time"),
+                                       tr("Minutes needed:"), 60, 1,
+                                       24 * 60, 15, &ok);
+    if (!ok) return;
+
+    QDateTime from = QDateTime::currentDateTime();
+    delete commonTimeFinder;
+    commonTimeFinder = new AvailabilityFinder(from,
+                                              from.addDays(CommonTimeDays));
+    commonTimeFinder->addPlan(currentFile, pw->vector());
+    commonTimeMinutes = minutes;
+
+    commonTimeAction->setEnabled(false);
+    statusBar()->showMessage(tr("Reading %n plan(s)...", "",
+                                fileNames.size()));
+    commonTimeWatcher->setFuture(commonTimeFinder->loadPlans(fileNames,
+                                                        storageOptions()));
+}
+
+/* The other plans are in: offer the common free time, and put the chosen
+   time into the fields, ready to be added */
+void PlannerMainWindow::commonTimeLoaded()
+{
+    commonTimeAction->setEnabled(true);
+    statusBar()->clearMessage();
+
+    AvailabilityFinder *finder = commonTimeFinder;
+    commonTimeFinder = NULL;
+    bool ok = finder->addLoaded(commonTimeWatcher->future().results());
+    QList<Occurrence> found;
+    if (ok) found = finder->freeSlots(qint64(commonTimeMinutes) * 60 * 1000,
+                                      CommonTimeSlots);
+    QString errors = finder->errorString();
+    delete finder;
+
+    if (!ok) {
+        QMessageBox::warning(this, appName, errors);
+        return;
+    }
+    if (found.isEmpty()) {
+        QMessageBox::information(this, appName,
+                                 tr("There is no common free time in the "
+                                    "next %1 days.").arg(CommonTimeDays));
+        return;
+    }
+
+    QStringList choices;
+    for (int i = 0; i < found.size(); i++)
+        choices.append(tr("%1 to %2")
+                       .arg(found[i].first.toString("MM/dd/yyyy h:mm AP"))
+                       .arg(found[i].second.toString("MM/dd/yyyy h:mm AP")));
+    QString choice = QInputDialog::getItem(this, tr("Find Common Free Time"),
+                                           tr("Everyone is free:"), choices,
+                                           0, false, &ok);
+    if (!ok) return;
+
+    Occurrence chosen = found[choices.indexOf(choice)];
+    pw->setFieldTimes(chosen.first, chosen.second);
+}
+
 void PlannerMainWindow::newFile()
 {
     if (okToContinue()) {
+        removeRecoveryFile();
         pw->clearList();
         pw->clearFields();
+        pw->markSynced();
+        setBackend(NULL);
         setCurrentFile("");
     }
 }
@@ -162,10 +552,12 @@ void PlannerMainWindow::open()
     if (okToContinue()) {
         QString fileName = QFileDialog::getOpenFileName(this,
                                    tr("Open %1 File").arg(appName), ".",
-                                   tr("%1 files (*%2)").arg(appName)
-                                                       .arg(fileExt));
-        if (!fileName.isEmpty())
+                                   tr("%1 files (*%2 *%3)").arg(appName)
+                                                   .arg(fileExt).arg(dbExt));
+        if (!fileName.isEmpty()) {
+            removeRecoveryFile();
             readFile(fileName);
+        }
     }
     pw->clearFields();
 }
@@ -175,7 +567,6 @@ bool PlannerMainWindow::save()
     if (currentFile == "") return saveAs();
     else {
         writeFile(currentFile);
-        updateRecentFileActions();
         return true;
     }
 }
@@ -184,29 +575,159 @@ bool PlannerMainWindow::saveAs()
 {
     QString fileName = QFileDialog::getSaveFileName(this,
                                tr("Save %1 File").arg(appName), ".",
-                               tr("%1 files (*%2)").arg(appName)
-                                                    .arg(fileExt));
+                               tr("%1 files (*%2);;%1 databases (*%3)")
+                               .arg(appName).arg(fileExt).arg(dbExt));
     if (fileName.isEmpty())
         return false;
 
-    updateRecentFileActions();
     return writeFile(fileName);
 }
 
+/* Add the entries of a CSV or iCalendar file to the current plan, a batch
+   at a time, so the file is never held in memory as a whole. */
+void PlannerMainWindow::importEntries()
+{
+    QString fileName = QFileDialog::getOpenFileName(this,
+                               tr("Import Entries"), ".",
+                               tr("Calendar files (*.csv *.ics);;"
+                                  "CSV files (*.csv);;"
+                                  "iCalendar files (*.ics)"));
+    if (fileName.isEmpty()) return;
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QMessageBox::warning(this, appName,
+        tr("Cannot read file %1:\n%2.")
+        .arg(fileName)
+        .arg(file.errorString()));
+        return;
+    }
+
+    TRACE_SCOPE("importEntries");
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    EntryImporter importer(&file, formatForFile(fileName));
+    std::vector<AbstractEntry*> batch;
+    int imported = 0;
+    while (importer.readBatch(batch, ImportBatchSize)) {
+        pw->addEntries(batch);
+        imported += int(batch.size());
+        batch.clear();
+    }
+    QApplication::restoreOverrideCursor();
+    TRACE_COUNT(imported);
+
+    if (importer.hasError()) {
+        QMessageBox::warning(this, appName,
+        tr("Cannot import file %1:\n%2")
+        .arg(fileName)
+        .arg(importer.errorString()));
+        return;
+    }
+
+    QString message = tr("Imported %1 entries").arg(imported);
+    if (importer.skipped() > 0)
+        message += tr(", skipped %1 that were incomplete")
+                   .arg(importer.skipped());
+    statusBar()->showMessage(message, 5000);
+
+    if (importer.simplified() > 0)
+        QMessageBox::warning(this, appName,
+        tr("%n imported event(s) repeat in ways Planner can't represent, "
+           "such as on several weekdays or more often than daily. Only "
+           "the parts of their rules that Planner understands were kept, "
+           "so they may not repeat as in the original calendar.", "",
+           importer.simplified()));
+}
+
+void PlannerMainWindow::exportEntries()
+{
+    QString fileName = QFileDialog::getSaveFileName(this,
+                               tr("Export Entries"), ".",
+                               tr("CSV files (*.csv);;"
+                                  "iCalendar files (*.ics)"));
+    if (fileName.isEmpty()) return;
+
+    AtomicFile file(fileName, PrefsDialog::durability());
+    if (!file.open()) {
+        QMessageBox::warning(this, appName,
+        tr("Cannot write file %1:\n%2.")
+        .arg(fileName)
+        .arg(file.errorString()));
+        return;
+    }
+
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    EntryExporter exporter(formatForFile(fileName));
+    bool ok = exporter.write(file.device(), pw->listOrder());
+    QString error = exporter.errorString();
+    if (ok) {
+        ok = file.commit();
+        error = file.errorString();
+    }
+    QApplication::restoreOverrideCursor();
+
+    if (!ok)
+        QMessageBox::warning(this, appName,
+        tr("Cannot write file %1:\n%2.")
+        .arg(fileName)
+        .arg(error));
+}
+
 void PlannerMainWindow::openRecentFile()
 {
     if (okToContinue()) {
         QAction *action = qobject_cast<QAction *>(sender());
-        if (action)
-            readFile(action->data().toString());
+        if (action) {
+            removeRecoveryFile();
+            QString fileName = action->data().toString();
+            // A file that has gone since it was checked leaves the menu
+            if (!readFile(fileName) && !QFile::exists(fileName)) {
+                recentFileExists.insert(fileName, false);
+                updateRecentFileActions();
+            }
+        }
     }
 }
 
 void PlannerMainWindow::prefs()
 {
+    if (!prefsDialog) {
+        prefsDialog = new PrefsDialog(this);
+        connect(prefsDialog, SIGNAL(accepted()), this, SLOT(applyPrefs()));
+    }
     prefsDialog->show();
 }
 
+// Settings that take effect as soon as they're changed
+void PlannerMainWindow::applyPrefs()
+{
+    pw->setRemindersEnabled(PrefsDialog::remindersChecked());
+    updateArchive();
+}
+
+/* A desktop notification where the system tray supports them; the status
+   bar and the taskbar (or dock) always show it too. */
+void PlannerMainWindow::showReminder(const QString &name,
+                                     const QDateTime &start)
+{
+    QString text = tr("\"%1\" starts at %2")
+                   .arg(name).arg(start.toString("h:mm AP"));
+
+    if (QSystemTrayIcon::isSystemTrayAvailable()
+            && QSystemTrayIcon::supportsMessages()) {
+        if (trayIcon == NULL) {
+            trayIcon = new QSystemTrayIcon(
+                        style()->standardIcon(QStyle::SP_MessageBoxInformation),
+                        this);
+            trayIcon->setToolTip(appName);
+        }
+        trayIcon->show();
+        trayIcon->showMessage(appName, text);
+    }
+    statusBar()->showMessage(text);
+    QApplication::alert(this);
+}
+
 void PlannerMainWindow::about()
 {
     QMessageBox::about(this, tr("About Planner"),
@@ -217,90 +738,115 @@ void PlannerMainWindow::about()
     "Qt classes."));
 }
 
-void PlannerMainWindow::sendEntryToStream(std::vector<AbstractEntry*>::iterator it,
-                                          QDataStream &outStream)
+/* How busy the plan is, with hours per week and per day under Show
+   Details */
+void PlannerMainWindow::showStatistics()
 {
-    outStream << (*it)->name()
-              << (*it)->startDateTime()
-              << (*it)->endDateTime()
-              << (*it)->notes()
-              << (*it)->whenAdded();
+    PlanStatistics stats = pw->statistics();
+    QMessageBox box(QMessageBox::Information, tr("Statistics"),
+                    stats.reportHtml(), QMessageBox::Ok, this);
+    box.setDetailedText(stats.report());
+    box.exec();
 }
 
-bool PlannerMainWindow::writeFile(const QString& fileName)
+// What the open plan costs in memory, part by part
+void PlannerMainWindow::showMemoryUsage()
 {
-    QFile file(fileName);
-    if (!file.open(QIODevice::WriteOnly)) {
+    QMessageBox::information(this, tr("Memory Usage"),
+                             pw->memoryUsage().reportHtml());
+}
+
+#ifdef PLANNER_TRACING
+// Save the timings recorded so far, for chrome://tracing
+void PlannerMainWindow::saveTrace()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Trace"),
+                               "planner-trace.json",
+                               tr("Trace files (*.json)"));
+    if (fileName.isEmpty()) return;
+
+    QString error;
+    if (!Trace::writeJson(fileName, &error))
         QMessageBox::warning(this, appName,
-        tr("Cannot write file %1:\n%2.")
-        .arg(file.fileName())
-        .arg(file.errorString()));
-        return false;
+                             tr("Cannot write file %1:\n%2.")
+                             .arg(fileName).arg(error));
+}
+#endif
+
+/* Write the plan to fileName with the backend its extension calls for.
+   A database that's already the current document is kept up to date edit
+   by edit, so there's nothing left to write. */
+bool PlannerMainWindow::writeFile(const QString& fileName)
+{
+    if (backend && backend->isIncremental()
+            && backend->fileName() == fileName) {
+        setCurrentFile(fileName);
+        return true;
     }
 
-    QDataStream out(&file);
-    out.setVersion(QDataStream::Qt_4_1);
-    out << quint32(MagicNumber);
+    /* Closing while the plan is still being listed at startup can save it:
+       list the rest first, so none is left out. listStartupBatch() then
+       finds them all in and finishes the load as usual. */
+    if (isLoading) pw->loadMore(INT_MAX);
 
+    TRACE_SCOPE("writeFile");
+    TRACE_COUNT(pw->vector().size());
+    StorageBackend *target = StorageBackend::create(fileName,
+                                                    storageOptions());
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    bool ok = target->save(pw->listOrder());
+    QApplication::restoreOverrideCursor();
 
-    std::vector<AbstractEntry*> vec = pw->vector();
-    std::vector<AbstractEntry*>::iterator i, end;
-    i = vec.begin();
-    end = vec.end();
-
-    while (i != end)
-    {
-        sendEntryToStream(i, out);
-        i++;
+    if (!ok) {
+        QMessageBox::warning(this, appName, target->errorString());
+        delete target;
+        return false;
     }
 
-    QApplication::restoreOverrideCursor();
+    setBackend(target);
+    pw->markSynced();
+    removeRecoveryFile();
     setCurrentFile(fileName);
     return true;
 }
 
-AbstractEntry* PlannerMainWindow::getEntryFromStream(QDataStream &inStream)
+bool PlannerMainWindow::readFile(const QString &fileName)
 {
-    QString name, notes;
-    QDateTime start, end, whenAdded;
+    TRACE_SCOPE("readFile");
+    StorageBackend *source = StorageBackend::create(fileName,
+                                                    storageOptions());
+    if (!loadEntries(source)) {
+        delete source;
+        return false;
+    }
 
-    inStream >> name >> start >> end >> notes >> whenAdded;
-    PlannerEntry *entry = new PlannerEntry(name, start, end, notes, whenAdded);
-    return entry;
+    setBackend(source);
+    pw->markSynced();
+    setCurrentFile(fileName);
+    offerRecovery();
+    TRACE_COUNT(pw->vector().size());
+    return true;
 }
 
-bool PlannerMainWindow::readFile(const QString &fileName)
+// Replace the list's entries with source's, leaving currentFile alone
+bool PlannerMainWindow::loadEntries(StorageBackend *source)
 {
-    QFile file(fileName);
-    if (!file.open(QIODevice::ReadOnly)) {
-        QMessageBox::warning(this, appName,
-        tr("Cannot read file %1:\n%2.")
-        .arg(file.fileName())
-        .arg(file.errorString()));
-        return false;
-    }
+    TRACE_SCOPE("loadEntries");
+    QApplication::setOverrideCursor(Qt::WaitCursor);
+    std::vector<AbstractEntry*> entries;
+    bool ok = source->load(entries);
+    QApplication::restoreOverrideCursor();
+    TRACE_COUNT(entries.size());
 
-    QDataStream in(&file);
-    in.setVersion(QDataStream::Qt_4_1);
-    quint32 magic;
-    in >> magic;
-    if (magic != MagicNumber) {
-        QMessageBox::warning(this, appName,
-        tr("The file is not a %1 file.").arg(appName));
+    if (!ok) {
+        QMessageBox::warning(this, appName, source->errorString());
         return false;
     }
 
     // Clear out any current data, otherwise loaded data will appear atop it
     pw->clearList();
-
-    QApplication::setOverrideCursor(Qt::WaitCursor);
-    while (!in.atEnd()) {
-        pw->addEntry(getEntryFromStream(in));
-    }
-
-    QApplication::restoreOverrideCursor();
-    setCurrentFile(fileName);
+    for (uint i = 0; i < entries.size(); i++)
+        pw->addEntry(entries[i]);
     return true;
 }
 
@@ -316,6 +862,7 @@ void PlannerMainWindow::setCurrentFile(const QString &fileName)
     QString shownName;
     if (!currentFile.isEmpty()) {
         shownName = strippedName(currentFile);
+        recentFileExists.insert(currentFile, true);  // just opened or saved
         recentFiles.removeAll(currentFile);
         recentFiles.prepend(currentFile);
         updateRecentFileActions();
@@ -323,6 +870,110 @@ void PlannerMainWindow::setCurrentFile(const QString &fileName)
     else shownName = "Untitled";
 
     setWindowTitle(tr("%1[*] - %2").arg(shownName).arg(appName));
+    watchCurrentFile();
+    updateArchive();
+}
+
+/* Watch the current file for saves by other people (or programs). A
+   database is only ever changed through its backend, so isn't watched. */
+void PlannerMainWindow::watchCurrentFile()
+{
+    reloadTimer->stop();
+    if (!fileWatcher->files().isEmpty())
+        fileWatcher->removePaths(fileWatcher->files());
+
+    QFileInfo info(currentFile);
+    syncedModified = info.lastModified();
+    syncedSize = info.exists() ? info.size() : -1;
+    syncedDigest.clear();
+    digestedFile.clear();
+
+    if (!currentFile.isEmpty() && info.exists()
+            && !(backend && backend->isIncremental())) {
+        startDigest(false);
+        fileWatcher->addPath(currentFile);
+    }
+}
+
+void PlannerMainWindow::fileChanged(const QString &fileName)
+{
+    if (fileName == currentFile) reloadTimer->start();
+}
+
+/* Merge what's now in the file into the open plan. Files saved by Planner
+   replace the old file, which ends the watch on it, so it's renewed here.
+
+   Our own saves are recognised by the file's contents. A new time or size
+   means a change, but the same ones don't mean there was none: times only
+   have whole seconds, and records have fixed sizes, so another save in the
+   same second that only moved entries would look the same. The contents
+   are hashed on a worker thread, and digestComputed() does the merge. */
+void PlannerMainWindow::reloadChangedFile()
+{
+    QFileInfo info(currentFile);
+    if (currentFile.isEmpty() || !info.exists() || !backend
+            || backend->isIncremental())
+        return;
+    // Look again once the plan is all in and no other digest is running
+    if (isLoading || digestWatcher->isRunning()) {
+        reloadTimer->start();
+        return;
+    }
+
+    if (!fileWatcher->files().contains(currentFile))
+        fileWatcher->addPath(currentFile);
+    startDigest(true);
+}
+
+// Hash currentFile on a worker thread, to check it for changes or not
+void PlannerMainWindow::startDigest(bool forReload)
+{
+    digestedFile = currentFile;
+    digestForReload = forReload;
+    digestWatcher->setFuture(QtConcurrent::run(fileDigest, currentFile));
+}
+
+/* A digest of a file that has since been closed is dropped. Otherwise it
+   is the one we're in sync with, unless a change notification asked for
+   it, when it's compared first. */
+void PlannerMainWindow::digestComputed()
+{
+    if (digestedFile.isEmpty() || digestedFile != currentFile) return;
+    QByteArray digest = digestWatcher->result();
+    if (!digestForReload) {
+        syncedDigest = digest;
+        return;
+    }
+
+    QFileInfo info(currentFile);
+    if (!backend || backend->isIncremental()) return;
+    if (isLoading) {
+        reloadTimer->start();
+        return;
+    }
+    if (info.lastModified() == syncedModified && info.size() == syncedSize
+            && digest == syncedDigest)
+        return;
+
+    std::vector<AbstractEntry*> disk;
+    if (!backend->load(disk)) {
+        statusBar()->showMessage(tr("%1 changed on disk but could not be "
+                                    "reloaded").arg(strippedName(currentFile)));
+        return;
+    }
+    syncedModified = info.lastModified();
+    syncedSize = info.size();
+    syncedDigest = digest;
+
+    TRACE_SCOPE("reloadChangedFile");
+    TRACE_COUNT(disk.size());
+    PlannerWidget::MergeResult r = pw->mergeFromDisk(disk);
+    QString message = tr("Reloaded %1: %2 added, %3 changed, %4 removed")
+                      .arg(strippedName(currentFile)).arg(r.added)
+                      .arg(r.changed).arg(r.removed);
+    if (r.kept > 0)
+        message += tr("; kept %1 of your unsaved changes").arg(r.kept);
+    statusBar()->showMessage(message, 5000);
 }
 
 bool PlannerMainWindow::okToContinue()
@@ -360,12 +1011,19 @@ void PlannerMainWindow::sortInReverse()
     pw->sortInReverse();
 }
 
+/* The menu lists the recent files straight away, leaving out only those
+   known to be gone. Files not yet checked are looked for in the
+   background, and the menu is updated again when the answers are in. Each
+   file is checked once a session. */
 void PlannerMainWindow::updateRecentFileActions()
 {
+    QStringList unchecked;
     QMutableStringListIterator i(recentFiles);
     while (i.hasNext()) {
-        if (!QFile::exists(i.next()))
-            i.remove();
+        QHash<QString, bool>::const_iterator known =
+                recentFileExists.constFind(i.next());
+        if (known == recentFileExists.constEnd()) unchecked.append(i.value());
+        else if (!known.value()) i.remove();
     }
     for (int j = 0; j < MaxRecentFiles; j++) {
         if (j < recentFiles.count()) {
@@ -381,6 +1039,23 @@ void PlannerMainWindow::updateRecentFileActions()
         }
     }
     separatorAction->setVisible(!recentFiles.isEmpty());
+
+    // Files added while a check runs are picked up when it finishes
+    if (!unchecked.isEmpty() && !recentFilesWatcher->isRunning())
+        recentFilesWatcher->setFuture(QtConcurrent::run(checkFilesExist,
+                                                        unchecked));
+}
+
+void PlannerMainWindow::recentFilesChecked()
+{
+    QHash<QString, bool> checked = recentFilesWatcher->result();
+    QHash<QString, bool>::const_iterator it;
+    for (it = checked.constBegin(); it != checked.constEnd(); it++) {
+        // A file opened or saved meanwhile is known to exist
+        if (!recentFileExists.contains(it.key()))
+            recentFileExists.insert(it.key(), it.value());
+    }
+    updateRecentFileActions();
 }
 
 void PlannerMainWindow::readSettings()
@@ -396,3 +1071,120 @@ void PlannerMainWindow::writeSettings()
     QSettings settings("MSF091886", appName);
     settings.setValue("recentFiles", recentFiles);
 }
+
+
+
+
+/******************************************************************************
+    AUTOSAVE
+******************************************************************************/
+
+/* Recovery copies live in the user's data directory rather than next to
+   the file, which may be on a shared drive. */
+QString PlannerMainWindow::recoveryFileName(const QString &fileName)
+{
+    QString dir = QDesktopServices::storageLocation(
+                QDesktopServices::DataLocation) + "/recovery";
+    QDir().mkpath(dir);
+
+    if (fileName.isEmpty()) return dir + "/Untitled" + fileExt;
+    QByteArray path = QFileInfo(fileName).absoluteFilePath().toUtf8();
+    return dir + "/" + QCryptographicHash::hash(path, QCryptographicHash::Md5)
+                       .toHex() + fileExt;
+}
+
+/* Every AutoSaveInterval, if anything changed since the last recovery copy
+   (or save), write a snapshot of the entries on a worker thread. */
+void PlannerMainWindow::autoSave()
+{
+    if (!PrefsDialog::autoSaveChecked() || !modified()) return;
+    if (autoSaveWatcher->isRunning() || isLoading) return;
+    if (pw->changeCount() == autoSavedChanges) return;
+
+    autoSavedChanges = pw->changeCount();
+    autoSaveWatcher->setFuture(QtConcurrent::run(writeRecoveryFile,
+                               pw->snapshot(), recoveryFileName(currentFile),
+                               PrefsDialog::compressFilesChecked()));
+}
+
+void PlannerMainWindow::autoSaveFinished()
+{
+    pw->releaseSnapshot();
+    if (autoSaveWatcher->result())
+        statusBar()->showMessage(tr("Recovery copy saved"), 2000);
+    else statusBar()->showMessage(tr("Could not save a recovery copy"));
+}
+
+/* Offer the current file's recovery copy if it's newer than the file */
+void PlannerMainWindow::offerRecovery()
+{
+    // Databases are written edit by edit and never get recovery copies
+    if (backend && backend->isIncremental()) return;
+
+    QFileInfo recovery(recoveryFileName(currentFile));
+    if (!recovery.exists()) return;
+
+    QFileInfo original(currentFile);
+    if (!currentFile.isEmpty() && original.exists()
+            && recovery.lastModified() <= original.lastModified())
+        return;
+
+    int r = QMessageBox::question(this, appName,
+                tr("Planner found unsaved changes to %1 from an\n"
+                   "earlier session. Would you like to recover them?")
+                .arg(currentFile.isEmpty() ? tr("an untitled plan")
+                                           : strippedName(currentFile)),
+                QMessageBox::Yes | QMessageBox::No, QMessageBox::Yes);
+    if (r == QMessageBox::No) {
+        removeRecoveryFile();
+        return;
+    }
+
+    // Recovered entries still need saving, so leave the document modified
+    StorageOptions options = storageOptions();
+    PlaFileBackend copy(recovery.filePath(), options);
+    if (loadEntries(&copy)) pw->setWindowModified(true);
+}
+
+StorageOptions PlannerMainWindow::storageOptions() const
+{
+    StorageOptions options;
+    options.compressed = PrefsDialog::compressFilesChecked();
+    options.durability = PrefsDialog::durability();
+    return options;
+}
+
+// Make newBackend (possibly NULL) the current document's storage
+void PlannerMainWindow::setBackend(StorageBackend *newBackend)
+{
+    if (newBackend == backend) return;
+    pw->setBackend(newBackend);
+    delete backend;
+    backend = newBackend;
+}
+
+/* Archive past events next to the current file if the preference is on,
+   or delete them when cleared if not. Nothing is read from the archive
+   until it's first used. */
+void PlannerMainWindow::updateArchive()
+{
+    QString fileName;
+    if (PrefsDialog::archiveOldChecked() && !currentFile.isEmpty())
+        fileName = EntryArchive::fileNameFor(currentFile);
+    if (archive && archive->fileName() == fileName) return;
+
+    pw->setArchive(NULL);
+    delete archive;
+    archive = NULL;
+    if (!fileName.isEmpty())
+        archive = new EntryArchive(fileName, PrefsDialog::durability());
+    pw->setArchive(archive);
+}
+
+/* Called whenever the current document's changes are saved or discarded */
+void PlannerMainWindow::removeRecoveryFile()
+{
+    autoSaveWatcher->waitForFinished();
+    QFile::remove(recoveryFileName(currentFile));
+    autoSavedChanges = pw->changeCount();
+}
@@ -2,16 +2,24 @@
 #define PLANNERMAINWINDOW_H
 
 #include <QtGui/QMainWindow>
-
-// Arbitrary fixed 32-bit integer
-#define MagicNumber 0x37406D6B
+#include <QDateTime>
+#include <QHash>
+#include <QFutureWatcher>
 
 class QMenu;
 class QAction;
 class PlannerWidget;
 class PrefsDialog;
 class QSettings;
-class AbstractEntry;
+class QTimer;
+class QFileSystemWatcher;
+class QSystemTrayIcon;
+class StorageBackend;
+class EntryArchive;
+struct StorageOptions;
+struct StartupLoad;
+struct BusyTime;
+class AvailabilityFinder;
 
 class PlannerMainWindow : public QMainWindow
 {
@@ -28,62 +36,135 @@ private slots:
     void open();
     bool save();
     bool saveAs();
+    void importEntries();
+    void exportEntries();
     void openRecentFile();
     void sortByDate();
     void sortByDateAdded();
     void sortByName();
     void sortInReverse();
     void clearOld();
+    void showArchive();
+    void findCommonTime();
+    void commonTimeLoaded();
+    void showStatistics();
     void prefs();
     void about();
+    void autoSave();
+    void autoSaveFinished();
+    void fileChanged(const QString &fileName);
+    void reloadChangedFile();
+    void digestComputed();
+    void applyPrefs();
+    void showReminder(const QString &name, const QDateTime &start);
+    void showMemoryUsage();
+    void startUp();
+    void startupLoaded();
+    void listStartupBatch();
+    void recentFilesChecked();
+#ifdef PLANNER_TRACING
+    void saveTrace();
+#endif
 
 protected:
     void closeEvent(QCloseEvent *event);
 
 private:
     PlannerWidget *pw;
-    PrefsDialog *prefsDialog;
+    PrefsDialog *prefsDialog;   // built when first opened
     QMenu *fileMenu;
     QMenu *editMenu;
     QMenu *sortSubmenu;
     QMenu *helpMenu;
     QString appName;
     QString fileExt;
+    QString dbExt;
+    StorageBackend *backend;    // of the current document; NULL if untitled
+    EntryArchive *archive;      // its past events, if they're archived
 
 
     QStringList recentFiles;
+    QHash<QString, bool> recentFileExists;  // checked this session
+    QFutureWatcher<QHash<QString, bool> > *recentFilesWatcher;
     QString currentFile;
     enum { MaxRecentFiles = 6 };
     QAction *recentFileActions[MaxRecentFiles];
     QAction *separatorAction;
 
+    enum { AutoSaveInterval = 2 * 60 * 1000 };
+    enum { ImportBatchSize = 4096 };
+    enum { CommonTimeDays = 30, CommonTimeSlots = 20 };
+    QFutureWatcher<BusyTime> *commonTimeWatcher;
+    AvailabilityFinder *commonTimeFinder;   // while the plans load
+    int commonTimeMinutes;
+    QTimer *autoSaveTimer;
+    QFutureWatcher<bool> *autoSaveWatcher;
+    quint64 autoSavedChanges;
+
+    enum { ReloadDelay = 500 };
+    QFileSystemWatcher *fileWatcher;
+    QTimer *reloadTimer;
+    QDateTime syncedModified;   // currentFile as we last loaded/saved it
+    qint64 syncedSize;
+    QByteArray syncedDigest;    // of its contents
+    QFutureWatcher<QByteArray> *digestWatcher;
+    QString digestedFile;       // by digestWatcher; empty if out of date
+    bool digestForReload;       // rather than to be synced with
+
+    QSystemTrayIcon *trayIcon;  // created for the first reminder
+
+    QFutureWatcher<StartupLoad> *startupWatcher;
+    QString startupFile;
+    bool startupPending;    // loaded entries not yet taken by the list
+    enum { StartupBatchSize = 16384 };  // entries listed per event loop pass
+    int startupListed;
+    int startupTotal;
+    bool isLoading;
+    QList<bool> enabledBeforeLoading;   // of what setLoading() disables
+    qint64 startupBegan;    // trace time, for the startup phases
+
     QAction *newAction;
     QAction *openAction;
     QAction *saveAction;
     QAction *saveAsAction;
+    QAction *importAction;
+    QAction *exportAction;
     QAction *quitAction;
     QAction *sortByDateAction;
     QAction *sortByDateAddedAction;
     QAction *sortByNameAction;
     QAction *sortInReverseAction;
     QAction *clearOldAction;
+    QAction *archiveAction;
+    QAction *commonTimeAction;
+    QAction *statisticsAction;
     QAction *prefsAction;
     QAction *aboutAction;
+    QAction *memoryAction;
+#ifdef PLANNER_TRACING
+    QAction *saveTraceAction;
+#endif
 
     bool okToContinue();
     void createActions();
     void createMenus();
     bool writeFile(const QString& fileName);
     bool readFile(const QString& fileName);
+    bool loadEntries(StorageBackend *source);
+    void setLoading(bool loading);
+    StorageOptions storageOptions() const;
+    void setBackend(StorageBackend *newBackend);
+    void updateArchive();
+    QString recoveryFileName(const QString& fileName);
+    void offerRecovery();
+    void removeRecoveryFile();
     QString strippedName(const QString &fullFileName);
     void setCurrentFile(const QString& fileName);
+    void watchCurrentFile();
+    void startDigest(bool forReload);
     void readSettings();
     void writeSettings();
     void updateRecentFileActions();
-
-    void sendEntryToStream(std::vector<AbstractEntry*>::iterator it,
-                           QDataStream &outStream);
-    AbstractEntry *getEntryFromStream(QDataStream& inStream);
 };
 
 #endif // PLANNERMAINWINDOW_H
@@ -6,15 +6,46 @@
 #include <QPlainTextEdit>
 #include <QDateTime>
 #include <QDateTimeEdit>
+#include <QComboBox>
+#include <QSpinBox>
 #include <QMessageBox>
-#include <QDebug>
+#include <QSet>
+#include <QCheckBox>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTimer>
 
 #include "plannerwidget.h"
+#include "recurringentry.h"
+#include "storagebackend.h"
+#include "reminderscheduler.h"
+#include "trace.h"
+#include "memoryusage.h"
+#include "fuzzymatch.h"
+#include "planstatistics.h"
+#include "entryarchive.h"
 #include <stack>
 
 PlannerWidget::PlannerWidget(QWidget *parent)
-    : QDialog(parent)
+    : QDialog(parent), changes(0), timeIndexStale(true), backend(NULL),
+      archive(NULL), snapshotsOut(0), pendingNext(0),
+      remindersEnabled(false)
 {
+    reminders = new ReminderScheduler(this);
+    connect(reminders, SIGNAL(due(quint64, qint64)), this,
+            SLOT(remind(quint64, qint64)));
+
+    refreshTimer = new QTimer(this);
+    refreshTimer->setSingleShot(true);
+    connect(refreshTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    notesTimer = new QTimer(this);
+    connect(notesTimer, SIGNAL(timeout()), this, SLOT(loadMoreNotes()));
+    filterTimer = new QTimer(this);
+    filterTimer->setSingleShot(true);
+    connect(filterTimer, SIGNAL(timeout()), this, SLOT(applyFilter()));
+    notesLoaded = 0;
+    fuzzyMatch = 0;
+
     // Top button layout
     clearButton = new QPushButton(tr("&Clear Fields"));
     refreshButton = new QPushButton(tr("&Refresh Selected"));
@@ -34,6 +65,16 @@ PlannerWidget::PlannerWidget(QWidget *parent)
     nameLayout->addWidget(nameInputLabel);
     nameLayout->addWidget(nameField);
 
+    // Tags layout
+    QLabel* tagsLabel = new QLabel(tr("Tags:"));
+    tagsField = new QLineEdit;
+    tagsField->setToolTip(tr("Categories for filtering the list, separated "
+                             "by commas"));
+
+    QHBoxLayout* tagsLayout = new QHBoxLayout;
+    tagsLayout->addWidget(tagsLabel);
+    tagsLayout->addWidget(tagsField);
+
     // Notes layout
     QLabel* notesLabel = new QLabel(tr("Event Notes:"));
     notesField = new QPlainTextEdit;
@@ -65,6 +106,43 @@ PlannerWidget::PlannerWidget(QWidget *parent)
     dateTimeLayout->addLayout(dateTime_1);
     dateTimeLayout->addLayout(dateTime_2);
 
+    // Recurrence layout. Repeat box index 0 is "Never", the rest follow
+    // RecurringEntry::Frequency.
+    QLabel* repeatLabel = new QLabel(tr("Repeat: "));
+    repeatBox = new QComboBox;
+    repeatBox->addItem(tr("Never"));
+    repeatBox->addItem(tr("Daily"));
+    repeatBox->addItem(tr("Weekly"));
+    repeatBox->addItem(tr("Monthly"));
+    repeatBox->addItem(tr("Yearly"));
+
+    repeatIntervalBox = new QSpinBox;
+    repeatIntervalBox->setRange(1, 99);
+    repeatIntervalBox->setPrefix(tr("every "));
+
+    repeatEndBox = new QComboBox;
+    repeatEndBox->addItem(tr("forever"));
+    repeatEndBox->addItem(tr("until"));
+    repeatEndBox->addItem(tr("times"));
+
+    repeatUntilDate = new QDateEdit;
+    repeatCountBox = new QSpinBox;
+    repeatCountBox->setRange(1, 9999);
+
+    connect(repeatBox, SIGNAL(currentIndexChanged(int)), this,
+            SLOT(enableRepeatOptions()));
+    connect(repeatEndBox, SIGNAL(currentIndexChanged(int)), this,
+            SLOT(enableRepeatOptions()));
+
+    QHBoxLayout* repeatLayout = new QHBoxLayout;
+    repeatLayout->addWidget(repeatLabel);
+    repeatLayout->addWidget(repeatBox);
+    repeatLayout->addWidget(repeatIntervalBox);
+    repeatLayout->addWidget(repeatEndBox);
+    repeatLayout->addWidget(repeatUntilDate);
+    repeatLayout->addWidget(repeatCountBox);
+    dateTimeLayout->addLayout(repeatLayout);
+
     // Bottom button layout
     addButton = new QPushButton(tr("&Add"));
     replaceButton = new QPushButton(tr("&Modify"));
@@ -83,6 +161,7 @@ PlannerWidget::PlannerWidget(QWidget *parent)
     QVBoxLayout* interfaceLayout = new QVBoxLayout;
     interfaceLayout->addLayout(buttonsLayout_1);
     interfaceLayout->addLayout(nameLayout);
+    interfaceLayout->addLayout(tagsLayout);
     interfaceLayout->addLayout(dateTimeLayout);
     interfaceLayout->addLayout(notesLayout);
     interfaceLayout->addLayout(buttonsLayout_2);
@@ -90,14 +169,45 @@ PlannerWidget::PlannerWidget(QWidget *parent)
     // Entry list layout
     QLabel *finderLabel = new QLabel("Find: ");
     finder = new QLineEdit;
+    fuzzyBox = new QCheckBox(tr("F&uzzy"));
+    fuzzyBox->setToolTip(tr("Allow typos, ignore case, and match anywhere "
+                            "in names. Press Enter for the next match."));
+    matchCountLabel = new QLabel;
     entryList = new QListWidget;
 
     QHBoxLayout *finderLayout = new QHBoxLayout;
     finderLayout->addWidget(finderLabel);
     finderLayout->addWidget(finder);
+    finderLayout->addWidget(fuzzyBox);
+    finderLayout->addWidget(matchCountLabel);
+
+    // Filter layout
+    QLabel *filterLabel = new QLabel(tr("Filter: "));
+    filterField = new QLineEdit;
+    filterField->setToolTip(tr("Show only entries with all of these tags, "
+                               "separated by commas. Put - before a tag to "
+                               "hide the entries that have it."));
+    betweenBox = new QCheckBox(tr("&Between"));
+    betweenBox->setToolTip(tr("Show only entries taking place between "
+                              "these dates"));
+    filterFromDate = new QDateEdit(QDate::currentDate());
+    filterToDate = new QDateEdit(QDate::currentDate().addDays(7));
+    filterFromDate->setCalendarPopup(true);
+    filterToDate->setCalendarPopup(true);
+    shownCountLabel = new QLabel;
+
+    QHBoxLayout *filterLayout = new QHBoxLayout;
+    filterLayout->addWidget(filterLabel);
+    filterLayout->addWidget(filterField);
+    filterLayout->addWidget(betweenBox);
+    filterLayout->addWidget(filterFromDate);
+    filterLayout->addWidget(new QLabel(tr("and")));
+    filterLayout->addWidget(filterToDate);
+    filterLayout->addWidget(shownCountLabel);
 
     QVBoxLayout *entryListLayout = new QVBoxLayout;
     entryListLayout->addLayout(finderLayout);
+    entryListLayout->addLayout(filterLayout);
     entryListLayout->addWidget(entryList);
 
     // Base layout
@@ -108,23 +218,39 @@ PlannerWidget::PlannerWidget(QWidget *parent)
     setLayout(baseLayout);
     setWindowTitle(tr("Planner[*]"));
 
-    // When a list item is clicked/selected, its data will display on interface
+    /* When a list item is clicked/selected, its data will display on
+       interface. Both signals come with one click, and arrowing or typing
+       in the finder can change the selection faster than it's drawn, so
+       the display is brought up to date once per event loop pass. */
     connect(entryList,
             SIGNAL(currentItemChanged(QListWidgetItem*, QListWidgetItem*)),
-            this, SLOT(refresh()));
-    connect(entryList, SIGNAL(clicked(QModelIndex)), this, SLOT(refresh()));
+            refreshTimer, SLOT(start()));
+    connect(entryList, SIGNAL(clicked(QModelIndex)), refreshTimer,
+            SLOT(start()));
     connect(finder, SIGNAL(textChanged(QString)), this, SLOT(find()));
+    connect(fuzzyBox, SIGNAL(toggled(bool)), this, SLOT(find()));
+    connect(finder, SIGNAL(returnPressed()), this, SLOT(nextMatch()));
+    connect(filterField, SIGNAL(textChanged(QString)), filterTimer,
+            SLOT(start()));
+    connect(betweenBox, SIGNAL(toggled(bool)), filterTimer, SLOT(start()));
+    connect(filterFromDate, SIGNAL(dateChanged(QDate)), filterTimer,
+            SLOT(start()));
+    connect(filterToDate, SIGNAL(dateChanged(QDate)), filterTimer,
+            SLOT(start()));
 
     /* Gray out buttons when they shouldn't be used */
     connect(entryList, SIGNAL(currentItemChanged(QListWidgetItem*,
             QListWidgetItem*)), this, SLOT(enableButtons()));
 
     enableButtons();
+    enableRepeatOptions();
 }
 
 PlannerWidget::~PlannerWidget()
 {
     clearVector();
+    for (uint i = 0; i < retired.size(); i++) delete retired[i];
+    for (uint i = pendingNext; i < pending.size(); i++) delete pending[i];
 }
 
 
@@ -154,36 +280,64 @@ void PlannerWidget::addEntry()
         return;
     }
 
-    QString notes = notesField->toPlainText();
+    AbstractEntry *entry = entryFromFields(name,
+                                           QDateTime::currentDateTime());
 
     // Ensure that there are no datetime conflicts with other entries
-    AbstractEntry* e = DT_conflict_in_list();
+    Occurrence when;
+    AbstractEntry* e = DT_conflict_in_list(entry, &when);
     if(e != NULL) {
         QString boxBody = tr("The supplied date/time interval conflicts\n"
                              "with the following entry:\n\n \"");
         boxBody.append(e->name());
         boxBody.append(tr("\"\nStart: "));
-        boxBody.append(e->startDateTime().toString("MM/dd/yyyy h:mm:ss AP"));
+        boxBody.append(when.first.toString("MM/dd/yyyy h:mm:ss AP"));
         boxBody.append(tr("\nEnd:  "));
-        boxBody.append(e->endDateTime().toString("MM/dd/yyyy h:mm:ss AP"));
+        boxBody.append(when.second.toString("MM/dd/yyyy h:mm:ss AP"));
+
+        /* Offer the first time after the requested one that's free for as
+           long as a single entry needs */
+        QList<Occurrence> free;
+        if (!entry->isRecurring())
+            free = freeSlots(start, start.addDays(FreeSlotSearchDays),
+                             end.toMSecsSinceEpoch()
+                             - start.toMSecsSinceEpoch(), 1);
+        if (!free.isEmpty()) {
+            boxBody.append(tr("\n\nThe first free time is:\nStart: "));
+            boxBody.append(free.first().first.toString("MM/dd/yyyy h:mm:ss AP"));
+            boxBody.append(tr("\nEnd:  "));
+            boxBody.append(free.first().second.toString("MM/dd/yyyy h:mm:ss AP"));
+        }
         boxBody.append(tr("\n\nAdd the entry anyway?"));
 
-        int x = QMessageBox::warning(this, tr("Date/Time Conflict"),
-                             boxBody,
-                             QMessageBox::Yes | QMessageBox::No,
-                             QMessageBox::No);
-
-        if(x == QMessageBox::No) return;
+        QMessageBox box(QMessageBox::Warning, tr("Date/Time Conflict"),
+                        boxBody, QMessageBox::Yes | QMessageBox::No, this);
+        box.setDefaultButton(QMessageBox::No);
+        QPushButton *freeButton = NULL;
+        if (!free.isEmpty())
+            freeButton = box.addButton(tr("Use &Free Time"),
+                                       QMessageBox::AcceptRole);
+        box.exec();
+
+        if (freeButton && box.clickedButton() == freeButton) {
+            entry->setStartDateTime(free.first().first);
+            entry->setEndDateTime(free.first().second);
+            startingDateTime->setDateTime(free.first().first);
+            endingDateTime->setDateTime(free.first().second);
+        }
+        else if (box.clickedButton() == box.button(QMessageBox::No)) {
+            delete entry;
+            return;
+        }
     }
 
-    PlannerEntry *entry = new PlannerEntry(name, start, end, notes,
-                                           QDateTime::currentDateTime());
     addEntry(entry);
+    if (writesThrough() && !backend->insertEntry(entry)) storageError();
 
     // Select the new item in the list (it's at the end)
     entryList->setCurrentRow(entryList->count() - 1);
 
-    setWindowModified(true);
+    markModified();
 }
 
 // Delete both the contents and indeces of entryVector
@@ -191,9 +345,19 @@ void PlannerWidget::clearVector()
 {
     std::vector<AbstractEntry*>::iterator it = entryVector.begin();
     while(!entryVector.empty()) {
-        delete *(it);
+        retire(*it);
         it = entryVector.erase(it); // Returns it++
     }
+    slotById.clear();
+    itemById.clear();
+    timeColumns.clear();
+    tagIndex.clear();
+    hiddenSlots.clear();
+    reminders->clear();
+    timeIndex.clear();
+    timeIndexStale = true;
+    stringPool.clear();
+    nameIndex.clear();
 }
 
 void PlannerWidget::clearFields()
@@ -206,10 +370,16 @@ void PlannerWidget::clearFields()
     DT.setTime(t);
 
     nameField->clear();
+    tagsField->clear();
     startingDateTime->setDateTime(DT);
     endingDateTime->setDateTime(DT);
-    notesField->clear();
+    showNotes(QString());
     whenAddedDisplay->clear();
+    repeatBox->setCurrentIndex(0);
+    repeatIntervalBox->setValue(1);
+    repeatEndBox->setCurrentIndex(0);
+    repeatUntilDate->setDate(DT.date());
+    repeatCountBox->setValue(1);
 }
 
 void PlannerWidget::clearList()
@@ -233,13 +403,16 @@ void PlannerWidget::deleteEntry()
 
     if (x == QMessageBox::No) return;
     deleteEntry(row);
-    setWindowModified(true);
+    markModified();
 }
 
 void PlannerWidget::find()
 {
+    TRACE_SCOPE("find");
     QString text, name;
     text = finder->text();
+    fuzzyMatches.clear();
+    matchCountLabel->clear();
 
     if (text.isEmpty()) {
         entryList->setCurrentRow(-1);
@@ -247,6 +420,11 @@ void PlannerWidget::find()
         return;
     }
 
+    if (fuzzyBox->isChecked()) {
+        fuzzyFind(text);
+        return;
+    }
+
     int i = 0;
     while(i < entryList->count()) {
         name = itemEntry(entryList->item(i))->name();
@@ -262,6 +440,82 @@ void PlannerWidget::find()
     clearFields();
 }
 
+/* Rank every entry whose name is close to text and select the best. The
+   ranking is kept for nextMatch(). */
+void PlannerWidget::fuzzyFind(const QString &text)
+{
+    TRACE_SCOPE("fuzzyFind");
+    TRACE_COUNT(entryVector.size());
+    std::vector<FuzzyMatch> matches = FuzzyMatcher(text).search(entryVector);
+    for (uint i = 0; i < matches.size(); i++)
+        fuzzyMatches.push_back(entryVector[matches[i].index]->id());
+
+    matchCountLabel->setText(tr("%n match(es)", "", int(matches.size())));
+    if (fuzzyMatches.empty()) {
+        entryList->setCurrentRow(-1);
+        clearFields();
+        return;
+    }
+    fuzzyMatch = 0;
+    entryList->setCurrentItem(itemById.value(fuzzyMatches[0]));
+}
+
+// Select the next entry in the fuzzy ranking, going round at the end
+void PlannerWidget::nextMatch()
+{
+    if (fuzzyMatches.empty()) return;
+
+    fuzzyMatch = (fuzzyMatch + 1) % int(fuzzyMatches.size());
+    QListWidgetItem *item = itemById.value(fuzzyMatches[fuzzyMatch]);
+    if (item) entryList->setCurrentItem(item);
+}
+
+/* Hide the entries the filter leaves out and show the rest. Only items
+   whose state changes are touched, all before the list is next painted. */
+void PlannerWidget::applyFilter()
+{
+    TRACE_SCOPE("applyFilter");
+    TRACE_COUNT(entryVector.size());
+    filterTimer->stop();
+
+    RoaringBitmap hidden;
+    if (filtering()) {
+        hidden = RoaringBitmap::range(quint32(entryVector.size()))
+                 .andNot(filterMatches());
+    }
+    std::vector<int> hideRows, showRows;
+    hidden.andNot(hiddenSlots).toVector(hideRows);
+    hiddenSlots.andNot(hidden).toVector(showRows);
+
+    entryList->setUpdatesEnabled(false);
+    for (uint i = 0; i < hideRows.size(); i++)
+        itemById.value(entryVector[hideRows[i]]->id())->setHidden(true);
+    for (uint i = 0; i < showRows.size(); i++)
+        itemById.value(entryVector[showRows[i]]->id())->setHidden(false);
+    entryList->setUpdatesEnabled(true);
+    hiddenSlots = hidden;
+
+    if (filtering())
+        shownCountLabel->setText(tr("%n shown", "", int(entryVector.size())
+                                                    - hidden.cardinality()));
+    else shownCountLabel->clear();
+
+    // Don't leave a hidden entry selected
+    QListWidgetItem *current = entryList->currentItem();
+    if (current && current->isHidden()) entryList->setCurrentRow(-1);
+}
+
+/* A row's hidden state belongs to the list's view, not its item, so rows
+   taken out and put back by a sort come back visible. Hide the filtered-out
+   ones again. */
+void PlannerWidget::rehideFiltered()
+{
+    std::vector<int> rows;
+    hiddenSlots.toVector(rows);
+    for (uint i = 0; i < rows.size(); i++)
+        itemById.value(entryVector[rows[i]]->id())->setHidden(true);
+}
+
 /* Disable certain buttons when no list item is selected */
 void PlannerWidget::enableButtons()
 {
@@ -271,18 +525,52 @@ void PlannerWidget::enableButtons()
     refreshButton->setEnabled(b);
 }
 
-// Load the data from the currently-selected list item into the input fields
+/* Gray out the recurrence fields that don't apply to the chosen rule */
+void PlannerWidget::enableRepeatOptions()
+{
+    bool repeats = repeatBox->currentIndex() != 0;
+    repeatIntervalBox->setEnabled(repeats);
+    repeatEndBox->setEnabled(repeats);
+    repeatUntilDate->setEnabled(repeats && repeatEndBox->currentIndex() == 1);
+    repeatCountBox->setEnabled(repeats && repeatEndBox->currentIndex() == 2);
+}
+
+/* Load the data from the currently-selected list item into the input
+   fields. Fields that already show it are left alone. */
 void PlannerWidget::refresh()
 {
+        refreshTimer->stop();
         if (entryList->currentItem() == NULL) return;
 
+        TRACE_SCOPE("refresh");
         AbstractEntry* e = currentEntry();
-        nameField->setText(e->name());
-        startingDateTime->setDateTime(e->startDateTime());
-        endingDateTime->setDateTime(e->endDateTime());
-        notesField->setPlainText(e->notes());
+        if (nameField->text() != e->name()) nameField->setText(e->name());
+        QString tags = e->tags().join(", ");
+        if (tagsField->text() != tags) tagsField->setText(tags);
+        if (startingDateTime->dateTime() != e->startDateTime())
+            startingDateTime->setDateTime(e->startDateTime());
+        if (endingDateTime->dateTime() != e->endDateTime())
+            endingDateTime->setDateTime(e->endDateTime());
+        showNotes(e->notes());
         whenAddedDisplay->setText("Entry created: " + e->whenAdded().toString(
                                       "MM/dd/yyyy h:mm:ss AP"));
+
+        if (!e->isRecurring()) {
+            repeatBox->setCurrentIndex(0);
+            return;
+        }
+        RecurringEntry *r = static_cast<RecurringEntry*>(e);
+        repeatBox->setCurrentIndex(r->frequency() + 1);
+        repeatIntervalBox->setValue(r->interval());
+        if (r->count() > 0) {
+            repeatEndBox->setCurrentIndex(2);
+            repeatCountBox->setValue(r->count());
+        }
+        else if (r->until().isValid()) {
+            repeatEndBox->setCurrentIndex(1);
+            repeatUntilDate->setDate(r->until());
+        }
+        else repeatEndBox->setCurrentIndex(0);
 }
 
 /* Replaces the selected entry's data with what's in the input fields. It's
@@ -299,13 +587,31 @@ void PlannerWidget::replaceEntry()
     if(name != e->name())
         if(invalidName(name)) return;
 
-    e->setName(name);
-    e->setStartDateTime(startingDateTime->dateTime());
-    e->setEndDateTime(endingDateTime->dateTime());
-    e->setNotes(notesField->toPlainText());
+    /* A rule is rebuilt from the fields as a fresh entry, which also covers
+       switching between single and recurring entries. */
+    if (e->isRecurring() || repeatBox->currentIndex() != 0) {
+        replaceItemEntry(entryList->currentItem(),
+                         entryFromFields(name, e->whenAdded()));
+    }
+    else {
+        e = writable(e);
+        QStringList oldTags = e->tags();
+        nameIndex.remove(e->name().constData());
+        releaseStrings(e);
+        e->setName(name);
+        e->setTags(AbstractEntry::parseTags(tagsField->text()));
+        e->setStartDateTime(startingDateTime->dateTime());
+        e->setEndDateTime(endingDateTime->dateTime());
+        e->setNotes(fieldNotes());
+        internStrings(e);
+        tagIndex.retag(slotById.value(e->id()), oldTags, e->tags());
+        timesChanged(e);
+    }
 
     entryList->currentItem()->setText(nameField->text());
-    setWindowModified(true);
+    if (writesThrough() && !backend->updateEntry(currentEntry()))
+        storageError();
+    markModified();
 }
 
 /* If the datetime fields indicate a datetime interval that conflicts with the
@@ -315,7 +621,9 @@ void PlannerWidget::sortByDate(bool byStartDT)
 {
     /* Will go through entryList and compare DT's, then continuously
        put the entry with the lowest DT at the end (selection sort) */
-    QDateTime minDT, curDT;
+    TRACE_SCOPE("sortByDate");
+    TRACE_COUNT(entryList->count());
+    qint64 minDT, curDT;
     int row, i, unsorted;
     unsorted = entryList->count();
 
@@ -328,16 +636,16 @@ void PlannerWidget::sortByDate(bool byStartDT)
         /* Reset everything */
         row = 0;
         if (byStartDT)
-            curDT = itemEntry(entryList->item(0))->startDateTime();
-        else curDT = itemEntry(entryList->item(0))->whenAdded();
+            curDT = itemEntry(entryList->item(0))->startMSecs();
+        else curDT = itemEntry(entryList->item(0))->whenAddedMSecs();
         minDT = curDT;
 
         /* Compare each unsorted item to the known min, and update min */
         for (i=0; i < unsorted; i++) {
             if (byStartDT)
-                curDT = itemEntry(entryList->item(i))->startDateTime();
-            else curDT = itemEntry(entryList->item(i))->whenAdded();
-            if(curDT.operator<=(minDT)) {
+                curDT = itemEntry(entryList->item(i))->startMSecs();
+            else curDT = itemEntry(entryList->item(i))->whenAddedMSecs();
+            if(curDT <= minDT) {
                 minDT = curDT;
                 row = i;
             }
@@ -348,11 +656,14 @@ void PlannerWidget::sortByDate(bool byStartDT)
         entryList->addItem(entryList->takeItem(row));
         unsorted--;
     }
-    setWindowModified(true);
+    rehideFiltered();
+    markModified();
 }
 
 void PlannerWidget::sortInReverse()
 {
+    TRACE_SCOPE("sortInReverse");
+    TRACE_COUNT(entryList->count());
     std::stack<QListWidgetItem*> itemStack;
 
     /* "Move" all the entries to a stack */
@@ -365,13 +676,16 @@ void PlannerWidget::sortInReverse()
         entryList->addItem(itemStack.top());
         itemStack.pop();
     }
-    setWindowModified(true);
+    rehideFiltered();
+    markModified();
 }
 
 void PlannerWidget::sortByName()
 {
+    TRACE_SCOPE("sortByName");
+    TRACE_COUNT(entryList->count());
     entryList->sortItems();
-    setWindowModified(true);
+    markModified();
 }
 
 void PlannerWidget::synchDT()
@@ -379,6 +693,37 @@ void PlannerWidget::synchDT()
     endingDateTime->setDateTime(startingDateTime->dateTime());
 }
 
+// Put the next chunk of long notes into the notes field (see showNotes())
+void PlannerWidget::loadMoreNotes()
+{
+    int end = notesChunkEnd(notesLoaded);
+    QTextCursor cursor(notesField->document());
+    cursor.movePosition(QTextCursor::End);
+    cursor.insertText(shownNotes.mid(notesLoaded, end - notesLoaded));
+    notesLoaded = end;
+    notesField->document()->setModified(false);
+    if (notesLoaded < shownNotes.size()) return;
+
+    notesTimer->stop();
+    notesField->document()->setUndoRedoEnabled(true);
+    notesField->setReadOnly(false);
+}
+
+/* An entry's reminder time has come: announce the occurrence starting
+   ReminderLead later, unless the reminder is overdue by more than that
+   (e.g. after the computer slept), then schedule the next occurrence. */
+void PlannerWidget::remind(quint64 id, qint64 msecs)
+{
+    AbstractEntry *e = entryWithId(id);
+    if (e == NULL) return;
+
+    qint64 start = msecs + ReminderLead;
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    if (start > now - ReminderLead)
+        emit reminder(e->name(), QDateTime::fromMSecsSinceEpoch(start));
+    scheduleReminder(e, qMax(start, now));
+}
+
 
 
 
@@ -388,50 +733,197 @@ void PlannerWidget::synchDT()
 
 void PlannerWidget::addEntry(AbstractEntry* entry)
 {
+    /* Entries keep the ID they were saved with, unless it's already used
+       here (e.g. a plan imported into itself) */
+    if (entry->id() == 0 || slotById.contains(entry->id()))
+        entry->setId(newId());
+
     /* Create a list item and corresponding entry */
     QListWidgetItem* item = new QListWidgetItem(entry->name());
 
-    /* Add a pointer to the entry to the list item */
-    QVariant qvar = qVariantFromValue((void*)entry);
-    item->setData(Qt::UserRole, qvar);
+    internStrings(entry);
+
+    /* The list item refers to its entry by ID */
+    item->setData(Qt::UserRole, QVariant(entry->id()));
+    itemById.insert(entry->id(), item);
 
+    slotById.insert(entry->id(), int(entryVector.size()));
+    tagIndex.add(int(entryVector.size()), entry->tags());
     entryVector.push_back(entry);
     entryList->addItem(item);
+
+    timesChanged(entry);
 }
 
-/* Remove entries whose ending datetime is earlier than DT. */
+/* Add a batch of entries at once, as an import does. Names must be unique,
+   so one that's taken gets a " (2)", " (3)"... suffix. The list is only
+   repainted once the whole batch is in. */
+void PlannerWidget::addEntries(const std::vector<AbstractEntry*> &entries)
+{
+    if (entries.empty()) return;
+
+    TRACE_SCOPE("addEntries");
+    TRACE_COUNT(entries.size());
+    entryList->setUpdatesEnabled(false);
+    if (writesThrough()) backend->beginBatch();
+    for (uint i = 0; i < entries.size(); i++) {
+        AbstractEntry *e = entries[i];
+        makeNameUnique(e);
+        addEntry(e);
+        if (writesThrough()) backend->insertEntry(e);
+    }
+    if (writesThrough() && !backend->endBatch()) storageError();
+    entryList->setUpdatesEnabled(true);
+    TRACE_COUNTER("entries", entryVector.size());
+
+    markModified();
+}
+
+/* Remove entries whose ending datetime is earlier than DT, moving them to
+   the archive if there is one. If they can't be archived, they stay. */
 void PlannerWidget::clearOldEntries(QDateTime dt)
 {
+    TRACE_SCOPE("clearOldEntries");
+    qint64 msecs = dt.toMSecsSinceEpoch();
+
     /* First, check if any "old" entries are present */
-    uint i = 0;
-    while (i < entryVector.size()) {
-        if(entryVector[i]->endDateTime().operator <=(dt))
-            break;
-        i++;
-    }
+    QSet<quint64> old = idsEndedBy(msecs);
 
     /* If none are found, return */
-    if (i == entryVector.size()) return;
+    if (old.isEmpty()) return;
 
     /* Ask whether or not to delete them */
+    if (!confirmClearOld()) return;
+
+    if (archive) {
+        std::vector<AbstractEntry*> archived;
+        archived.reserve(old.size());
+        QSet<quint64>::const_iterator it;
+        for (it = old.constBegin(); it != old.constEnd(); it++)
+            archived.push_back(entryWithId(*it));
+        if (!archiveEntries(archived)) return;
+    }
+
+    /* Delete the old items' rows from the end, so the remaining ones don't
+       shift */
+    int deleted = 0;
+    if (writesThrough()) backend->beginBatch();
+    for (int row = entryList->count() - 1; !old.isEmpty() && row >= 0;
+         row--) {
+        if (old.remove(entryList->item(row)->data(Qt::UserRole)
+                       .toULongLong())) {
+            deleteEntry(row);
+            deleted++;
+        }
+    }
+    if (writesThrough() && !backend->endBatch()) storageError();
+    if (deleted > 0) markModified();
+    TRACE_COUNT(deleted);
+    TRACE_COUNTER("entries", entryVector.size());
+}
+
+/* The IDs of the entries that ended by msecs: single ones from a scan of
+   their time columns, recurring ones from their rules */
+QSet<quint64> PlannerWidget::idsEndedBy(qint64 msecs) const
+{
+    QSet<quint64> ids;
+    std::vector<int> rows;
+    timeColumns.endedBy(msecs, rows);
+    for (uint i = 0; i < rows.size(); i++)
+        ids.insert(entryVector[rows[i]]->id());
+
+    const QSet<int> &recurring = timeColumns.recurringSlots();
+    QSet<int>::const_iterator it;
+    for (it = recurring.constBegin(); it != recurring.constEnd(); it++) {
+        if (entryVector[*it]->endedBy(msecs))
+            ids.insert(entryVector[*it]->id());
+    }
+    return ids;
+}
+
+bool PlannerWidget::confirmClearOld()
+{
     int x = QMessageBox::question(this, tr("Planner"),
-            tr("Would you like to clear\n"
-               "the events which have\n"
-               "already occurred?"),
+            archive ? tr("Would you like to archive\n"
+                         "the events which have\n"
+                         "already occurred?")
+                    : tr("Would you like to clear\n"
+                         "the events which have\n"
+                         "already occurred?"),
             QMessageBox::Yes | QMessageBox::No,
             QMessageBox::No);
-    if (x == QMessageBox::No) return;
+    return x == QMessageBox::Yes;
+}
 
-    /* Traverse list widget, deleting old items */
-    QDateTime eventEnd;
-    for(int j = i; j < entryList->count(); j++) {
-        eventEnd = itemEntry(entryList->item(j))->endDateTime();
+/* Start showing a newly opened document's entries (which are taken over),
+   leaving out those that ended by clearBefore if clearOld is set, so
+   clearing old entries costs no second pass. With an archive, the old
+   entries are written to it in one go, and kept if that fails. The rest
+   are only listed by loadMore(), a batch at a time. Returns how many were
+   left out.
+
+   Every entry is recorded as synced, cleared ones included, so a later
+   merge from disk knows they were deleted here. */
+int PlannerWidget::loadEntries(const std::vector<AbstractEntry*> &entries,
+                               bool clearOld, qint64 clearBefore)
+{
+    TRACE_SCOPE("PlannerWidget::loadEntries");
+    TRACE_COUNT(entries.size());
+    clearList();
+    syncedHashes.clear();
+    syncedHashes.reserve(int(entries.size()));
+    pending.clear();
+    pending.reserve(entries.size());
+    pendingNext = 0;
+
+    std::vector<AbstractEntry*> old;
+    for (uint i = 0; i < entries.size(); i++) {
+        AbstractEntry *e = entries[i];
+        if (clearOld && e->endedBy(clearBefore)) old.push_back(e);
+        else pending.push_back(e);
+    }
 
-        if(eventEnd.operator <=(dt)) {
-            deleteEntry(j);
-            j--; // Otherwise you'll skip the now-j'th (prev. j+1'th) entry
-        }
+    if (!old.empty() && archive && !archiveEntries(old)) {
+        pending.insert(pending.end(), old.begin(), old.end());
+        old.clear();
+    }
+
+    if (!old.empty() && writesThrough()) backend->beginBatch();
+    for (uint i = 0; i < old.size(); i++) {
+        AbstractEntry *e = old[i];
+        if (e->id()) syncedHashes.insert(e->id(), e->contentHash());
+        if (writesThrough() && !backend->removeEntry(e->id()))
+            storageError();
+        delete e;
+    }
+    if (!old.empty() && writesThrough() && !backend->endBatch())
+        storageError();
+
+    if (!old.empty()) markModified();
+    return int(old.size());
+}
+
+/* List up to count more of the entries loadEntries() took, repainting once.
+   Returns whether they're all in. */
+bool PlannerWidget::loadMore(int count)
+{
+    TRACE_SCOPE("PlannerWidget::loadMore");
+    uint end = pendingNext + qMin(uint(count), uint(pending.size())
+                                               - pendingNext);
+    TRACE_COUNT(end - pendingNext);
+    entryList->setUpdatesEnabled(false);
+    for (; pendingNext < end; pendingNext++) {
+        AbstractEntry *e = pending[pendingNext];
+        addEntry(e);
+        syncedHashes.insert(e->id(), e->contentHash());
     }
+    entryList->setUpdatesEnabled(true);
+    if (pendingNext < pending.size()) return false;
+
+    std::vector<AbstractEntry*>().swap(pending);
+    pendingNext = 0;
+    TRACE_COUNTER("entries", entryVector.size());
+    return true;
 }
 
 /* Return pointer to the entry represented by the current list item */
@@ -447,41 +939,149 @@ void PlannerWidget::deleteEntry(int row)
     QListWidgetItem *lwi = entryList->item(row);
 
     /* Delete the entry associated with lwi, but erase its vector element
-    first. Search for it linearly, since the list widget might get resorted,
-    which would leave the vector unsorted. */
+    and index entries first */
     AbstractEntry* e = itemEntry(lwi);
-    std::vector<AbstractEntry*>::iterator i = entryVector.begin();
-    while (*i != e) i++;
-    delete e;
-    entryVector.erase(i);
+    nameIndex.remove(e->name().constData());
+    itemById.remove(e->id());
+    reminders->cancel(e->id());
+    if (!timeIndexStale) timeIndex.remove(e->id());
+    if (writesThrough() && !backend->removeEntry(e->id())) storageError();
+    removeFromVector(e);
+    retire(e);
 
     /* Delete the list item */
     delete entryList->takeItem(row);
 }
 
-AbstractEntry *PlannerWidget::DT_conflict_in_list()
+/* Return the first entry whose date/time interval (or, for recurring
+   entries, any of their occurrences) overlaps candidate's. "when" receives
+   the clashing interval of the returned entry. */
+AbstractEntry *PlannerWidget::DT_conflict_in_list(const AbstractEntry *candidate,
+                                                  Occurrence *when)
 {
+    TRACE_SCOPE("DT_conflict_in_list");
+    TRACE_COUNT(entryVector.size());
     AbstractEntry *e;
-    QDateTime start_1, end_1, start_2, end_2;
-    start_1 = startingDateTime->dateTime();
-    end_1 = endingDateTime->dateTime();
-
-    for(uint i=0; i < entryVector.size(); i++) {
-        e = entryVector[i];
-        start_2 = e->startDateTime();
-        end_2 = e->endDateTime();
-
-        /* Check if either of the events have a starting point that is within
-           the start-end interval of the other, i.e. there is DT overlap. */
-        if (start_2.operator>=(start_1) && start_2.operator<=(end_1) ||
-            start_1.operator>=(start_2) && start_1.operator<=(end_2))
-        {
+    bool single_1 = !candidate->isRecurring();
+    qint64 start_1 = candidate->startMSecs(), end_1 = candidate->endMSecs();
+
+    /* Single entries are found by scanning their time columns.
+       Two single entries are just an interval overlap test; a single entry
+       can only meet a recurring candidate within the candidate's span. */
+    if (single_1) {
+        int slot = timeColumns.firstOverlapping(start_1, end_1);
+        if (slot >= 0) {
+            e = entryVector[slot];
+            if (when) *when = Occurrence(e->startDateTime(),
+                                         e->endDateTime());
             return e;
         }
     }
+    else {
+        std::vector<int> rows;
+        timeColumns.overlapping(start_1, static_cast<const RecurringEntry*>(
+                                    candidate)->lastEndMSecs(), rows);
+        for (uint i = 0; i < rows.size(); i++) {
+            e = entryVector[rows[i]];
+            if (e->conflictsWith(candidate, when)) return e;
+        }
+    }
+
+    // Recurring entries have their rules checked one by one
+    const QSet<int> &recurring = timeColumns.recurringSlots();
+    QSet<int>::const_iterator it;
+    for (it = recurring.constBegin(); it != recurring.constEnd(); it++) {
+        e = entryVector[*it];
+        if (e->conflictsWith(candidate, when)) return e;
+    }
     return NULL;
 }
 
+/* The earliest places between from and to, up to maxSlots of them in
+   different gaps, that an entry lasting duration (in milliseconds) could
+   take without conflicting with any entry. */
+QList<Occurrence> PlannerWidget::freeSlots(const QDateTime &from,
+                                           const QDateTime &to,
+                                           qint64 duration, int maxSlots)
+{
+    TRACE_SCOPE("freeSlots");
+    TRACE_COUNT(entryVector.size());
+    if (timeIndexStale) {
+        timeIndex.build(entryVector);
+        timeIndexStale = false;
+    }
+    return timeIndex.freeSlots(from.toMSecsSinceEpoch(),
+                               to.toMSecsSinceEpoch(), duration, maxSlots);
+}
+
+/* Show notes in the notes field, unless it already shows them unedited.
+   Long notes go in NotesChunk characters at a time, one chunk per event
+   loop pass, so selecting an entry with huge notes doesn't stall; the
+   field is read-only until they're all in. */
+void PlannerWidget::showNotes(const QString &notes)
+{
+    QTextDocument *document = notesField->document();
+    if (notes == shownNotes && !document->isModified()) return;
+
+    shownNotes = notes;
+    notesLoaded = notesChunkEnd(0);
+    bool loading = notesLoaded < notes.size();
+    notesField->setPlainText(loading ? notes.left(notesLoaded) : notes);
+    document->setModified(false);
+    document->setUndoRedoEnabled(!loading);
+    notesField->setReadOnly(loading);
+    if (loading) notesTimer->start();
+    else notesTimer->stop();
+}
+
+// Where the chunk of shownNotes starting at "from" ends
+int PlannerWidget::notesChunkEnd(int from) const
+{
+    int end = qMin(from + int(NotesChunk), shownNotes.size());
+
+    // Don't split a surrogate pair
+    if (end < shownNotes.size() && shownNotes.at(end - 1).isHighSurrogate())
+        end++;
+    return end;
+}
+
+/* The notes field's text. Unless it was edited, that's the notes it was
+   loaded with, so long notes (even half loaded) aren't copied out. */
+QString PlannerWidget::fieldNotes() const
+{
+    if (!notesField->document()->isModified()) return shownNotes;
+    return notesField->toPlainText();
+}
+
+/* Build a new entry from the input fields. A repeat setting other than
+   "Never" makes it a recurring entry. */
+AbstractEntry *PlannerWidget::entryFromFields(QString name,
+                                              QDateTime whenAdded)
+{
+    QDateTime start = startingDateTime->dateTime();
+    QDateTime end = endingDateTime->dateTime();
+    QString notes = fieldNotes();
+    AbstractEntry *entry;
+
+    if (repeatBox->currentIndex() == 0)
+        entry = new PlannerEntry(name, start, end, notes, whenAdded);
+    else {
+        int count = 0;
+        QDate until;
+        if (repeatEndBox->currentIndex() == 1)
+            until = repeatUntilDate->date();
+        else if (repeatEndBox->currentIndex() == 2)
+            count = repeatCountBox->value();
+
+        RecurringEntry::Frequency freq =
+                RecurringEntry::Frequency(repeatBox->currentIndex() - 1);
+        entry = new RecurringEntry(name, start, end, notes, whenAdded, freq,
+                                   repeatIntervalBox->value(), count, until);
+    }
+    entry->setTags(AbstractEntry::parseTags(tagsField->text()));
+    return entry;
+}
+
 bool PlannerWidget::invalidName(QString name)
 {
     // Make sure name is non-empty
@@ -494,30 +1094,480 @@ bool PlannerWidget::invalidName(QString name)
     }
 
     // Make sure name isn't taken
-    for (uint i=0; i < entryVector.size(); i++) {
-        if (name == entryVector[i]->name()) {
-            QMessageBox::warning(this, tr("Naming Conflict"),
-                                 tr("Another entry already has this\n"
-                                 "name. Please choose another."),
-                                 QMessageBox::Ok);
-            nameField->setFocus();
-            return true;
-        }
+    if (nameTaken(name)) {
+        QMessageBox::warning(this, tr("Naming Conflict"),
+                             tr("Another entry already has this\n"
+                             "name. Please choose another."),
+                             QMessageBox::Ok);
+        nameField->setFocus();
+        return true;
+    }
+    return false;
+}
+
+/* All entry names are interned, so an equal name has to share the interned
+   copy's data (and a name that was never interned can't be taken). */
+bool PlannerWidget::nameTaken(const QString &name) const
+{
+    QString interned = stringPool.lookup(name);
+    return !interned.isNull() && nameIndex.contains(interned.constData());
+}
+
+AbstractEntry *PlannerWidget::entryNamed(const QString &name) const
+{
+    QString interned = stringPool.lookup(name);
+    if (interned.isNull()) return NULL;
+    return nameIndex.value(interned.constData(), NULL);
+}
+
+AbstractEntry *PlannerWidget::entryWithId(quint64 id) const
+{
+    QHash<quint64, int>::const_iterator it = slotById.constFind(id);
+    if (it == slotById.constEnd()) return NULL;
+    return entryVector[it.value()];
+}
+
+/* Names must be unique, so a taken one gets a " (2)", " (3)"... suffix */
+void PlannerWidget::makeNameUnique(AbstractEntry *entry) const
+{
+    if (!nameTaken(entry->name())) return;
+
+    QString base = entry->name(), name;
+    int n = 2;
+    do name = QString("%1 (%2)").arg(base).arg(n++);
+    while (nameTaken(name));
+    entry->setName(name);
+}
+
+/* IDs are random rather than counted, so entries added to copies of a plan
+   in different places don't get the same ID (see mergeFromDisk()). qrand()
+   may give as few as 15 bits, so the ID is built 16 bits at a time. */
+quint64 PlannerWidget::newId() const
+{
+    quint64 id;
+    do {
+        id = 0;
+        for (int i = 0; i < 4; i++) id = id << 16 | quint64(qrand() & 0xFFFF);
+    } while (id == 0 || slotById.contains(id));
+    return id;
+}
+
+/* Move the last entry into the freed slot, so removal takes constant time.
+   The list widget, not the vector, keeps the order entries are shown in. */
+void PlannerWidget::removeFromVector(AbstractEntry *entry)
+{
+    int slot = slotById.take(entry->id());
+    int lastSlot = int(entryVector.size()) - 1;
+    AbstractEntry *last = entryVector.back();
+    entryVector[slot] = last;
+    tagIndex.remove(slot, entry->tags());
+    releaseStrings(entry);
+    if (last != entry) {
+        slotById.insert(last->id(), slot);
+        tagIndex.move(lastSlot, slot, last->tags());
     }
+    entryVector.pop_back();
+    timeColumns.remove(slot);
+
+    bool lastHidden = hiddenSlots.contains(lastSlot);
+    hiddenSlots.remove(lastSlot);
+    if (lastHidden && last != entry) hiddenSlots.add(slot);
+    else hiddenSlots.remove(slot);
+}
+
+/* The storage the current document lives in, or NULL. Incremental backends
+   are sent every edit as it's made. The caller keeps ownership. */
+void PlannerWidget::setBackend(StorageBackend *newBackend)
+{
+    backend = newBackend;
+}
+
+/* Where cleared entries are kept instead of being deleted, or NULL to
+   delete them. The caller keeps ownership. */
+void PlannerWidget::setArchive(EntryArchive *newArchive)
+{
+    archive = newArchive;
+}
+
+// Write old to the archive, saying why not if it can't be done
+bool PlannerWidget::archiveEntries(const std::vector<AbstractEntry*> &old)
+{
+    if (archive->append(old)) return true;
+    QMessageBox::warning(this, tr("Planner"),
+                         tr("The past events were kept, because they could "
+                            "not be archived:\n%1")
+                         .arg(archive->errorString()),
+                         QMessageBox::Ok);
     return false;
 }
 
+bool PlannerWidget::writesThrough() const
+{
+    return backend && backend->isIncremental();
+}
+
+void PlannerWidget::storageError()
+{
+    QMessageBox::warning(this, tr("Planner"),
+                         tr("The change could not be stored:\n%1")
+                         .arg(backend->errorString()),
+                         QMessageBox::Ok);
+}
+
 AbstractEntry* PlannerWidget::itemEntry(QListWidgetItem* lwi)
 {
-    return (PlannerEntry*)lwi->data(Qt::UserRole).value<void*>();
+    return entryWithId(lwi->data(Qt::UserRole).toULongLong());
+}
+
+/* Share the entry's strings with any identical ones already in use */
+void PlannerWidget::internStrings(AbstractEntry *entry)
+{
+    entry->setName(stringPool.intern(entry->name()));
+    entry->setNotes(stringPool.intern(entry->notes()));
+    nameIndex.insert(entry->name().constData(), entry);
+
+    QStringList tags = entry->tags();
+    for (int i = 0; i < tags.size(); i++) tags[i] = stringPool.intern(tags[i]);
+    entry->setTags(tags);
+}
+
+// End the string pool uses internStrings() made for the entry
+void PlannerWidget::releaseStrings(const AbstractEntry *entry)
+{
+    stringPool.release(entry->name());
+    stringPool.release(entry->notes());
+    QStringList tags = entry->tags();
+    for (int i = 0; i < tags.size(); i++) stringPool.release(tags[i]);
+}
+
+/* Swap the entry behind lwi for newEntry, keeping its ID and its list and
+   vector positions, and delete the old one. */
+void PlannerWidget::replaceItemEntry(QListWidgetItem *lwi,
+                                     AbstractEntry *newEntry)
+{
+    AbstractEntry* e = itemEntry(lwi);
+    int slot = slotById.value(e->id());
+    newEntry->setId(e->id());
+    entryVector[slot] = newEntry;
+    nameIndex.remove(e->name().constData());
+    tagIndex.retag(slot, e->tags(), newEntry->tags());
+    releaseStrings(e);
+    retire(e);
+    internStrings(newEntry);
+    timesChanged(newEntry);
+
+    lwi->setText(newEntry->name());
 }
 
-std::vector<AbstractEntry*> PlannerWidget::vector()
+// All entries, in no particular order
+const std::vector<AbstractEntry*> &PlannerWidget::vector() const
 {
     return entryVector;
 }
 
-/* Override the ESC button's ability to close this widget */
+/* All entries in the order they're listed, which is the order they're
+   saved in, so a sort lasts across sessions */
+std::vector<AbstractEntry*> PlannerWidget::listOrder() const
+{
+    std::vector<AbstractEntry*> entries;
+    entries.reserve(entryList->count());
+    for (int row = 0; row < entryList->count(); row++) {
+        quint64 id = entryList->item(row)->data(Qt::UserRole).toULongLong();
+        entries.push_back(entryVector[slotById.value(id)]);
+    }
+    return entries;
+}
+
+/* All entries in list order, for reading on another thread (e.g. to save
+   them) until releaseSnapshot(). Only pointers are copied: while any
+   snapshot is out, entries are never changed or freed in place. An edit
+   works on a copy that takes the original's place, and originals that are
+   replaced or deleted are kept until the last snapshot is released. */
+std::vector<AbstractEntry*> PlannerWidget::snapshot()
+{
+    snapshotsOut++;
+    return listOrder();
+}
+
+void PlannerWidget::releaseSnapshot()
+{
+    if (snapshotsOut == 0 || --snapshotsOut > 0) return;
+    for (uint i = 0; i < retired.size(); i++) delete retired[i];
+    std::vector<AbstractEntry*>().swap(retired);
+}
+
+// Free an entry that's no longer in the plan, unless a snapshot has it
+void PlannerWidget::retire(AbstractEntry *entry)
+{
+    if (snapshotsOut > 0) retired.push_back(entry);
+    else delete entry;
+}
+
+/* The entry to change in place of e: e itself, or while a snapshot may be
+   reading e, a copy that replaces it in the plan. A copy has the same ID,
+   slot and (shared) strings, so only the vector, the name index and the
+   free time index (which keeps recurring entries) need pointing at it. */
+AbstractEntry *PlannerWidget::writable(AbstractEntry *e)
+{
+    if (snapshotsOut == 0) return e;
+
+    AbstractEntry *copy = e->clone();
+    entryVector[slotById.value(e->id())] = copy;
+    nameIndex.insert(copy->name().constData(), copy);
+    if (!timeIndexStale) timeIndex.set(copy);
+    retire(e);
+    return copy;
+}
+
+/* Grows with every modification, so callers can tell whether anything
+   changed since they last looked */
+quint64 PlannerWidget::changeCount() const { return changes; }
+
+/* Record every entry's hash as the state of the file on disk, after it has
+   been loaded or saved. mergeFromDisk() compares both sides against this. */
+void PlannerWidget::markSynced()
+{
+    syncedHashes.clear();
+    syncedHashes.reserve(int(entryVector.size()));
+    for (uint i = 0; i < entryVector.size(); i++)
+        syncedHashes.insert(entryVector[i]->id(),
+                            entryVector[i]->contentHash());
+}
+
+/* Bring in the changes someone else saved to our file, given its current
+   entries (which are taken over). Entries are matched by ID (or by name, if
+   the file predates IDs) and compared by hash against the state last
+   synced. Only entries changed on disk but not here are applied; where
+   both sides changed, ours are kept. Entries keep their list positions, so
+   the selection and sort order survive, and unsaved edits elsewhere stay
+   unsaved. */
+PlannerWidget::MergeResult PlannerWidget::mergeFromDisk(
+        const std::vector<AbstractEntry*> &disk)
+{
+    TRACE_SCOPE("mergeFromDisk");
+    TRACE_COUNT(disk.size());
+    MergeResult result = { 0, 0, 0, 0 };
+    QHash<quint64, quint64> diskHashes;
+    diskHashes.reserve(int(disk.size()));
+
+    entryList->setUpdatesEnabled(false);
+    for (uint i = 0; i < disk.size(); i++) {
+        AbstractEntry *remote = disk[i];
+        quint64 hash = remote->contentHash();
+        AbstractEntry *local = remote->id() ? entryWithId(remote->id())
+                                            : entryNamed(remote->name());
+        quint64 id = remote->id() ? remote->id() : local ? local->id() : 0;
+        if (id) diskHashes.insert(id, hash);
+
+        QHash<quint64, quint64>::const_iterator base =
+                syncedHashes.constFind(id);
+        bool inBase = id && base != syncedHashes.constEnd();
+
+        // Unchanged on disk, or changed to what we have already
+        if ((inBase && base.value() == hash)
+                || (local && local->contentHash() == hash)) {
+            delete remote;
+            continue;
+        }
+
+        // Changed (or deleted, or added under the same ID) here as well
+        bool changedHere = inBase ? (!local || local->contentHash()
+                                               != base.value())
+                                  : local != NULL;
+        if (changedHere) {
+            result.kept++;
+            delete remote;
+            continue;
+        }
+
+        if (local) {
+            // A rename on disk may take a name that's in use here
+            if (remote->name() != local->name()) makeNameUnique(remote);
+            replaceItemEntry(itemById.value(local->id()), remote);
+            result.changed++;
+        }
+        else {
+            makeNameUnique(remote);
+            addEntry(remote);
+            diskHashes.insert(remote->id(), hash);
+            result.added++;
+        }
+    }
+
+    /* Entries deleted from the file go too, unless they were changed here.
+       Rows are deleted from the end so the remaining ones don't shift. */
+    QSet<quint64> removed;
+    QHash<quint64, quint64>::const_iterator it;
+    for (it = syncedHashes.constBegin(); it != syncedHashes.constEnd(); it++) {
+        if (diskHashes.contains(it.key())) continue;
+        AbstractEntry *local = entryWithId(it.key());
+        if (!local) continue;
+
+        if (local->contentHash() == it.value()) removed.insert(it.key());
+        else result.kept++;
+    }
+    for (int row = entryList->count() - 1; !removed.isEmpty() && row >= 0;
+         row--) {
+        if (removed.remove(entryList->item(row)->data(Qt::UserRole)
+                           .toULongLong())) {
+            deleteEntry(row);
+            result.removed++;
+        }
+    }
+    entryList->setUpdatesEnabled(true);
+
+    syncedHashes = diskHashes;
+    return result;
+}
+
+// Put the times of a new entry into the fields
+void PlannerWidget::setFieldTimes(const QDateTime &start, const QDateTime &end)
+{
+    entryList->setCurrentRow(-1);
+    startingDateTime->setDateTime(start);
+    endingDateTime->setDateTime(end);
+}
+
+/* Remind of each entry ReminderLead before it starts. Turning reminders on
+   schedules every entry once; after that, entries are scheduled one at a
+   time as they're added, changed or reminded of. */
+void PlannerWidget::setRemindersEnabled(bool enabled)
+{
+    if (enabled == remindersEnabled) return;
+    remindersEnabled = enabled;
+
+    reminders->clear();
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    for (uint i = 0; enabled && i < entryVector.size(); i++)
+        scheduleReminder(entryVector[i], now);
+}
+
+/* Keep what depends on an entry's times up to date after it's added or
+   changed, the filter included */
+void PlannerWidget::timesChanged(const AbstractEntry *entry)
+{
+    timeColumns.set(slotById.value(entry->id()), entry);
+    if (!timeIndexStale) timeIndex.set(entry);
+    scheduleReminder(entry, QDateTime::currentMSecsSinceEpoch());
+    if (!filterTimer->isActive() && filtering()) filterTimer->start();
+}
+
+// Schedule the reminder for entry's first occurrence starting after "after"
+void PlannerWidget::scheduleReminder(const AbstractEntry *entry, qint64 after)
+{
+    if (!remindersEnabled) return;
+
+    qint64 start;
+    if (entry->nextStartAfter(after, start))
+        reminders->schedule(entry->id(), start - ReminderLead);
+    else reminders->cancel(entry->id());
+}
+
+bool PlannerWidget::filtering() const
+{
+    return !filterField->text().trimmed().isEmpty() || betweenBox->isChecked();
+}
+
+/* The slots of the entries the filter lets through: those with every tag
+   listed, none of those listed after a "-", and, if Between is checked, an
+   occurrence between its dates. Tags and single entries' times are looked
+   up as bitmaps of slots, so this costs a few word operations per 64
+   entries; only recurring entries still in the running are checked one by
+   one. */
+RoaringBitmap PlannerWidget::filterMatches() const
+{
+    RoaringBitmap matches = RoaringBitmap::range(quint32(entryVector.size()));
+    QStringList terms = filterField->text().split(',',
+                                                  QString::SkipEmptyParts);
+    for (int i = 0; i < terms.size(); i++) {
+        QString tag = terms[i].trimmed();
+        if (tag.startsWith('-')) {
+            tag = tag.mid(1).trimmed();
+            if (!tag.isEmpty())
+                matches = matches.andNot(tagIndex.entriesTagged(tag));
+        }
+        else if (!tag.isEmpty())
+            matches = matches & tagIndex.entriesTagged(tag);
+    }
+    if (!betweenBox->isChecked() || matches.isEmpty()) return matches;
+
+    qint64 from = QDateTime(filterFromDate->date()).toMSecsSinceEpoch();
+    qint64 to = QDateTime(filterToDate->date().addDays(1))
+                .toMSecsSinceEpoch() - 1;
+    std::vector<quint64> mask;
+    timeColumns.overlapMask(from, to, mask);
+    RoaringBitmap between = RoaringBitmap::fromMask(
+                mask.empty() ? NULL : &mask[0], timeColumns.size());
+
+    PlannerEntry range(QString(), from, to, QString(), 0);
+    const QSet<int> &recurring = timeColumns.recurringSlots();
+    QSet<int>::const_iterator it;
+    for (it = recurring.constBegin(); it != recurring.constEnd(); it++) {
+        if (matches.contains(*it) && entryVector[*it]->conflictsWith(&range))
+            between.add(*it);
+    }
+    return matches & between;
+}
+
+// How busy the plan is, from its time columns
+PlanStatistics PlannerWidget::statistics() const
+{
+    TRACE_SCOPE("statistics");
+    TRACE_COUNT(entryVector.size());
+    return PlanStatistics::compute(timeColumns, entryVector);
+}
+
+/* Estimated memory taken by the plan: its entries, their strings, the
+   list items showing them, and every index kept over them */
+MemoryUsage PlannerWidget::memoryUsage() const
+{
+    /* A list item has a private part holding a vector of its values (text
+       and entry ID), and a pointer in the list's model */
+    qint64 itemBytes = MemoryUsage::block(sizeof(QListWidgetItem))
+                       + MemoryUsage::block(3 * sizeof(void*))
+                       + MemoryUsage::block(16 + 2 * (sizeof(int)
+                                                      + sizeof(QVariant)))
+                       + sizeof(void*);
+
+    MemoryUsage usage;
+    usage.addEntries(entryVector);
+    usage.add(tr("Entry vector"), entryVector.size(),
+              MemoryUsage::vectorBytes(entryVector));
+    usage.add(tr("ID index"), slotById.size(),
+              MemoryUsage::hashBytes(slotById));
+    usage.add(tr("List items"), entryList->count(),
+              entryList->count() * itemBytes);
+    usage.add(tr("List item index"), itemById.size(),
+              MemoryUsage::hashBytes(itemById));
+    usage.add(tr("Name index"), nameIndex.size(),
+              MemoryUsage::hashBytes(nameIndex));
+    usage.add(tr("String pool"), stringPool.size(), stringPool.memoryUsed());
+    usage.add(tr("Saved state hashes"), syncedHashes.size(),
+              MemoryUsage::hashBytes(syncedHashes));
+    usage.add(tr("Time columns"), entryVector.size(),
+              timeColumns.memoryUsed());
+    usage.add(tr("Tag index"), tagIndex.size(), tagIndex.memoryUsed());
+    usage.add(tr("Filter"), hiddenSlots.cardinality(),
+              hiddenSlots.memoryUsed());
+    usage.add(tr("Free time index"), timeIndexStale ? 0 : entryVector.size(),
+              timeIndex.memoryUsed());
+    usage.add(tr("Reminders"), reminders->count(), reminders->memoryUsed());
+    return usage;
+}
+
+void PlannerWidget::markModified()
+{
+    changes++;
+
+    // Edits that were written through leave nothing to save
+    if (!writesThrough()) setWindowModified(true);
+}
+
+/* Override the ESC button's ability to close this widget, and keep Enter
+   in the finder (which steps through fuzzy matches) from pressing a
+   button */
 void PlannerWidget::keyPressEvent(QKeyEvent *e){
+    bool enter = e->key() == Qt::Key_Return || e->key() == Qt::Key_Enter;
+    if (enter && finder->hasFocus()) return;
     if(e->key()!=Qt::Key_Escape) QDialog::keyPressEvent(e);
 }
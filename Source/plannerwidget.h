@@ -2,8 +2,22 @@
 #define PLANNERWIDGET_H
 
 #include <QtGui/QDialog>
+#include <QHash>
 #include "plannerentry.h"
+#include "stringpool.h"
+#include "timeindex.h"
+#include "timecolumns.h"
+#include "tagindex.h"
 
+class StorageBackend;
+class EntryArchive;
+class MemoryUsage;
+class PlanStatistics;
+class ReminderScheduler;
+
+class QCheckBox;
+class QComboBox;
+class QDateEdit;
 class QListWidget;
 class QPushButton;
 class QLabel;
@@ -13,25 +27,61 @@ class QDateTimeEdit;
 class QPlainTextEdit;
 class QDateTimeEdit;
 class QListWidgetItem;
+class QSpinBox;
+class QTimer;
 
 class PlannerWidget : public QDialog
 {
     Q_OBJECT
     
 public:
+    // What mergeFromDisk() did
+    struct MergeResult {
+        int added;
+        int changed;
+        int removed;
+        int kept;       // entries changed on both sides; ours were kept
+    };
+
     PlannerWidget(QWidget *parent = 0);
     ~PlannerWidget();
 
     void addEntry(AbstractEntry *entry);
+    void            addEntries(const std::vector<AbstractEntry*> &entries);
     void            clearList();
     void            clearOldEntries(QDateTime dt);
+    bool            confirmClearOld();
     void            clearVector();
     AbstractEntry  *currentEntry();
     void            deleteEntry(int row);
-    AbstractEntry  *DT_conflict_in_list();
+    AbstractEntry  *DT_conflict_in_list(const AbstractEntry *candidate,
+                                        Occurrence *when);
+    QList<Occurrence> freeSlots(const QDateTime &from, const QDateTime &to,
+                                qint64 duration, int maxSlots);
     bool            invalidName(QString name);
     AbstractEntry  *itemEntry(QListWidgetItem* lwi);
-    std::vector<AbstractEntry*> vector();
+    int             loadEntries(const std::vector<AbstractEntry*> &entries,
+                                bool clearOld, qint64 clearBefore);
+    bool            loadMore(int count);
+    AbstractEntry  *entryNamed(const QString &name) const;
+    AbstractEntry  *entryWithId(quint64 id) const;
+    void            setBackend(StorageBackend *newBackend);
+    void            setArchive(EntryArchive *newArchive);
+    const std::vector<AbstractEntry*> &vector() const;
+    std::vector<AbstractEntry*> listOrder() const;
+    std::vector<AbstractEntry*> snapshot();
+    void            releaseSnapshot();
+    quint64         changeCount() const;
+    void            markSynced();
+    MergeResult     mergeFromDisk(const std::vector<AbstractEntry*> &disk);
+    void            setRemindersEnabled(bool enabled);
+    MemoryUsage     memoryUsage() const;
+    PlanStatistics  statistics() const;
+    void            setFieldTimes(const QDateTime &start,
+                                  const QDateTime &end);
+
+signals:
+    void reminder(const QString &name, const QDateTime &start);
 
 protected:
     virtual void keyPressEvent(QKeyEvent *e);
@@ -41,6 +91,7 @@ public slots:
     void clearFields();
     void deleteEntry();
     void enableButtons();
+    void enableRepeatOptions();
     void find();
     void refresh();
     void replaceEntry();
@@ -49,19 +100,98 @@ public slots:
     void sortByName();
     void synchDT();
 
+private slots:
+    void remind(quint64 id, qint64 msecs);
+    void loadMoreNotes();
+    void nextMatch();
+    void applyFilter();
+
 private:
-    std::vector<AbstractEntry*> entryVector;
+    AbstractEntry  *entryFromFields(QString name, QDateTime whenAdded);
+    void            fuzzyFind(const QString &text);
+    void            showNotes(const QString &notes);
+    int             notesChunkEnd(int from) const;
+    QString         fieldNotes() const;
+    void            internStrings(AbstractEntry *entry);
+    void            releaseStrings(const AbstractEntry *entry);
+    void            makeNameUnique(AbstractEntry *entry) const;
+    void            markModified();
+    bool            nameTaken(const QString &name) const;
+    quint64         newId() const;
+    void            removeFromVector(AbstractEntry *entry);
+    void            retire(AbstractEntry *entry);
+    AbstractEntry  *writable(AbstractEntry *e);
+    void            timesChanged(const AbstractEntry *entry);
+    bool            filtering() const;
+    RoaringBitmap   filterMatches() const;
+    void            rehideFiltered();
+    QSet<quint64>   idsEndedBy(qint64 msecs) const;
+    void            scheduleReminder(const AbstractEntry *entry, qint64 after);
+    bool            archiveEntries(const std::vector<AbstractEntry*> &old);
+    bool            writesThrough() const;
+    void            storageError();
+    void            replaceItemEntry(QListWidgetItem *lwi,
+                                     AbstractEntry *newEntry);
+
+    std::vector<AbstractEntry*> entryVector;    // in no particular order
+    QHash<quint64, int> slotById;   // each entry's index in entryVector
+    QHash<quint64, QListWidgetItem*> itemById;
+    StringPool stringPool;  // Every entry's name and notes are interned
+    QHash<const QChar*, AbstractEntry*> nameIndex; // by name's constData()
+    StorageBackend *backend;    // the document's storage, if any (not owned)
+    EntryArchive *archive;      // where old entries go, if kept (not owned)
+    QHash<quint64, quint64> syncedHashes;   // by ID, as last loaded/saved
+    int snapshotsOut;       // handed out by snapshot(), not yet released
+    std::vector<AbstractEntry*> retired;    // kept for those snapshots
+    std::vector<AbstractEntry*> pending;    // loaded, not yet listed
+    uint pendingNext;                       // the first of them not listed
+    quint64 changes;        // Number of modifications ever made
+    TimeColumns timeColumns;    // single entries' times, by slot
+    TagIndex tagIndex;          // entries' tags, by slot
+    RoaringBitmap hiddenSlots;  // entries the filter hides from the list
+    TimeIndex timeIndex;    // for freeSlots(), built when it's first used
+    bool timeIndexStale;    // not built yet; once it is, kept up to date
+
+    enum { ReminderLead = 5 * 60 * 1000 };
+    enum { FreeSlotSearchDays = 30 };
+    ReminderScheduler *reminders;
+    bool remindersEnabled;
+
+    QTimer *refreshTimer;   // coalesces selection changes into one refresh
+    QTimer *notesTimer;     // loads long notes a chunk at a time
+    QTimer *filterTimer;    // coalesces filter and entry changes
+    enum { NotesChunk = 64 * 1024 };
+    QString shownNotes;     // what the notes field was last loaded with
+    int notesLoaded;        // how much of shownNotes is in the field so far
+
     QListWidget *entryList;
     QLineEdit *finder;
+    QCheckBox *fuzzyBox;
+    QLabel *matchCountLabel;
+    std::vector<quint64> fuzzyMatches;  // IDs, best match first
+    int fuzzyMatch;                     // the one selected
+
+    QLineEdit *filterField;
+    QCheckBox *betweenBox;
+    QDateEdit *filterFromDate;
+    QDateEdit *filterToDate;
+    QLabel *shownCountLabel;
 
     QPushButton *clearButton;
     QPushButton *refreshButton;
 
     QLineEdit *nameField;
+    QLineEdit *tagsField;
     QDateTimeEdit *startingDateTime;
     QDateTimeEdit *endingDateTime;
     QPlainTextEdit *notesField;
 
+    QComboBox *repeatBox;
+    QSpinBox *repeatIntervalBox;
+    QComboBox *repeatEndBox;
+    QDateEdit *repeatUntilDate;
+    QSpinBox *repeatCountBox;
+
     QLabel *whenAddedDisplay;
 
     QPushButton *addButton;
@@ -0,0 +1,396 @@
+#include <QDateTime>
+#include <QStringList>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+#include <algorithm>
+
+#include "planstatistics.h"
+#include "recurringentry.h"
+#include "timecolumns.h"
+
+static const qint64 MSecsPerHour = 60 * 60 * 1000;
+static const qint64 MSecsPerDay = 24 * MSecsPerHour;
+static const qint64 Forever = Q_INT64_C(0x7FFFFFFFFFFFFFFF);
+
+// Rows of start and end columns; a row that starts after it ends is skipped
+struct RowSpan
+{
+    const qint64 *starts;
+    const qint64 *ends;
+    int count;
+};
+
+// What one chunk of rows adds up to
+struct ChunkTotals
+{
+    int intervals;
+    qint64 booked;
+    qint64 shortest;
+    qint64 longest;
+    std::vector<qint64> partDays;   // msecs booked on days not fully booked
+    std::vector<int> fullDays;      // +1 where a run of full days starts,
+                                    // -1 after it ends
+};
+
+/* Sums a chunk of rows into day buckets, on one of QtConcurrent's threads.
+   An interval adds its share of its first and last days; the days between
+   are only marked, since they're booked whole. Only the part of it within
+   the histogram's days is bucketed. */
+struct ChunkSummer
+{
+    typedef ChunkTotals result_type;
+
+    explicit ChunkSummer(const std::vector<qint64> *midnights)
+        : midnights(midnights) {}
+
+    // The day t falls on: a guess from its distance, corrected for DST
+    int dayOf(qint64 t) const
+    {
+        const std::vector<qint64> &m = *midnights;
+        int days = int(m.size()) - 1;
+        int d = int(qBound(qint64(0), (t - m[0]) / MSecsPerDay,
+                           qint64(days - 1)));
+        while (d > 0 && t < m[d]) d--;
+        while (d < days - 1 && t >= m[d + 1]) d++;
+        return d;
+    }
+
+    ChunkTotals operator()(const RowSpan &span) const
+    {
+        ChunkTotals totals;
+        totals.intervals = 0;
+        totals.booked = 0;
+        totals.shortest = Forever;
+        totals.longest = 0;
+        totals.partDays.assign(midnights->size() - 1, 0);
+        totals.fullDays.assign(midnights->size(), 0);
+
+        for (int i = 0; i < span.count; i++) {
+            qint64 start = span.starts[i], end = span.ends[i];
+            if (start > end) continue;
+
+            qint64 length = end - start;
+            totals.intervals++;
+            totals.booked += length;
+            totals.shortest = qMin(totals.shortest, length);
+            totals.longest = qMax(totals.longest, length);
+
+            const std::vector<qint64> &m = *midnights;
+            if (end < m.front() || start >= m.back()) continue;
+            start = qMax(start, m.front());
+            end = qMin(end, m.back());
+            length = end - start;
+
+            int first = dayOf(start), last = dayOf(end);
+            if (first == last) totals.partDays[first] += length;
+            else {
+                totals.partDays[first] += (*midnights)[first + 1] - start;
+                totals.partDays[last] += end - (*midnights)[last];
+                totals.fullDays[first + 1]++;
+                totals.fullDays[last]--;
+            }
+        }
+        return totals;
+    }
+
+    const std::vector<qint64> *midnights;
+};
+
+/* LSD radix sort on 11 bits at a time of each value's distance from the
+   smallest, skipping the passes above the highest bit in use, so a
+   million times spanning years take four passes. */
+static void radixSort(std::vector<qint64> *values)
+{
+    if (values->size() < 2) return;
+
+    enum { Bits = 11, Buckets = 1 << Bits };
+    qint64 low = *std::min_element(values->begin(), values->end());
+    qint64 high = *std::max_element(values->begin(), values->end());
+    quint64 range = quint64(high - low);
+    std::vector<qint64> sorted(values->size());
+
+    for (int shift = 0; shift < 64 && (range >> shift) != 0; shift += Bits) {
+        int offsets[Buckets + 1] = { 0 };
+        for (uint i = 0; i < values->size(); i++)
+            offsets[((quint64((*values)[i] - low) >> shift) & (Buckets - 1))
+                    + 1]++;
+        for (int b = 0; b < Buckets; b++) offsets[b + 1] += offsets[b];
+        for (uint i = 0; i < values->size(); i++) {
+            qint64 v = (*values)[i];
+            sorted[offsets[(quint64(v - low) >> shift) & (Buckets - 1)]++] = v;
+        }
+        values->swap(sorted);
+    }
+}
+
+PlanStatistics::PlanStatistics()
+    : entries(0), intervals(0), bookedMSecs(0), shortestMSecs(0),
+      longestMSecs(0), peakOverlap(0), peakStart(0), spanDays(0) {}
+
+/* The statistics of the entries in columns, whose slots index entries
+   (only recurring entries are looked at one by one) */
+PlanStatistics PlanStatistics::compute(
+        const TimeColumns &columns, const std::vector<AbstractEntry*> &entries)
+{
+    PlanStatistics stats;
+    stats.entries = int(entries.size());
+    const std::vector<qint64> &starts = columns.startColumn();
+    const std::vector<qint64> &ends = columns.endColumn();
+
+    // The plan's span, taking rules that never end as far as it goes
+    qint64 from = Forever, to = -Forever;
+    for (uint i = 0; i < starts.size(); i++) {
+        if (starts[i] > ends[i]) continue;
+        from = qMin(from, starts[i]);
+        to = qMax(to, ends[i]);
+    }
+
+    const QSet<int> &recurring = columns.recurringSlots();
+    bool unending = false;
+    QSet<int>::const_iterator it;
+    for (it = recurring.constBegin(); it != recurring.constEnd(); it++) {
+        const RecurringEntry *r =
+                static_cast<const RecurringEntry*>(entries[*it]);
+        qint64 lastEnd = r->lastEndMSecs();
+        if (lastEnd < r->startMSecs()) continue;   // no occurrences
+        from = qMin(from, r->startMSecs());
+        if (lastEnd == Forever) unending = true;
+        else to = qMax(to, lastEnd);
+    }
+    if (from == Forever) return stats;
+    if (unending)
+        to = qMax(to, QDateTime::fromMSecsSinceEpoch(from).addYears(1)
+                      .toMSecsSinceEpoch());
+
+    // Recurring entries' occurrences become rows of their own
+    std::vector<qint64> occurrenceStarts, occurrenceEnds;
+    QDateTime fromDT = QDateTime::fromMSecsSinceEpoch(from);
+    QDateTime toDT = QDateTime::fromMSecsSinceEpoch(to);
+    for (it = recurring.constBegin(); it != recurring.constEnd(); it++) {
+        QList<Occurrence> list = entries[*it]->occurrences(fromDT, toDT);
+        for (int i = 0; i < list.size(); i++) {
+            occurrenceStarts.push_back(
+                        qMax(from, list[i].first.toMSecsSinceEpoch()));
+            occurrenceEnds.push_back(
+                        qMin(to, list[i].second.toMSecsSinceEpoch()));
+        }
+    }
+
+    QList<RowSpan> spans;
+    for (uint i = 0; i < starts.size(); i += ChunkSize) {
+        RowSpan span = { &starts[i], &ends[i],
+                         qMin(int(ChunkSize), int(starts.size() - i)) };
+        spans.append(span);
+    }
+    if (!occurrenceStarts.empty()) {
+        RowSpan span = { &occurrenceStarts[0], &occurrenceEnds[0],
+                         int(occurrenceStarts.size()) };
+        spans.append(span);
+    }
+
+    /* The sweep's copy of every start and end, the two sorted side by side
+       when there are many */
+    std::vector<qint64> sortedStarts, sortedEnds;
+    sortedStarts.reserve(starts.size() + occurrenceStarts.size());
+    sortedEnds.reserve(sortedStarts.capacity());
+    for (uint i = 0; i < starts.size(); i++) {
+        if (starts[i] > ends[i]) continue;
+        sortedStarts.push_back(starts[i]);
+        sortedEnds.push_back(ends[i]);
+    }
+    sortedStarts.insert(sortedStarts.end(), occurrenceStarts.begin(),
+                        occurrenceStarts.end());
+    sortedEnds.insert(sortedEnds.end(), occurrenceEnds.begin(),
+                      occurrenceEnds.end());
+
+    bool parallel = sortedStarts.size() >= uint(ParallelThreshold);
+    if (parallel) {
+        QFuture<void> sortingEnds = QtConcurrent::run(radixSort, &sortedEnds);
+        radixSort(&sortedStarts);
+        sortingEnds.waitForFinished();
+    }
+    else {
+        radixSort(&sortedStarts);
+        radixSort(&sortedEnds);
+    }
+
+    /* The days the histogram covers: the whole span, unless that's more
+       than MaxHistogramDays, when it's that many around the middle start.
+       One entry far in the future (or past) would otherwise cost a bucket
+       per chunk and a local time conversion for every day in between. */
+    QDate lastDay = toDT.date();
+    stats.spanDays = fromDT.date().daysTo(lastDay) + 1;
+    stats.firstDay = fromDT.date();
+    int days = stats.spanDays;
+    if (days > MaxHistogramDays) {
+        days = MaxHistogramDays;
+        QDate middle = sortedStarts.empty()
+                ? stats.firstDay
+                : QDateTime::fromMSecsSinceEpoch(
+                      sortedStarts[sortedStarts.size() / 2]).date();
+        QDate first = middle.addDays(-days / 2);
+        if (first.daysTo(lastDay) < days - 1)
+            first = lastDay.addDays(1 - days);
+        if (first > stats.firstDay) stats.firstDay = first;
+    }
+
+    // Local midnights, from the first day's to the one after the last day
+    std::vector<qint64> midnights(days + 1);
+    for (int d = 0; d <= days; d++)
+        midnights[d] = QDateTime(stats.firstDay.addDays(d))
+                       .toMSecsSinceEpoch();
+
+    ChunkSummer sum(&midnights);
+    QList<ChunkTotals> totals;
+    if (parallel)
+        totals = QtConcurrent::blockingMapped<QList<ChunkTotals> >(spans, sum);
+    else
+        for (int i = 0; i < spans.size(); i++) totals.append(sum(spans[i]));
+
+    // Join the chunks' sums, running through the full day marks
+    std::vector<qint64> partDays(days, 0);
+    std::vector<int> fullDays(days + 1, 0);
+    stats.shortestMSecs = Forever;
+    for (int c = 0; c < totals.size(); c++) {
+        const ChunkTotals &t = totals[c];
+        stats.intervals += t.intervals;
+        stats.bookedMSecs += t.booked;
+        stats.shortestMSecs = qMin(stats.shortestMSecs, t.shortest);
+        stats.longestMSecs = qMax(stats.longestMSecs, t.longest);
+        for (int d = 0; d < days; d++) {
+            partDays[d] += t.partDays[d];
+            fullDays[d] += t.fullDays[d];
+        }
+    }
+    if (stats.intervals == 0) stats.shortestMSecs = 0;
+    stats.dayMSecs.resize(days);
+    int wholeDays = 0;
+    for (int d = 0; d < days; d++) {
+        wholeDays += fullDays[d];
+        stats.dayMSecs[d] = partDays[d]
+                            + wholeDays * (midnights[d + 1] - midnights[d]);
+    }
+
+    /* Sweep the starts in order: just after the starts at one instant,
+       every interval started so far is on unless it ended before then.
+       Ends are included in intervals, as they are in conflict checks. */
+    int n = int(sortedStarts.size());
+    for (int i = 0, ended = 0; i < n; i++) {
+        if (i + 1 < n && sortedStarts[i + 1] == sortedStarts[i]) continue;
+        while (ended < n && sortedEnds[ended] < sortedStarts[i]) ended++;
+        if (i + 1 - ended > stats.peakOverlap) {
+            stats.peakOverlap = i + 1 - ended;
+            stats.peakStart = sortedStarts[i];
+        }
+    }
+    return stats;
+}
+
+qint64 PlanStatistics::averageMSecs() const
+{
+    return intervals ? bookedMSecs / intervals : 0;
+}
+
+
+
+
+/******************************************************************************
+    REPORTS
+******************************************************************************/
+
+static QString hours(qint64 msecs)
+{
+    return PlanStatistics::tr("%1 h").arg(double(msecs) / MSecsPerHour, 0,
+                                          'f', 1);
+}
+
+// A row of a text histogram: label, hours and a bar scaled to the largest
+static QString bar(const QString &label, qint64 msecs, qint64 largest)
+{
+    int width = largest ? int(40 * msecs / largest) : 0;
+    return QString("%1 %2 %3\n").arg(label, -10).arg(hours(msecs), 9)
+           .arg(QString(width, '#'));
+}
+
+/* The summary, then the hours booked each week (starting on Mondays) and
+   on each day that has any */
+QString PlanStatistics::report() const
+{
+    QString text;
+    QStringList names, values;
+    names << tr("Entries") << tr("Intervals") << tr("Hours booked")
+          << tr("Average length") << tr("Shortest") << tr("Longest")
+          << tr("Peak overlap");
+    values << QString::number(entries) << QString::number(intervals)
+           << hours(bookedMSecs) << hours(averageMSecs())
+           << hours(shortestMSecs) << hours(longestMSecs)
+           << QString::number(peakOverlap);
+    if (peakOverlap > 0)
+        values.last() += tr(" (at %1)").arg(QDateTime::fromMSecsSinceEpoch(
+                                            peakStart).toString(Qt::ISODate));
+    for (int i = 0; i < names.size(); i++)
+        text += QString("%1 %2\n").arg(names[i], -24).arg(values[i]);
+    if (dayMSecs.isEmpty()) return text;
+
+    QList<QDate> weeks;
+    QList<qint64> weekMSecs;
+    qint64 busiestWeek = 0, busiestDay = 0;
+    for (int d = 0; d < dayMSecs.size(); d++) {
+        QDate day = firstDay.addDays(d);
+        QDate monday = day.addDays(1 - day.dayOfWeek());
+        if (weeks.isEmpty() || weeks.last() != monday) {
+            weeks.append(monday);
+            weekMSecs.append(0);
+        }
+        weekMSecs.last() += dayMSecs[d];
+        busiestWeek = qMax(busiestWeek, weekMSecs.last());
+        busiestDay = qMax(busiestDay, dayMSecs[d]);
+    }
+
+    if (dayMSecs.size() < spanDays)
+        text += tr("\nFrom %1 to %2 only\n")
+                .arg(firstDay.toString(Qt::ISODate))
+                .arg(firstDay.addDays(dayMSecs.size() - 1)
+                     .toString(Qt::ISODate));
+    text += tr("\nHours per week\n");
+    for (int w = 0; w < weeks.size(); w++)
+        text += bar(weeks[w].toString(Qt::ISODate), weekMSecs[w], busiestWeek);
+
+    text += tr("\nHours per day\n");
+    for (int d = 0; d < dayMSecs.size(); d++) {
+        if (dayMSecs[d] > 0)
+            text += bar(firstDay.addDays(d).toString(Qt::ISODate), dayMSecs[d],
+                        busiestDay);
+    }
+    return text;
+}
+
+// The summary alone, as a table
+QString PlanStatistics::reportHtml() const
+{
+    int busiest = 0;
+    for (int d = 1; d < dayMSecs.size(); d++)
+        if (dayMSecs[d] > dayMSecs[busiest]) busiest = d;
+    qint64 perDay = spanDays ? bookedMSecs / spanDays : 0;
+
+    QString row("<tr><td>%1</td><td align=\"right\">%2</td></tr>");
+    QString html = "<table cellspacing=\"4\">";
+    html += row.arg(tr("Entries")).arg(entries);
+    html += row.arg(tr("Intervals (with each occurrence)")).arg(intervals);
+    html += row.arg(tr("Hours booked")).arg(hours(bookedMSecs));
+    html += row.arg(tr("Average per day")).arg(hours(perDay));
+    html += row.arg(tr("Average length")).arg(hours(averageMSecs()));
+    html += row.arg(tr("Shortest / longest"))
+            .arg(hours(shortestMSecs) + " / " + hours(longestMSecs));
+    if (!dayMSecs.isEmpty())
+        html += row.arg(tr("Busiest day"))
+                .arg(tr("%1 (%2)").arg(firstDay.addDays(busiest)
+                                       .toString(Qt::DefaultLocaleShortDate))
+                     .arg(hours(dayMSecs[busiest])));
+    html += row.arg(tr("Most at once")).arg(peakOverlap);
+    if (peakOverlap > 0)
+        html += row.arg(tr("First at")).arg(QDateTime::fromMSecsSinceEpoch(
+                    peakStart).toString(Qt::DefaultLocaleShortDate));
+    html += "</table>";
+    return html;
+}
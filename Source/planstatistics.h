@@ -0,0 +1,53 @@
+#ifndef PLANSTATISTICS_H
+#define PLANSTATISTICS_H
+
+#include <QCoreApplication>
+#include <QDate>
+#include <QVector>
+#include <vector>
+
+class AbstractEntry;
+class TimeColumns;
+
+/* How busy a plan is: the hours booked on each day (and so each week), how
+   long entries last, and the most entries going on at once. Computed in one
+   pass over the time columns, in chunks summed in parallel, plus a sort of
+   every start and end for the sweep that finds the peak.
+
+   Recurring entries count once per occurrence within the plan's span: from
+   its first start to its last end, and for at least a year if a rule never
+   ends. The day histogram covers at most MaxHistogramDays of that span,
+   around its middle start if the span is longer. */
+class PlanStatistics
+{
+    Q_DECLARE_TR_FUNCTIONS(PlanStatistics)
+
+public:
+    PlanStatistics();
+
+    static PlanStatistics compute(const TimeColumns &columns,
+                                  const std::vector<AbstractEntry*> &entries);
+
+    qint64  averageMSecs() const;
+    QString report() const;
+    QString reportHtml() const;
+
+    int     entries;
+    int     intervals;      // single entries plus recurring occurrences
+    qint64  bookedMSecs;    // all intervals' lengths, overlaps included
+    qint64  shortestMSecs;
+    qint64  longestMSecs;
+    int     peakOverlap;    // most intervals that share an instant
+    qint64  peakStart;      // when peakOverlap is first reached
+    int     spanDays;       // from the plan's first day to its last
+    QDate   firstDay;
+    QVector<qint64> dayMSecs;   // booked on each day from firstDay on
+
+    enum { MaxHistogramDays = 3 * 366 };
+
+private:
+    enum { ChunkSize = 64 * 1024 };         // rows summed by one thread
+    enum { ParallelThreshold = 128 * 1024 };
+};
+
+#endif // PLANSTATISTICS_H
@@ -1,5 +1,6 @@
 #include <QLayout>
 #include <QCheckBox>
+#include <QComboBox>
 #include <QLineEdit>
 #include <QGroupBox>
 #include <QStackedLayout>
@@ -11,6 +12,25 @@
 
 #include "prefsdialog.h"
 
+/* Each checkbox's setting is saved under its text, so the texts double as
+   keys. Just make sure none of the checkboxes have the same text. */
+static const char *AutoLoadText =
+        QT_TRANSLATE_NOOP("PrefsDialog", "Automatically load a file on run");
+static const char *AutoClearOldText =
+        QT_TRANSLATE_NOOP("PrefsDialog",
+                          "Automatically prompt to clear its old entries");
+static const char *CompressFilesText =
+        QT_TRANSLATE_NOOP("PrefsDialog", "Compress saved files");
+static const char *ArchiveOldText =
+        QT_TRANSLATE_NOOP("PrefsDialog",
+                          "Archive past events instead of deleting them");
+static const char *AutoSaveText =
+        QT_TRANSLATE_NOOP("PrefsDialog",
+                          "Save a recovery copy every two minutes");
+static const char *RemindersText =
+        QT_TRANSLATE_NOOP("PrefsDialog",
+                          "Remind me five minutes before entries start");
+
 PrefsDialog::PrefsDialog(QWidget *parent) :
     QDialog(parent)
 {
@@ -55,8 +75,8 @@ void PrefsDialog::createGeneralPage()
     /* Start-up group box */
     startupGroupBox = new QGroupBox(tr("Start-up options"));
 
-    autoLoad_chkBx = new QCheckBox(tr("Automatically load a file on run"));
-    autoClearOld_chkBx = new QCheckBox(tr("Automatically prompt to clear its old entries"));
+    autoLoad_chkBx = new QCheckBox(tr(AutoLoadText));
+    autoClearOld_chkBx = new QCheckBox(tr(AutoClearOldText));
 
     chkBxVector.push_back(autoLoad_chkBx);
     chkBxVector.push_back(autoClearOld_chkBx);
@@ -72,6 +92,41 @@ void PrefsDialog::createGeneralPage()
 
     startupGroupBox->setLayout(startupGroupBoxLayout);
     pageLayout->addWidget(startupGroupBox);
+
+    /* Saving group box */
+    savingGroupBox = new QGroupBox(tr("Saving"));
+    compressFiles_chkBx = new QCheckBox(tr(CompressFilesText));
+    autoSave_chkBx = new QCheckBox(tr(AutoSaveText));
+    archiveOld_chkBx = new QCheckBox(tr(ArchiveOldText));
+    chkBxVector.push_back(compressFiles_chkBx);
+    chkBxVector.push_back(autoSave_chkBx);
+    chkBxVector.push_back(archiveOld_chkBx);
+
+    /* Item order follows AtomicFile::Durability */
+    QLabel *durabilityLabel = new QLabel(tr("Before replacing the old file, sync:"));
+    durabilityBox = new QComboBox;
+    durabilityBox->addItem(tr("Nothing (fastest)"));
+    durabilityBox->addItem(tr("The new file"));
+    durabilityBox->addItem(tr("The new file and its folder (safest)"));
+
+    QVBoxLayout *savingGroupBoxLayout = new QVBoxLayout;
+    savingGroupBoxLayout->addWidget(compressFiles_chkBx);
+    savingGroupBoxLayout->addWidget(autoSave_chkBx);
+    savingGroupBoxLayout->addWidget(archiveOld_chkBx);
+    savingGroupBoxLayout->addWidget(durabilityLabel);
+    savingGroupBoxLayout->addWidget(durabilityBox);
+    savingGroupBox->setLayout(savingGroupBoxLayout);
+    pageLayout->addWidget(savingGroupBox);
+
+    /* Reminders group box */
+    remindersGroupBox = new QGroupBox(tr("Reminders"));
+    reminders_chkBx = new QCheckBox(tr(RemindersText));
+    chkBxVector.push_back(reminders_chkBx);
+
+    QVBoxLayout *remindersGroupBoxLayout = new QVBoxLayout;
+    remindersGroupBoxLayout->addWidget(reminders_chkBx);
+    remindersGroupBox->setLayout(remindersGroupBoxLayout);
+    pageLayout->addWidget(remindersGroupBox);
     generalPage->setLayout(pageLayout);
 
     QSettings settings("MSF091886", appName);
@@ -86,6 +141,7 @@ void PrefsDialog::createGeneralPage()
     /* Load other settings */
     QString fileName = settings.value("autoFileName").toString();
     autoFileName->setText(fileName);
+    durabilityBox->setCurrentIndex(durability());
 
     /* Gray out fields under autoLoad_chkBx if it's not checked */
     connect(autoLoad_chkBx, SIGNAL(clicked()), this,
@@ -99,21 +155,39 @@ void PrefsDialog::enableStartUpOptions()
     autoFileName->setEnabled(b);
 }
 
-bool PrefsDialog::isChecked(QCheckBox *chkbx)
+bool PrefsDialog::isChecked(const char *chkbxText)
 {
-    QSettings settings("MSF091886", appName);
-    return settings.value(chkbx->text(), false).toBool();
+    QSettings settings("MSF091886", tr("Planner"));
+    return settings.value(tr(chkbxText), false).toBool();
 }
 
-bool PrefsDialog::autoLoadChecked() { return isChecked(autoLoad_chkBx); }
+bool PrefsDialog::autoLoadChecked() { return isChecked(AutoLoadText); }
 
 bool PrefsDialog::autoClearOldChecked() {
-    return isChecked(autoClearOld_chkBx);
+    return isChecked(AutoClearOldText);
+}
+
+bool PrefsDialog::compressFilesChecked() {
+    return isChecked(CompressFilesText);
+}
+
+bool PrefsDialog::autoSaveChecked() { return isChecked(AutoSaveText); }
+
+bool PrefsDialog::archiveOldChecked() { return isChecked(ArchiveOldText); }
+
+bool PrefsDialog::remindersChecked() { return isChecked(RemindersText); }
+
+AtomicFile::Durability PrefsDialog::durability()
+{
+    QSettings settings("MSF091886", tr("Planner"));
+    int level = settings.value("durability", AtomicFile::SyncFile).toInt();
+    return AtomicFile::Durability(qBound(int(AtomicFile::NoSync), level,
+                                         int(AtomicFile::SyncDirectory)));
 }
 
-QString PrefsDialog::autoFileNameString() const
+QString PrefsDialog::autoFileNameString()
 {
-    QSettings settings("MSF091886", appName);
+    QSettings settings("MSF091886", tr("Planner"));
     return settings.value("autoFileName").toString();
 }
 
@@ -121,8 +195,7 @@ void PrefsDialog::saveSettings()
 {
     QSettings settings("MSF091886", appName);
 
-    /* Save checkbox settings. Just make sure none of the checkboxes have the
-    same text() value, or the settings object will get confused. */
+    /* Save checkbox settings, under their text (see AutoLoadText) */
     for (std::vector<QCheckBox*>::iterator it = chkBxVector.begin();
          it != chkBxVector.end(); it++)
     {
@@ -133,6 +206,7 @@ void PrefsDialog::saveSettings()
     QString fileName = autoFileName->text();
     if (fileName.right(fileExt.length()) != fileExt) fileName.append(fileExt);
     settings.setValue("autoFileName", fileName);
+    settings.setValue("durability", durabilityBox->currentIndex());
 
     accept();
 }
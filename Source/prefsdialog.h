@@ -2,8 +2,10 @@
 #define PREFSDIALOG_H
 
 #include <QDialog>
+#include "atomicfile.h"
 
 class QCheckBox;
+class QComboBox;
 class QGroupBox;
 class QLabel;
 class QLineEdit;
@@ -20,10 +22,17 @@ class PrefsDialog : public QDialog
 public:
     explicit PrefsDialog(QWidget *parent = 0);
     ~PrefsDialog();
-    bool isChecked(QCheckBox *chkbx);
-    bool autoLoadChecked();
-    bool autoClearOldChecked();
-    QString autoFileNameString() const;
+
+    /* The saved settings, which can be read without building the dialog */
+    static bool isChecked(const char *chkbxText);
+    static bool autoLoadChecked();
+    static bool autoClearOldChecked();
+    static bool compressFilesChecked();
+    static bool autoSaveChecked();
+    static bool archiveOldChecked();
+    static bool remindersChecked();
+    static AtomicFile::Durability durability();
+    static QString autoFileNameString();
     
 public slots:
     void saveSettings();
@@ -43,6 +52,15 @@ private:
     QCheckBox *autoLoad_chkBx;
     QCheckBox *autoClearOld_chkBx;
 
+    QGroupBox *savingGroupBox;
+    QCheckBox *compressFiles_chkBx;
+    QCheckBox *autoSave_chkBx;
+    QCheckBox *archiveOld_chkBx;
+    QComboBox *durabilityBox;
+
+    QGroupBox *remindersGroupBox;
+    QCheckBox *reminders_chkBx;
+
     std::vector<QCheckBox*> chkBxVector;
 
     QLineEdit *autoFileName;
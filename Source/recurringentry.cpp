@@ -0,0 +1,407 @@
+#include <QStringList>
+
+#include "recurringentry.h"
+
+static const qint64 MSecsPerDay = Q_INT64_C(86400000);
+static const qint64 Unbounded   = Q_INT64_C(0x7FFFFFFFFFFFFFFF);
+
+// The Gregorian calendar (weekdays and month lengths) repeats every 400 years
+static const qint64 CycleDays = 146097;
+
+/* Convert to and from milliseconds on the local wall clock, counted from the
+   start of the Julian period. */
+static qint64 toWall(const QDateTime &dt)
+{
+    return qint64(dt.date().toJulianDay()) * MSecsPerDay
+           + QTime(0, 0).msecsTo(dt.time());
+}
+
+static QDateTime fromWall(qint64 wall)
+{
+    qint64 day = wall / MSecsPerDay;
+    return QDateTime(QDate::fromJulianDay(int(day)),
+                     QTime(0, 0).addMSecs(int(wall - day * MSecsPerDay)));
+}
+
+// Integer division rounding toward negative infinity
+static qint64 floorDiv(qint64 a, qint64 b)
+{
+    qint64 q = a / b;
+    if (a % b != 0 && ((a < 0) != (b < 0))) q--;
+    return q;
+}
+
+static qint64 gcd(qint64 a, qint64 b)
+{
+    while (b != 0) {
+        qint64 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Inverse of a modulo m, for coprime a and m (extended Euclid)
+static qint64 modInverse(qint64 a, qint64 m)
+{
+    qint64 r0 = a % m, r1 = m, s0 = 1, s1 = 0;
+    while (r1 != 0) {
+        qint64 q = r0 / r1, t;
+        t = r0 - q * r1; r0 = r1; r1 = t;
+        t = s0 - q * s1; s0 = s1; s1 = t;
+    }
+    return ((s0 % m) + m) % m;
+}
+
+RecurringEntry::RecurringEntry(QString name, QDateTime startDateTime,
+                               QDateTime endDateTime, QString notes,
+                               QDateTime whenAdded, Frequency frequency,
+                               int interval, int count, QDate until)
+    : AbstractEntry(name, notes), _first(toWall(startDateTime)),
+      _duration(toWall(endDateTime) - toWall(startDateTime)),
+      _whenAddedMSecs(whenAdded.toMSecsSinceEpoch()), _frequency(frequency),
+      _interval(qMax(interval, 1)), _count(count), _until(until) {}
+
+AbstractEntry *RecurringEntry::clone() const
+{
+    return new RecurringEntry(*this);
+}
+
+QDateTime RecurringEntry::startDateTime() const { return fromWall(_first); }
+QDateTime RecurringEntry::whenAdded() const
+{
+    return QDateTime::fromMSecsSinceEpoch(_whenAddedMSecs);
+}
+qint64 RecurringEntry::whenAddedMSecs() const { return _whenAddedMSecs; }
+
+QDateTime RecurringEntry::endDateTime() const
+{
+    return fromWall(_first + _duration);
+}
+
+// The start/end setters move the first occurrence; the rule is kept
+void RecurringEntry::setStartDateTime(QDateTime newDT)
+{
+    _first = toWall(newDT);
+}
+void RecurringEntry::setEndDateTime(QDateTime newDT)
+{
+    _duration = toWall(newDT) - _first;
+}
+
+RecurringEntry::Frequency RecurringEntry::frequency() const
+{
+    return _frequency;
+}
+int   RecurringEntry::interval() const { return _interval; }
+int   RecurringEntry::count() const    { return _count; }
+QDate RecurringEntry::until() const    { return _until; }
+
+void RecurringEntry::setRule(Frequency frequency, int interval, int count,
+                             QDate until)
+{
+    _frequency = frequency;
+    _interval = qMax(interval, 1);
+    _count = count;
+    _until = until;
+}
+
+/* The rule in iCalendar RRULE syntax, e.g. "FREQ=WEEKLY;INTERVAL=2;COUNT=5".
+   UNTIL is given as the end of that day, in local time like the entry. */
+QString RecurringEntry::ruleString() const
+{
+    static const char *names[] = { "DAILY", "WEEKLY", "MONTHLY", "YEARLY" };
+
+    QString rule = QString("FREQ=%1").arg(names[_frequency]);
+    if (_interval > 1) rule += QString(";INTERVAL=%1").arg(_interval);
+    if (_count > 0) rule += QString(";COUNT=%1").arg(_count);
+    if (_until.isValid())
+        rule += ";UNTIL=" + _until.toString("yyyyMMdd") + "T235959";
+    return rule;
+}
+
+/* Read back the parts of an RRULE this class can represent. Returns false
+   if FREQ is missing or finer than daily. Parts it has no use for (BYDAY
+   and the like) are left out, and listed in ignored as "KEY=VALUE". */
+bool RecurringEntry::parseRule(const QString &rule, Frequency &frequency,
+                               int &interval, int &count, QDate &until,
+                               QStringList *ignored)
+{
+    bool haveFrequency = false;
+    interval = 1;
+    count = 0;
+    until = QDate();
+
+    QStringList parts = rule.trimmed().split(';', QString::SkipEmptyParts);
+    for (int i = 0; i < parts.size(); i++) {
+        QString key = parts[i].section('=', 0, 0).trimmed().toUpper();
+        QString value = parts[i].section('=', 1).trimmed().toUpper();
+
+        if (key == "FREQ") {
+            haveFrequency = true;
+            if (value == "DAILY") frequency = Daily;
+            else if (value == "WEEKLY") frequency = Weekly;
+            else if (value == "MONTHLY") frequency = Monthly;
+            else if (value == "YEARLY") frequency = Yearly;
+            else haveFrequency = false;
+        }
+        else if (key == "INTERVAL") interval = qMax(value.toInt(), 1);
+        else if (key == "COUNT") count = qMax(value.toInt(), 0);
+        else if (key == "UNTIL")
+            until = QDate::fromString(value.left(8), "yyyyMMdd");
+        else if (ignored) ignored->append(key + "=" + value);
+    }
+    return haveFrequency;
+}
+
+bool RecurringEntry::conflictsWith(const AbstractEntry *other,
+                                   Occurrence *when) const
+{
+    if (other->isRecurring())
+        return ruleConflict(static_cast<const RecurringEntry*>(other), when);
+
+    qint64 k = overlapIndex(toWall(other->startDateTime()),
+                            toWall(other->endDateTime()));
+    if (k < 0) return false;
+
+    if (when) *when = occurrence(k);
+    return true;
+}
+
+/* Only a rule with a count or an until date can ever be over */
+bool RecurringEntry::endedBy(qint64 msecs) const
+{
+    qint64 last = lastIndex();
+    if (last == Unbounded) return false;
+    if (last < 0) return true;
+    return occurrenceStart(last) + _duration
+           <= toWall(QDateTime::fromMSecsSinceEpoch(msecs));
+}
+
+/* Found from the rule, however far past the first occurrence msecs is. The
+   wall clock index is only a guess where DST makes wall times repeat. */
+bool RecurringEntry::nextStartAfter(qint64 msecs, qint64 &start) const
+{
+    qint64 k = indexAtOrBefore(toWall(QDateTime::fromMSecsSinceEpoch(msecs)));
+    qint64 last = lastIndex();
+    for (k = qMax(k, Q_INT64_C(-1)) + 1; k <= last; k++) {
+        start = fromWall(occurrenceStart(k)).toMSecsSinceEpoch();
+        if (start > msecs) return true;
+    }
+    return false;
+}
+
+quint64 RecurringEntry::contentHash() const
+{
+    int rule[4] = { _frequency, _interval, _count,
+                    _until.isValid() ? _until.toJulianDay() : 0 };
+    return hashBytes(AbstractEntry::contentHash(), rule, sizeof(rule));
+}
+
+/* When the last occurrence ends: the largest qint64 if the rule never ends,
+   the smallest if it has no occurrences at all. */
+qint64 RecurringEntry::lastEndMSecs() const
+{
+    qint64 last = lastIndex();
+    if (last == Unbounded) return Unbounded;
+    if (last < 0) return -Unbounded - 1;
+    return fromWall(occurrenceStart(last) + _duration).toMSecsSinceEpoch();
+}
+
+QList<Occurrence> RecurringEntry::occurrences(const QDateTime &from,
+                                              const QDateTime &to) const
+{
+    QList<Occurrence> list;
+    qint64 last = lastIndex();
+    qint64 end = toWall(to);
+
+    for (qint64 k = firstEndingAtOrAfter(toWall(from)); k <= last; k++) {
+        qint64 start = occurrenceStart(k);
+        if (start > end) break;
+        list.append(Occurrence(fromWall(start), fromWall(start + _duration)));
+    }
+    return list;
+}
+
+
+
+
+/******************************************************************************
+    RULE ARITHMETIC
+******************************************************************************/
+
+/* Daily and weekly rules advance by a fixed number of days; monthly and
+   yearly ones by calendar months, whose length varies. */
+bool RecurringEntry::dayBased() const
+{
+    return _frequency == Daily || _frequency == Weekly;
+}
+
+// Days between occurrences for day-based rules, otherwise months
+qint64 RecurringEntry::periodUnits() const
+{
+    switch (_frequency) {
+    case Daily:   return _interval;
+    case Weekly:  return 7 * _interval;
+    case Monthly: return _interval;
+    default:      return 12 * _interval;
+    }
+}
+
+qint64 RecurringEntry::approxPeriodDays() const
+{
+    return dayBased() ? periodUnits() : periodUnits() * 30;
+}
+
+/* Index of the final occurrence, Unbounded if the rule never ends, or -1
+   if it has no occurrences at all. */
+qint64 RecurringEntry::lastIndex() const
+{
+    qint64 last = Unbounded;
+    if (_count > 0) last = _count - 1;
+    if (_until.isValid()) {
+        qint64 endOfUntil = qint64(_until.toJulianDay() + 1) * MSecsPerDay - 1;
+        last = qMin(last, indexAtOrBefore(endOfUntil));
+    }
+    return last;
+}
+
+qint64 RecurringEntry::occurrenceStart(qint64 k) const
+{
+    if (dayBased()) return _first + k * periodUnits() * MSecsPerDay;
+
+    /* QDate::addMonths() clamps to the end of shorter months, so a rule
+       starting on the 31st lands on the 30th (or 28th/29th) when needed. */
+    qint64 day = _first / MSecsPerDay;
+    QDate d = QDate::fromJulianDay(int(day)).addMonths(int(k * periodUnits()));
+    return qint64(d.toJulianDay()) * MSecsPerDay + (_first - day * MSecsPerDay);
+}
+
+// Largest k whose occurrence starts at or before wall (may be negative)
+qint64 RecurringEntry::indexAtOrBefore(qint64 wall) const
+{
+    if (dayBased())
+        return floorDiv(wall - _first, periodUnits() * MSecsPerDay);
+
+    QDate first = QDate::fromJulianDay(int(_first / MSecsPerDay));
+    QDate d = QDate::fromJulianDay(int(floorDiv(wall, MSecsPerDay)));
+    qint64 months = qint64(d.year() - first.year()) * 12
+                    + d.month() - first.month();
+    qint64 k = floorDiv(months, periodUnits());
+
+    // Same month, but later in it (or clamped past wall)
+    if (occurrenceStart(k) > wall) k--;
+    return k;
+}
+
+// Smallest k >= 0 whose occurrence ends at or after wall
+qint64 RecurringEntry::firstEndingAtOrAfter(qint64 wall) const
+{
+    qint64 k = indexAtOrBefore(wall - _duration);
+    if (k < 0) return 0;
+    if (occurrenceStart(k) + _duration < wall) k++;
+    return k;
+}
+
+/* Index of the first occurrence overlapping [start, end], or -1. Since all
+   occurrences have the same length, that's the first one which hasn't ended
+   by start, provided it begins by end. */
+qint64 RecurringEntry::overlapIndex(qint64 start, qint64 end) const
+{
+    qint64 k = firstEndingAtOrAfter(start);
+    if (k > lastIndex() || occurrenceStart(k) > end) return -1;
+    return k;
+}
+
+qint64 RecurringEntry::lastEnd() const
+{
+    qint64 last = lastIndex();
+    if (last == Unbounded) return Unbounded;
+    return occurrenceStart(last) + _duration;
+}
+
+Occurrence RecurringEntry::occurrence(qint64 k) const
+{
+    qint64 start = occurrenceStart(k);
+    return Occurrence(fromWall(start), fromWall(start + _duration));
+}
+
+bool RecurringEntry::ruleConflict(const RecurringEntry *other,
+                                  Occurrence *when) const
+{
+    if (lastIndex() < 0 || other->lastIndex() < 0) return false;
+    if (dayBased() && other->dayBased()) return dayRuleConflict(other, when);
+
+    /* Otherwise walk the sparser rule over the span in which both are active,
+       intersecting each of its occurrences with the other rule directly.
+       Two rules repeat relative to each other within the product of their
+       intervals times one Gregorian cycle, which bounds unending rules. */
+    bool walkThis = approxPeriodDays() >= other->approxPeriodDays();
+    const RecurringEntry *walker = walkThis ? this : other;
+    const RecurringEntry *target = walkThis ? other : this;
+
+    qint64 from = qMax(_first, other->_first)
+                  - qMax(_duration, other->_duration);
+    qint64 to = qMin(lastEnd(), other->lastEnd());
+
+    /* The product is taken in 64 bits, and only applied when it fits:
+       large intervals would overflow it, and then there's no bound short
+       of "to" anyway */
+    const qint64 cycle = CycleDays * MSecsPerDay;
+    qint64 cycles = qint64(_interval) * qint64(other->_interval);
+    qint64 room = Unbounded - qMax(from, qint64(0));
+    if (cycles > 0 && cycles <= room / cycle)
+        to = qMin(to, from + cycles * cycle);
+
+    qint64 last = walker->lastIndex();
+    for (qint64 k = walker->firstEndingAtOrAfter(from); k <= last; k++) {
+        qint64 start = walker->occurrenceStart(k);
+        if (start > to) break;
+
+        qint64 hit = target->overlapIndex(start, start + walker->_duration);
+        if (hit < 0) continue;
+
+        if (when) *when = occurrence(walkThis ? k : hit);
+        return true;
+    }
+    return false;
+}
+
+/* Occurrence i of this rule and j of the other overlap iff
+       -otherDuration <= diff + (j*pB - i*pA) days <= thisDuration
+   where diff is the distance between the first occurrences. j*pB - i*pA
+   only takes multiples of g = gcd(pA, pB), so try each such shift m*g that
+   lands in that window and solve j*(pB/g) - i*(pA/g) = m for the earliest
+   i, j >= 0. That's constant work per shift, however long the rules run. */
+bool RecurringEntry::dayRuleConflict(const RecurringEntry *other,
+                                     Occurrence *when) const
+{
+    qint64 pA = periodUnits(), pB = other->periodUnits();
+    qint64 g = gcd(pA, pB);
+    qint64 a = pA / g, b = pB / g;
+    qint64 step = g * MSecsPerDay;
+    qint64 diff = other->_first - _first;
+
+    qint64 mLo = -floorDiv(other->_duration + diff, step);
+    qint64 mHi = floorDiv(_duration - diff, step);
+    qint64 inverse = (a == 1) ? 0 : modInverse(b % a, a);
+    qint64 lastA = lastIndex(), lastB = other->lastIndex();
+    qint64 best = -1;
+
+    for (qint64 m = mLo; m <= mHi; m++) {
+        qint64 j = (a == 1) ? 0 : (((m % a) + a) % a) * inverse % a;
+        qint64 i = (j * b - m) / a;
+
+        // Shift along the solution line until both indices are valid
+        qint64 t = qMax(Q_INT64_C(0), -floorDiv(i, b));
+        i += t * b;
+        j += t * a;
+
+        if (i <= lastA && j <= lastB && (best < 0 || i < best))
+            best = i;
+    }
+
+    if (best < 0) return false;
+    if (when) *when = occurrence(best);
+    return true;
+}
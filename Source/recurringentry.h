@@ -0,0 +1,82 @@
+#ifndef RECURRINGENTRY_H
+#define RECURRINGENTRY_H
+
+#include "abstractentry.h"
+
+/* An entry that repeats by rule (like an iCalendar RRULE) instead of being
+   stored once per occurrence. Occurrences are only computed for the window
+   that is asked about, so memory and file size don't grow with the horizon.
+
+   Occurrence arithmetic is done on "wall clock" milliseconds (Julian day and
+   time of day), so a 9:00 standup stays at 9:00 across DST changes. */
+class RecurringEntry : public AbstractEntry
+{
+
+public:
+    enum Frequency { Daily, Weekly, Monthly, Yearly };
+
+    /* count: number of occurrences, or 0 for no limit
+       until: date of the last possible occurrence, or a null QDate */
+    RecurringEntry(QString name, QDateTime startDateTime,
+                   QDateTime endDateTime, QString notes, QDateTime whenAdded,
+                   Frequency frequency, int interval, int count, QDate until);
+    virtual ~RecurringEntry() {}
+
+    virtual AbstractEntry *clone() const;
+
+    virtual QDateTime startDateTime() const;
+    virtual QDateTime endDateTime() const;
+    virtual QDateTime whenAdded() const;
+    virtual qint64    whenAddedMSecs() const;
+
+    virtual void setStartDateTime(QDateTime newDT);
+    virtual void setEndDateTime(QDateTime newDT);
+
+    Frequency frequency() const;
+    int       interval() const;
+    int       count() const;
+    QDate     until() const;
+    void      setRule(Frequency frequency, int interval, int count,
+                      QDate until);
+
+    QString     ruleString() const;
+    static bool parseRule(const QString &rule, Frequency &frequency,
+                          int &interval, int &count, QDate &until,
+                          QStringList *ignored = 0);
+
+    virtual bool isRecurring() const { return true; }
+    virtual bool conflictsWith(const AbstractEntry *other,
+                               Occurrence *when = 0) const;
+    virtual bool endedBy(qint64 msecs) const;
+    virtual bool nextStartAfter(qint64 msecs, qint64 &start) const;
+    qint64       lastEndMSecs() const;
+    virtual quint64 contentHash() const;
+    virtual QList<Occurrence> occurrences(const QDateTime &from,
+                                          const QDateTime &to) const;
+
+private:
+    bool   dayBased() const;
+    qint64 periodUnits() const;
+    qint64 approxPeriodDays() const;
+    qint64 lastIndex() const;
+    qint64 occurrenceStart(qint64 k) const;
+    qint64 indexAtOrBefore(qint64 wall) const;
+    qint64 firstEndingAtOrAfter(qint64 wall) const;
+    qint64 overlapIndex(qint64 start, qint64 end) const;
+    qint64 lastEnd() const;
+    Occurrence occurrence(qint64 k) const;
+    bool   ruleConflict(const RecurringEntry *other, Occurrence *when) const;
+    bool   dayRuleConflict(const RecurringEntry *other,
+                           Occurrence *when) const;
+
+    qint64          _first;     // wall clock start of the first occurrence
+    qint64          _duration;  // wall clock length of each occurrence
+    const qint64    _whenAddedMSecs;
+
+    Frequency _frequency;
+    int       _interval;
+    int       _count;
+    QDate     _until;
+};
+
+#endif // RECURRINGENTRY_H
@@ -0,0 +1,110 @@
+#include <QDateTime>
+#include <QTimer>
+#include <algorithm>
+
+#include "reminderscheduler.h"
+#include "memoryusage.h"
+
+ReminderScheduler::ReminderScheduler(QObject *parent)
+    : QObject(parent)
+{
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    connect(timer, SIGNAL(timeout()), this, SLOT(fireDue()));
+}
+
+/* Remind of entry id at msecs (since the epoch), replacing any reminder it
+   had. A time that has already passed fires on the next event loop pass. */
+void ReminderScheduler::schedule(quint64 id, qint64 msecs)
+{
+    pending.insert(id, msecs);
+    Reminder r = { msecs, id };
+    heap.push_back(r);
+    std::push_heap(heap.begin(), heap.end(), Later());
+
+    // Only a new earliest reminder moves the timer
+    if (heap.front().id == id && heap.front().msecs == msecs) arm();
+    else if (heap.size() > 2 * uint(pending.size()) + 64) rebuild();
+}
+
+void ReminderScheduler::cancel(quint64 id)
+{
+    if (pending.remove(id) == 0) return;
+    if (heap.size() > 2 * uint(pending.size()) + 64) rebuild();
+}
+
+void ReminderScheduler::clear()
+{
+    heap.clear();
+    pending.clear();
+    timer->stop();
+}
+
+int ReminderScheduler::count() const { return pending.size(); }
+
+qint64 ReminderScheduler::memoryUsed() const
+{
+    return MemoryUsage::vectorBytes(heap) + MemoryUsage::hashBytes(pending);
+}
+
+bool ReminderScheduler::isLive(const Reminder &r) const
+{
+    QHash<quint64, qint64>::const_iterator it = pending.constFind(r.id);
+    return it != pending.constEnd() && it.value() == r.msecs;
+}
+
+// Pop cancelled and replaced reminders off the top
+void ReminderScheduler::dropStale()
+{
+    while (!heap.empty() && !isLive(heap.front())) {
+        std::pop_heap(heap.begin(), heap.end(), Later());
+        heap.pop_back();
+    }
+}
+
+// Rebuild the heap from the live reminders only, in O(n)
+void ReminderScheduler::rebuild()
+{
+    heap.clear();
+    heap.reserve(pending.size());
+    QHash<quint64, qint64>::const_iterator it;
+    for (it = pending.constBegin(); it != pending.constEnd(); it++) {
+        Reminder r = { it.value(), it.key() };
+        heap.push_back(r);
+    }
+    std::make_heap(heap.begin(), heap.end(), Later());
+    arm();
+}
+
+void ReminderScheduler::arm()
+{
+    dropStale();
+    if (heap.empty()) {
+        timer->stop();
+        return;
+    }
+
+    qint64 wait = heap.front().msecs - QDateTime::currentMSecsSinceEpoch();
+    timer->start(int(qBound(Q_INT64_C(0), wait, qint64(MaxWait))));
+}
+
+/* Take every reminder that's due off the heap before emitting any, since
+   receivers usually schedule the entry's next reminder straight away. */
+void ReminderScheduler::fireDue()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    std::vector<Reminder> fired;
+
+    dropStale();
+    while (!heap.empty() && heap.front().msecs <= now) {
+        fired.push_back(heap.front());
+        pending.remove(heap.front().id);
+        std::pop_heap(heap.begin(), heap.end(), Later());
+        heap.pop_back();
+        dropStale();
+    }
+    arm();
+
+    for (uint i = 0; i < fired.size(); i++)
+        emit due(fired[i].id, fired[i].msecs);
+}
@@ -0,0 +1,60 @@
+#ifndef REMINDERSCHEDULER_H
+#define REMINDERSCHEDULER_H
+
+#include <QObject>
+#include <QHash>
+#include <vector>
+
+class QTimer;
+
+/* Emits due() when an entry's reminder time comes. Reminders are kept in a
+   binary min-heap on their time, with one timer armed for the earliest, so
+   scheduling costs O(log n) and cancelling O(1) however many entries there
+   are, and nothing is rescanned when one fires.
+
+   A cancelled or rescheduled reminder is left in the heap and skipped when
+   it reaches the top; the heap is rebuilt once such leftovers outnumber the
+   live reminders. */
+class ReminderScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReminderScheduler(QObject *parent = 0);
+
+    void schedule(quint64 id, qint64 msecs);
+    void cancel(quint64 id);
+    void clear();
+    int  count() const;
+    qint64 memoryUsed() const;
+
+signals:
+    void due(quint64 id, qint64 msecs);
+
+private slots:
+    void fireDue();
+
+private:
+    struct Reminder {
+        qint64  msecs;
+        quint64 id;
+    };
+    struct Later {
+        bool operator()(const Reminder &a, const Reminder &b) const
+        { return a.msecs > b.msecs; }
+    };
+
+    bool isLive(const Reminder &r) const;
+    void dropStale();
+    void rebuild();
+    void arm();
+
+    // The timer is re-armed at least this often, in case the clock jumps
+    enum { MaxWait = 60 * 60 * 1000 };
+
+    std::vector<Reminder> heap;
+    QHash<quint64, qint64> pending;     // the live reminder of each entry
+    QTimer *timer;
+};
+
+#endif // REMINDERSCHEDULER_H
@@ -0,0 +1,321 @@
+#include <algorithm>
+
+#include "roaringbitmap.h"
+#include "memoryusage.h"
+
+static inline int popCount(quint64 word)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    for (; word != 0; word &= word - 1) count++;
+    return count;
+#endif
+}
+
+static inline int lowestBit(quint64 word)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    while (!(word & (Q_UINT64_C(1) << bit))) bit++;
+    return bit;
+#endif
+}
+
+/* The set bits of a Scan kernel's mask (row i in bit i % 64 of word
+   i / 64), which map directly onto bitmap containers */
+RoaringBitmap RoaringBitmap::fromMask(const quint64 *mask, int bits)
+{
+    RoaringBitmap result;
+    int maskWords = (bits + 63) / 64;
+    std::vector<quint64> words(BitmapWords);
+    for (int w = 0; w < maskWords; w += BitmapWords) {
+        int n = qMin(int(BitmapWords), maskWords - w);
+        std::copy(mask + w, mask + w + n, words.begin());
+        std::fill(words.begin() + n, words.end(), 0);
+
+        Container c;
+        c.key = quint16(w / BitmapWords);
+        c.setBits(&words[0]);
+        if (c.count > 0) result.containers.push_back(c);
+    }
+    return result;
+}
+
+// 0 to count - 1
+RoaringBitmap RoaringBitmap::range(quint32 count)
+{
+    RoaringBitmap result;
+    std::vector<quint64> words(BitmapWords);
+    for (quint64 base = 0; base < count; base += 65536) {
+        int n = int(qMin(quint64(65536), count - base));
+        std::fill(words.begin(), words.end(), 0);
+        std::fill(words.begin(), words.begin() + n / 64, ~Q_UINT64_C(0));
+        if (n % 64) words[n / 64] = (Q_UINT64_C(1) << (n % 64)) - 1;
+
+        Container c;
+        c.key = quint16(base >> 16);
+        c.setBits(&words[0]);
+        result.containers.push_back(c);
+    }
+    return result;
+}
+
+void RoaringBitmap::add(quint32 value)
+{
+    quint16 key = quint16(value >> 16), low = quint16(value);
+    int i = find(key);
+    if (i == int(containers.size()) || containers[i].key != key) {
+        Container c;
+        c.key = key;
+        c.count = 0;
+        containers.insert(containers.begin() + i, c);
+    }
+
+    Container &c = containers[i];
+    if (c.isBitmap()) {
+        quint64 bit = Q_UINT64_C(1) << (low % 64);
+        if (c.bits[low / 64] & bit) return;
+        c.bits[low / 64] |= bit;
+        c.count++;
+        return;
+    }
+
+    std::vector<quint16>::iterator it =
+            std::lower_bound(c.array.begin(), c.array.end(), low);
+    if (it != c.array.end() && *it == low) return;
+    c.array.insert(it, low);
+    if (++c.count > ArrayMax) {
+        std::vector<quint64> words(BitmapWords);
+        c.toBits(&words[0]);
+        c.setBits(&words[0]);
+    }
+}
+
+void RoaringBitmap::remove(quint32 value)
+{
+    quint16 key = quint16(value >> 16), low = quint16(value);
+    int i = find(key);
+    if (i == int(containers.size()) || containers[i].key != key) return;
+
+    Container &c = containers[i];
+    if (c.isBitmap()) {
+        quint64 bit = Q_UINT64_C(1) << (low % 64);
+        if (!(c.bits[low / 64] & bit)) return;
+        c.bits[low / 64] &= ~bit;
+        if (--c.count <= ArrayMax) {
+            std::vector<quint64> words(c.bits);
+            c.setBits(&words[0]);
+        }
+    }
+    else {
+        std::vector<quint16>::iterator it =
+                std::lower_bound(c.array.begin(), c.array.end(), low);
+        if (it == c.array.end() || *it != low) return;
+        c.array.erase(it);
+        c.count--;
+    }
+    if (c.count == 0) containers.erase(containers.begin() + i);
+}
+
+bool RoaringBitmap::contains(quint32 value) const
+{
+    quint16 key = quint16(value >> 16);
+    int i = find(key);
+    return i < int(containers.size()) && containers[i].key == key
+           && containers[i].contains(quint16(value));
+}
+
+int RoaringBitmap::cardinality() const
+{
+    int count = 0;
+    for (uint i = 0; i < containers.size(); i++) count += containers[i].count;
+    return count;
+}
+
+/* Groups with a key on one side only are kept or dropped whole; the rest
+   are combined container by container. */
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap &other) const
+{
+    RoaringBitmap result;
+    uint i = 0, j = 0;
+    Container c;
+    while (i < containers.size() && j < other.containers.size()) {
+        if (containers[i].key < other.containers[j].key) i++;
+        else if (containers[i].key > other.containers[j].key) j++;
+        else {
+            if (combine(containers[i++], other.containers[j++], And, c))
+                result.containers.push_back(c);
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap &other) const
+{
+    RoaringBitmap result;
+    uint i = 0, j = 0;
+    Container c;
+    while (i < containers.size() || j < other.containers.size()) {
+        if (j == other.containers.size()
+                || (i < containers.size()
+                    && containers[i].key < other.containers[j].key))
+            result.containers.push_back(containers[i++]);
+        else if (i == containers.size()
+                 || containers[i].key > other.containers[j].key)
+            result.containers.push_back(other.containers[j++]);
+        else {
+            combine(containers[i++], other.containers[j++], Or, c);
+            result.containers.push_back(c);
+        }
+    }
+    return result;
+}
+
+// The values here that aren't in other
+RoaringBitmap RoaringBitmap::andNot(const RoaringBitmap &other) const
+{
+    RoaringBitmap result;
+    uint j = 0;
+    Container c;
+    for (uint i = 0; i < containers.size(); i++) {
+        while (j < other.containers.size()
+               && other.containers[j].key < containers[i].key)
+            j++;
+        if (j == other.containers.size()
+                || other.containers[j].key != containers[i].key)
+            result.containers.push_back(containers[i]);
+        else if (combine(containers[i], other.containers[j], AndNot, c))
+            result.containers.push_back(c);
+    }
+    return result;
+}
+
+// Append every value, in increasing order
+void RoaringBitmap::toVector(std::vector<int> &values) const
+{
+    for (uint i = 0; i < containers.size(); i++) {
+        const Container &c = containers[i];
+        int high = int(c.key) << 16;
+        if (!c.isBitmap()) {
+            for (uint k = 0; k < c.array.size(); k++)
+                values.push_back(high | c.array[k]);
+            continue;
+        }
+        for (int w = 0; w < BitmapWords; w++) {
+            for (quint64 word = c.bits[w]; word != 0; word &= word - 1)
+                values.push_back(high | (w * 64 + lowestBit(word)));
+        }
+    }
+}
+
+qint64 RoaringBitmap::memoryUsed() const
+{
+    qint64 bytes = MemoryUsage::vectorBytes(containers);
+    for (uint i = 0; i < containers.size(); i++) {
+        bytes += MemoryUsage::vectorBytes(containers[i].array)
+                 + MemoryUsage::vectorBytes(containers[i].bits);
+    }
+    return bytes;
+}
+
+// The index of the first container whose key isn't below key
+int RoaringBitmap::find(quint16 key) const
+{
+    int low = 0, high = int(containers.size());
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (containers[middle].key < key) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+/* One group of a set operation. Arrays are filtered or merged as they are;
+   anything involving a bitmap is worked out on words and stored in the
+   smaller container. False if the result is empty. */
+bool RoaringBitmap::combine(const Container &a, const Container &b,
+                            Operation op, Container &result)
+{
+    result.key = a.key;
+    result.array.clear();
+    result.bits.clear();
+
+    // An array is filtered by whether the other side has each value
+    const Container *filtered = NULL, *against = NULL;
+    if (op == And && !a.isBitmap()) filtered = &a, against = &b;
+    else if (op == And && !b.isBitmap()) filtered = &b, against = &a;
+    else if (op == AndNot && !a.isBitmap()) filtered = &a, against = &b;
+    if (filtered) {
+        for (uint k = 0; k < filtered->array.size(); k++) {
+            if (against->contains(filtered->array[k]) == (op == And))
+                result.array.push_back(filtered->array[k]);
+        }
+        result.count = int(result.array.size());
+        return result.count > 0;
+    }
+
+    if (op == Or && !a.isBitmap() && !b.isBitmap()
+            && a.count + b.count <= ArrayMax) {
+        result.array.resize(a.count + b.count);
+        result.array.erase(std::set_union(a.array.begin(), a.array.end(),
+                                          b.array.begin(), b.array.end(),
+                                          result.array.begin()),
+                           result.array.end());
+        result.count = int(result.array.size());
+        return true;
+    }
+
+    std::vector<quint64> words(BitmapWords), other(BitmapWords);
+    a.toBits(&words[0]);
+    b.toBits(&other[0]);
+    for (int w = 0; w < BitmapWords; w++) {
+        if (op == And) words[w] &= other[w];
+        else if (op == Or) words[w] |= other[w];
+        else words[w] &= ~other[w];
+    }
+    result.setBits(&words[0]);
+    return result.count > 0;
+}
+
+bool RoaringBitmap::Container::contains(quint16 low) const
+{
+    if (isBitmap()) return bits[low / 64] & (Q_UINT64_C(1) << (low % 64));
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+// Set the container's values in words, which start out clear
+void RoaringBitmap::Container::toBits(quint64 *words) const
+{
+    if (isBitmap()) {
+        std::copy(bits.begin(), bits.end(), words);
+        return;
+    }
+    for (uint k = 0; k < array.size(); k++)
+        words[array[k] / 64] |= Q_UINT64_C(1) << (array[k] % 64);
+}
+
+// Hold the values set in words, in an array if there are few enough
+void RoaringBitmap::Container::setBits(const quint64 *words)
+{
+    count = 0;
+    for (int w = 0; w < BitmapWords; w++) count += popCount(words[w]);
+
+    if (count > ArrayMax) {
+        std::vector<quint16>().swap(array);
+        bits.assign(words, words + BitmapWords);
+        return;
+    }
+
+    std::vector<quint16> values;
+    values.reserve(count);
+    for (int w = 0; w < BitmapWords; w++) {
+        for (quint64 word = words[w]; word != 0; word &= word - 1)
+            values.push_back(quint16(w * 64 + lowestBit(word)));
+    }
+    array.swap(values);
+    std::vector<quint64>().swap(bits);
+}
@@ -0,0 +1,61 @@
+#ifndef ROARINGBITMAP_H
+#define ROARINGBITMAP_H
+
+#include <QtGlobal>
+#include <vector>
+
+/* A compressed set of 32-bit integers (entry slots, here), after Roaring
+   bitmaps: values are grouped by their high 16 bits, and each group keeps
+   its low 16 bits in whichever container is smaller, a sorted array of up
+   to ArrayMax values or a plain 65536-bit bitmap. A sparse tag costs two
+   bytes per entry and a common one an eighth of a byte, and set operations
+   work a group at a time, a word of 64 values at a time where both sides
+   are bitmaps. */
+class RoaringBitmap
+{
+public:
+    RoaringBitmap() {}
+
+    static RoaringBitmap fromMask(const quint64 *mask, int bits);
+    static RoaringBitmap range(quint32 count);
+
+    void add(quint32 value);
+    void remove(quint32 value);
+    bool contains(quint32 value) const;
+    int  cardinality() const;
+    bool isEmpty() const { return containers.empty(); }
+    void clear() { containers.clear(); }
+
+    RoaringBitmap operator&(const RoaringBitmap &other) const;
+    RoaringBitmap operator|(const RoaringBitmap &other) const;
+    RoaringBitmap andNot(const RoaringBitmap &other) const;
+
+    void   toVector(std::vector<int> &values) const;
+    qint64 memoryUsed() const;
+
+private:
+    enum { ArrayMax = 4096 };   // values; past that, a bitmap is smaller
+    enum { BitmapWords = 65536 / 64 };
+
+    struct Container {
+        quint16 key;                // the values' high 16 bits
+        int count;
+        std::vector<quint16> array; // sorted low bits, if not a bitmap
+        std::vector<quint64> bits;  // BitmapWords words, if a bitmap
+
+        bool isBitmap() const { return !bits.empty(); }
+        bool contains(quint16 low) const;
+        void toBits(quint64 *words) const;
+        void setBits(const quint64 *words);
+    };
+
+    enum Operation { And, Or, AndNot };
+
+    int  find(quint16 key) const;
+    static bool combine(const Container &a, const Container &b, Operation op,
+                        Container &result);
+
+    std::vector<Container> containers;  // by key
+};
+
+#endif // ROARINGBITMAP_H
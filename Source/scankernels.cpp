@@ -0,0 +1,243 @@
+#include <QByteArray>
+
+#include "scankernels.h"
+
+/* Per-function targets for AVX2 code need GCC 4.9 (earlier immintrin.h
+   only declares what the whole file is compiled for) and clang 3.8, and
+   __builtin_cpu_supports() GCC 4.8. Older compilers, like the GCC 4.4 in
+   the Windows MinGW kit, get the plain versions only. */
+#if defined(__clang__)
+#define SCAN_COMPILER_OK (__clang_major__ > 3 \
+                          || (__clang_major__ == 3 && __clang_minor__ >= 8))
+#elif defined(__GNUC__)
+#define SCAN_COMPILER_OK (__GNUC__ > 4 \
+                          || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#else
+#define SCAN_COMPILER_OK 0
+#endif
+
+#if SCAN_COMPILER_OK && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    // Up to 64 rows' overlap bits, one row at a time
+    inline quint64 overlapWord(const qint64 *starts, const qint64 *ends,
+                               int count, qint64 from, qint64 to)
+    {
+        quint64 word = 0;
+        for (int j = 0; j < count; j++)
+            word |= quint64(Scan::meets(starts[j], ends[j], from, to)) << j;
+        return word;
+    }
+
+    void overlapScalar(const qint64 *starts, const qint64 *ends, int n,
+                       qint64 from, qint64 to, quint64 *mask)
+    {
+        for (int i = 0; i < n; i += 64)
+            mask[i / 64] = overlapWord(starts + i, ends + i, qMin(64, n - i),
+                                       from, to);
+    }
+
+    int countAboveScalar(const qint64 *values, int n, qint64 t)
+    {
+        int above = 0;
+        for (int i = 0; i < n; i++) above += values[i] > t;
+        return above;
+    }
+
+#ifdef SCAN_X86
+    /* The vector versions test whole words of 64 rows, two or four rows
+       per compare; a row is out if start > to or from > end. The last,
+       partial word is left to the scalar version. */
+    __attribute__((target("sse4.2")))
+    void overlapSSE42(const qint64 *starts, const qint64 *ends, int n,
+                      qint64 from, qint64 to, quint64 *mask)
+    {
+        const __m128i low = _mm_set1_epi64x(from);
+        const __m128i high = _mm_set1_epi64x(to);
+        int i = 0;
+        for (; i + 64 <= n; i += 64) {
+            quint64 out = 0;
+            for (int j = 0; j < 64; j += 2) {
+                __m128i s = _mm_loadu_si128((const __m128i*)(starts + i + j));
+                __m128i e = _mm_loadu_si128((const __m128i*)(ends + i + j));
+                __m128i miss = _mm_or_si128(_mm_cmpgt_epi64(s, high),
+                                            _mm_cmpgt_epi64(low, e));
+                out |= quint64(_mm_movemask_pd(_mm_castsi128_pd(miss))) << j;
+            }
+            mask[i / 64] = ~out;
+        }
+        if (i < n)
+            mask[i / 64] = overlapWord(starts + i, ends + i, n - i, from, to);
+    }
+
+    __attribute__((target("avx2")))
+    void overlapAVX2(const qint64 *starts, const qint64 *ends, int n,
+                     qint64 from, qint64 to, quint64 *mask)
+    {
+        const __m256i low = _mm256_set1_epi64x(from);
+        const __m256i high = _mm256_set1_epi64x(to);
+        int i = 0;
+        for (; i + 64 <= n; i += 64) {
+            quint64 out = 0;
+            for (int j = 0; j < 64; j += 4) {
+                __m256i s = _mm256_loadu_si256(
+                            (const __m256i*)(starts + i + j));
+                __m256i e = _mm256_loadu_si256((const __m256i*)(ends + i + j));
+                __m256i miss = _mm256_or_si256(_mm256_cmpgt_epi64(s, high),
+                                               _mm256_cmpgt_epi64(low, e));
+                out |= quint64(_mm256_movemask_pd(_mm256_castsi256_pd(miss)))
+                       << j;
+            }
+            mask[i / 64] = ~out;
+        }
+        if (i < n)
+            mask[i / 64] = overlapWord(starts + i, ends + i, n - i, from, to);
+    }
+
+    // A compare gives -1 per lane that's above, so subtracting it counts
+    __attribute__((target("sse4.2")))
+    int countAboveSSE42(const qint64 *values, int n, qint64 t)
+    {
+        const __m128i limit = _mm_set1_epi64x(t);
+        __m128i above = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 2 <= n; i += 2) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+            above = _mm_sub_epi64(above, _mm_cmpgt_epi64(v, limit));
+        }
+        qint64 lanes[2];
+        _mm_storeu_si128((__m128i*)lanes, above);
+        return int(lanes[0] + lanes[1])
+               + countAboveScalar(values + i, n - i, t);
+    }
+
+    __attribute__((target("avx2")))
+    int countAboveAVX2(const qint64 *values, int n, qint64 t)
+    {
+        const __m256i limit = _mm256_set1_epi64x(t);
+        __m256i above = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+            above = _mm256_sub_epi64(above, _mm256_cmpgt_epi64(v, limit));
+        }
+        qint64 lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, above);
+        return int(lanes[0] + lanes[1] + lanes[2] + lanes[3])
+               + countAboveScalar(values + i, n - i, t);
+    }
+#endif // SCAN_X86
+
+    struct Kernels
+    {
+        Scan::Level level;
+        void (*overlap)(const qint64 *, const qint64 *, int, qint64, qint64,
+                        quint64 *);
+        int (*countAbove)(const qint64 *, int, qint64);
+    };
+
+#ifdef SCAN_X86
+    /* Whether a vector version gives the plain version's answers, on rows
+       that sit on and either side of the query's ends, in whole words and a
+       partial one */
+    bool agrees(const Kernels &k)
+    {
+        enum { Rows = 64 * 3 + 5, Words = (Rows + 63) / 64 };
+        qint64 starts[Rows], ends[Rows];
+        for (int i = 0; i < Rows; i++) {
+            starts[i] = qint64(i % 7) - 3 - (i % 2 ? Q_INT64_C(1) << 40 : 0);
+            ends[i] = starts[i] + i % 5;
+        }
+        const qint64 bounds[][2] = {
+            { 0, 0 }, { -2, 1 }, { 3, 3 }, { -(Q_INT64_C(1) << 40), -4 }
+        };
+        for (uint b = 0; b < sizeof(bounds) / sizeof(bounds[0]); b++) {
+            quint64 want[Words], got[Words];
+            overlapScalar(starts, ends, Rows, bounds[b][0], bounds[b][1],
+                          want);
+            k.overlap(starts, ends, Rows, bounds[b][0], bounds[b][1], got);
+            for (int w = 0; w < Words; w++)
+                if (want[w] != got[w]) return false;
+            if (k.countAbove(ends, Rows, bounds[b][1])
+                    != countAboveScalar(ends, Rows, bounds[b][1]))
+                return false;
+        }
+        return true;
+    }
+#endif
+
+    /* The best versions the CPU runs, as long as they agree with the plain
+       ones on a few rows; a miscompiled kernel would otherwise give wrong
+       search results without any sign */
+    Kernels choose()
+    {
+        Kernels k = { Scan::Scalar, overlapScalar, countAboveScalar };
+#ifdef SCAN_X86
+        QByteArray cap = qgetenv("PLANNER_SCAN");
+        __builtin_cpu_init();
+        Kernels sse = { Scan::SSE42, overlapSSE42, countAboveSSE42 };
+        Kernels avx = { Scan::AVX2, overlapAVX2, countAboveAVX2 };
+        if (cap != "scalar" && __builtin_cpu_supports("sse4.2")
+                && agrees(sse))
+            k = sse;
+        if (cap != "scalar" && cap != "sse4.2"
+                && __builtin_cpu_supports("avx2") && agrees(avx))
+            k = avx;
+#endif
+        return k;
+    }
+
+    const Kernels &kernels()
+    {
+        static const Kernels chosen = choose();
+        return chosen;
+    }
+}
+
+Scan::Level Scan::level() { return kernels().level; }
+
+const char *Scan::levelName()
+{
+    const char *names[] = { "scalar", "SSE4.2", "AVX2" };
+    return names[level()];
+}
+
+void Scan::overlapMask(const qint64 *starts, const qint64 *ends, int n,
+                       qint64 from, qint64 to, quint64 *mask)
+{
+    kernels().overlap(starts, ends, n, from, to, mask);
+}
+
+// A point is an interval of its own, so this is an overlap scan
+void Scan::rangeMask(const qint64 *values, int n, qint64 low, qint64 high,
+                     quint64 *mask)
+{
+    kernels().overlap(values, values, n, low, high, mask);
+}
+
+int Scan::countAtMost(const qint64 *values, int n, qint64 t)
+{
+    return n - kernels().countAbove(values, n, t);
+}
+
+/* Append the rows set in mask, plus offset, to indexes, visiting only the
+   set bits */
+void Scan::maskIndexes(const quint64 *mask, int n, std::vector<int> &indexes,
+                       int offset)
+{
+    for (int w = 0; w < maskWords(n); w++) {
+        for (quint64 word = mask[w]; word != 0; word &= word - 1) {
+#ifdef __GNUC__
+            int bit = __builtin_ctzll(word);
+#else
+            int bit = 0;
+            while (!(word & (Q_UINT64_C(1) << bit))) bit++;
+#endif
+            indexes.push_back(offset + w * 64 + bit);
+        }
+    }
+}
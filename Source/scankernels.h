@@ -0,0 +1,48 @@
+#ifndef SCANKERNELS_H
+#define SCANKERNELS_H
+
+#include <QtGlobal>
+#include <vector>
+
+/* Brute-force scans over columns of millisecond times, for when there's no
+   index to ask (or it would cost more to build than one scan). Results are
+   bitmasks, one quint64 word per 64 rows with row i in bit i % 64, that
+   maskIndexes() turns into row numbers; bits past the last row are clear.
+
+   Each kernel has an AVX2, an SSE4.2 and a plain version, and the best one
+   the CPU runs is chosen the first time any is called, after checking it
+   against the plain one. PLANNER_SCAN=scalar or PLANNER_SCAN=sse4.2 in the
+   environment caps the choice, for comparing them. The vector versions are
+   only built on x86 by GCC 4.9 or clang 3.8 and later, which can target
+   them function by function. */
+namespace Scan
+{
+    enum Level { Scalar, SSE42, AVX2 };
+
+    Level level();
+    const char *levelName();
+
+    /* Whether [start, end] meets [from, to], ends included. Every overlap
+       test between intervals, scanned or not, comes down to this one. */
+    inline bool meets(qint64 start, qint64 end, qint64 from, qint64 to)
+    {
+        return start <= to && end >= from;
+    }
+
+    // Rows whose [starts[i], ends[i]] meets [from, to]
+    void overlapMask(const qint64 *starts, const qint64 *ends, int n,
+                     qint64 from, qint64 to, quint64 *mask);
+
+    // Rows with low <= values[i] <= high
+    void rangeMask(const qint64 *values, int n, qint64 low, qint64 high,
+                   quint64 *mask);
+
+    // How many values[i] <= t, i.e. how many entries ended by t
+    int countAtMost(const qint64 *values, int n, qint64 t);
+
+    inline int maskWords(int n) { return (n + 63) / 64; }
+    void maskIndexes(const quint64 *mask, int n, std::vector<int> &indexes,
+                     int offset = 0);
+}
+
+#endif // SCANKERNELS_H
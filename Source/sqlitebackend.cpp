@@ -0,0 +1,465 @@
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+#include <QDir>
+#include <QFileInfo>
+
+#include "sqlitebackend.h"
+#include "plannerentry.h"
+#include "recurringentry.h"
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_MAC) || defined(Q_OS_FREEBSD)
+#include <sys/param.h>
+#include <sys/mount.h>
+#elif defined(Q_OS_LINUX)
+#include <sys/vfs.h>
+#endif
+
+/* Whether fileName is on a local disk rather than a network share. When it
+   can't be told, it's taken to be on a share. */
+static bool isLocalFile(const QString &fileName)
+{
+    QString path = QFileInfo(fileName).absoluteFilePath();
+#if defined(Q_OS_WIN)
+    path = QDir::toNativeSeparators(path);
+    if (path.startsWith("\\\\")) return false;     // a UNC path
+    QString root = path.left(3);                    // "C:\\"
+    UINT type = GetDriveTypeW((const wchar_t*)root.utf16());
+    return type == DRIVE_FIXED || type == DRIVE_REMOVABLE
+           || type == DRIVE_RAMDISK;
+#elif defined(Q_OS_MAC) || defined(Q_OS_FREEBSD)
+    struct statfs fs;
+    if (::statfs(QFile::encodeName(QFileInfo(path).absolutePath())
+                 .constData(), &fs))
+        return false;
+    return fs.f_flags & MNT_LOCAL;
+#elif defined(Q_OS_LINUX)
+    struct statfs fs;
+    if (::statfs(QFile::encodeName(QFileInfo(path).absolutePath())
+                 .constData(), &fs))
+        return false;
+    switch (quint32(fs.f_type)) {
+    case 0x6969:        // NFS
+    case 0x517B:        // SMB
+    case 0xFF534D42u:   // CIFS
+    case 0xFE534D42u:   // SMB2
+    case 0x65735546:    // FUSE, which sshfs and the like use
+        return false;
+    default:
+        return true;
+    }
+#else
+    Q_UNUSED(path);
+    return false;
+#endif
+}
+
+// Bumped whenever the table layout changes (kept in PRAGMA user_version)
+static const int SchemaVersion = 3;
+
+static const char *Columns =
+        "name, start_msecs, end_msecs, notes, added_msecs, last_end_msecs, "
+        "frequency, repeat_interval, repeat_count, repeat_until, id, tags";
+
+static const char *Placeholders =
+        ":name, :start, :end, :notes, :added, :lastEnd, "
+        ":frequency, :interval, :count, :until, :id, :tags";
+
+SqliteBackend::SqliteBackend(const QString &fileName,
+                             const StorageOptions &options, bool readOnly)
+    : name(fileName), options(options), readOnly(readOnly),
+      readVersion(SchemaVersion), opened(false),
+      batchDepth(0), batchFailed(false), inTransaction(false)
+{
+    // Every backend gets a connection of its own
+    connection = QString("planner-%1").arg(quintptr(this));
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connection);
+    db.setDatabaseName(fileName);
+    if (readOnly) db.setConnectOptions("QSQLITE_OPEN_READONLY");
+}
+
+SqliteBackend::~SqliteBackend()
+{
+    {
+        QSqlDatabase db = database();
+        if (inTransaction) db.commit();
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(connection);
+}
+
+QString SqliteBackend::fileName() const    { return name; }
+QString SqliteBackend::errorString() const { return error; }
+
+QSqlDatabase SqliteBackend::database() const
+{
+    return QSqlDatabase::database(connection, false);
+}
+
+/* Open (or create) the database and its table. The sync setting decides how
+   much SQLite flushes per transaction, like it does for .pla saves. */
+bool SqliteBackend::open()
+{
+    if (opened) return true;
+
+    QSqlDatabase db = database();
+    if (readOnly && !QFileInfo(name).exists()) {
+        error = tr("Cannot open database %1:\n%2.").arg(name)
+                .arg(tr("The file does not exist"));
+        return false;
+    }
+    if (!db.open()) {
+        error = tr("Cannot open database %1:\n%2.").arg(name)
+                .arg(db.lastError().text());
+        return false;
+    }
+    if (readOnly) return openReadOnly();
+
+    /* WAL needs memory shared between everyone using the database, which
+       network file systems can't provide, so plans on shares keep the
+       rollback journal (and one that was switched to WAL goes back) */
+    const char *sync[] = { "OFF", "NORMAL", "FULL" };
+    int level = qBound(0, int(options.durability), 2);
+    QSqlQuery query(db);
+    query.exec(isLocalFile(name) ? "PRAGMA journal_mode = WAL"
+                                 : "PRAGMA journal_mode = DELETE");
+    query.exec(QString("PRAGMA synchronous = %1").arg(sync[level]));
+
+    query.exec("PRAGMA user_version");
+    int version = query.next() ? query.value(0).toInt() : 0;
+    if (version > SchemaVersion) {
+        error = tr("The database was saved by a newer version of Planner.");
+        return false;
+    }
+
+    /* New databases get the current table. Version 1 had no IDs, so its
+       rows take their rowids, which are already unique; versions before 3
+       had no tags. Tags are stored one per line. */
+    QStringList schema;
+    if (version == 0) {
+        schema << "CREATE TABLE IF NOT EXISTS entries ("
+                  " name TEXT NOT NULL,"
+                  " start_msecs INTEGER NOT NULL,"
+                  " end_msecs INTEGER NOT NULL,"
+                  " notes TEXT,"
+                  " added_msecs INTEGER NOT NULL,"
+                  " last_end_msecs INTEGER NOT NULL,"
+                  " frequency INTEGER,"
+                  " repeat_interval INTEGER,"
+                  " repeat_count INTEGER,"
+                  " repeat_until TEXT,"
+                  " id INTEGER NOT NULL,"
+                  " tags TEXT NOT NULL DEFAULT '')"
+               << "CREATE UNIQUE INDEX IF NOT EXISTS entries_name"
+                  " ON entries(name)"
+               << "CREATE INDEX IF NOT EXISTS entries_start"
+                  " ON entries(start_msecs)"
+               << "CREATE INDEX IF NOT EXISTS entries_end"
+                  " ON entries(last_end_msecs)";
+    }
+    else if (version == 1) {
+        schema << "ALTER TABLE entries ADD COLUMN id INTEGER"
+               << "UPDATE entries SET id = rowid";
+    }
+    if (version >= 1 && version < 3)
+        schema << "ALTER TABLE entries"
+                  " ADD COLUMN tags TEXT NOT NULL DEFAULT ''";
+    if (version < SchemaVersion)
+        schema << "CREATE UNIQUE INDEX IF NOT EXISTS entries_id ON entries(id)";
+
+    if (!schema.isEmpty()) {
+        db.transaction();
+        for (int i = 0; i < schema.size(); i++) {
+            if (!query.exec(schema[i])) {
+                error = tr("Cannot set up database %1:\n%2.").arg(name)
+                        .arg(query.lastError().text());
+                db.rollback();
+                return false;
+            }
+        }
+        query.exec(QString("PRAGMA user_version = %1").arg(SchemaVersion));
+        db.commit();
+    }
+
+    opened = true;
+    return true;
+}
+
+/* Check that a database opened read-only can be read as it is. An older
+   layout isn't upgraded: every version has the times and rules loadTimes()
+   reads, and load() reads the columns it lacks as they'd be upgraded. */
+bool SqliteBackend::openReadOnly()
+{
+    QSqlQuery query(database());
+    query.exec("PRAGMA user_version");
+    int version = query.next() ? query.value(0).toInt() : 0;
+    readVersion = version;
+    if (version > SchemaVersion) {
+        error = tr("The database was saved by a newer version of Planner.");
+        return false;
+    }
+    if (version == 0) {
+        error = tr("%1 is not a Planner database.").arg(name);
+        return false;
+    }
+
+    opened = true;
+    return true;
+}
+
+/* Columns, with stand-ins for any a database opened read-only is too old
+   to have: version 1 rows are identified by their rowids, and rows before
+   version 3 have no tags */
+QString SqliteBackend::selectColumns() const
+{
+    QString columns = Columns;
+    if (readOnly && readVersion < 2) columns.replace(", id,", ", rowid,");
+    if (readOnly && readVersion < 3) columns.replace(", tags", ", ''");
+    return columns;
+}
+
+bool SqliteBackend::exec(QSqlQuery &query)
+{
+    if (query.exec()) return true;
+    error = query.lastError().text();
+    return false;
+}
+
+/* Single entries end where their only occurrence does; recurring ones are
+   stored with the end of their last occurrence for range queries. */
+void SqliteBackend::bindEntry(QSqlQuery &query,
+                              const AbstractEntry *entry) const
+{
+    query.bindValue(":name", entry->name());
+    query.bindValue(":start", entry->startMSecs());
+    query.bindValue(":end", entry->endMSecs());
+    query.bindValue(":notes", entry->notes());
+    query.bindValue(":added", entry->whenAddedMSecs());
+    query.bindValue(":id", qint64(entry->id()));
+    query.bindValue(":tags", entry->tags().join("\n"));
+
+    if (entry->isRecurring()) {
+        const RecurringEntry *r = static_cast<const RecurringEntry*>(entry);
+        query.bindValue(":lastEnd", r->lastEndMSecs());
+        query.bindValue(":frequency", int(r->frequency()));
+        query.bindValue(":interval", r->interval());
+        query.bindValue(":count", r->count());
+        query.bindValue(":until", r->until().isValid()
+                                  ? QVariant(r->until().toString(Qt::ISODate))
+                                  : QVariant(QVariant::String));
+    }
+    else {
+        query.bindValue(":lastEnd", entry->endMSecs());
+        query.bindValue(":frequency", QVariant(QVariant::Int));
+        query.bindValue(":interval", QVariant(QVariant::Int));
+        query.bindValue(":count", QVariant(QVariant::Int));
+        query.bindValue(":until", QVariant(QVariant::String));
+    }
+}
+
+// Build an entry from a row selected with Columns
+AbstractEntry *SqliteBackend::entryFromRecord(const QSqlQuery &query) const
+{
+    QString entryName = query.value(0).toString();
+    qint64 start = query.value(1).toLongLong();
+    qint64 end = query.value(2).toLongLong();
+    QString notes = query.value(3).toString();
+    qint64 added = query.value(4).toLongLong();
+
+    AbstractEntry *entry;
+    if (query.value(6).isNull())
+        entry = new PlannerEntry(entryName, start, end, notes, added);
+    else {
+        entry = new RecurringEntry(entryName,
+                    QDateTime::fromMSecsSinceEpoch(start),
+                    QDateTime::fromMSecsSinceEpoch(end), notes,
+                    QDateTime::fromMSecsSinceEpoch(added),
+                    RecurringEntry::Frequency(query.value(6).toInt()),
+                    query.value(7).toInt(), query.value(8).toInt(),
+                    QDate::fromString(query.value(9).toString(), Qt::ISODate));
+    }
+    entry->setId(quint64(query.value(10).toLongLong()));
+    entry->setTags(query.value(11).toString().split('\n',
+                                                    QString::SkipEmptyParts));
+    return entry;
+}
+
+/******************************************************************************
+    LOADING AND SAVING
+******************************************************************************/
+
+bool SqliteBackend::load(std::vector<AbstractEntry*> &entries)
+{
+    if (!open()) return false;
+
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
+    query.prepare(QString("SELECT %1 FROM entries ORDER BY rowid")
+                  .arg(selectColumns()));
+    if (!exec(query)) {
+        error = tr("Cannot read database %1:\n%2.").arg(name).arg(error);
+        return false;
+    }
+
+    std::vector<AbstractEntry*> loaded;
+    while (query.next()) loaded.push_back(entryFromRecord(query));
+    entries.insert(entries.end(), loaded.begin(), loaded.end());
+    return true;
+}
+
+/* Only the rows that touch [from, to], found with the start and end indexes,
+   and only their times and rules: the entries have no names, notes, IDs or
+   tags. Nothing is appended if the rows can't be read. */
+bool SqliteBackend::loadTimes(qint64 from, qint64 to,
+                              std::vector<AbstractEntry*> &entries)
+{
+    if (!open()) return false;
+
+    QSqlQuery query(database());
+    query.setForwardOnly(true);
+    query.prepare("SELECT start_msecs, end_msecs, frequency, repeat_interval,"
+                  " repeat_count, repeat_until FROM entries"
+                  " WHERE start_msecs <= :to AND last_end_msecs >= :from");
+    query.bindValue(":to", to);
+    query.bindValue(":from", from);
+    if (!exec(query)) {
+        error = tr("Cannot read database %1:\n%2.").arg(name).arg(error);
+        return false;
+    }
+
+    std::vector<AbstractEntry*> loaded;
+    while (query.next()) {
+        qint64 start = query.value(0).toLongLong();
+        qint64 end = query.value(1).toLongLong();
+        if (query.value(2).isNull()) {
+            loaded.push_back(new PlannerEntry(QString(), start, end,
+                                              QString(), start));
+            continue;
+        }
+        loaded.push_back(new RecurringEntry(QString(),
+                    QDateTime::fromMSecsSinceEpoch(start),
+                    QDateTime::fromMSecsSinceEpoch(end), QString(),
+                    QDateTime::fromMSecsSinceEpoch(start),
+                    RecurringEntry::Frequency(query.value(2).toInt()),
+                    query.value(3).toInt(), query.value(4).toInt(),
+                    QDate::fromString(query.value(5).toString(),
+                                      Qt::ISODate)));
+    }
+    if (query.lastError().isValid()) {
+        for (uint i = 0; i < loaded.size(); i++) delete loaded[i];
+        error = tr("Cannot read database %1:\n%2.").arg(name)
+                .arg(query.lastError().text());
+        return false;
+    }
+    entries.insert(entries.end(), loaded.begin(), loaded.end());
+    return true;
+}
+
+/* Replace everything in the database with entries, in one transaction.
+   Only needed when a plan is first saved as a database; after that it's
+   kept up to date edit by edit. */
+bool SqliteBackend::save(const std::vector<AbstractEntry*> &entries)
+{
+    if (!open()) return false;
+
+    QSqlDatabase db = database();
+    db.transaction();
+
+    QSqlQuery query(db);
+    bool ok = query.exec("DELETE FROM entries");
+    if (!ok) error = query.lastError().text();
+
+    query.prepare(QString("INSERT INTO entries (%1) VALUES (%2)")
+                  .arg(Columns).arg(Placeholders));
+    for (uint i = 0; ok && i < entries.size(); i++) {
+        bindEntry(query, entries[i]);
+        ok = exec(query);
+    }
+
+    if (ok && db.commit()) return true;
+    if (ok) error = db.lastError().text();
+    db.rollback();
+    error = tr("Cannot write database %1:\n%2.").arg(name).arg(error);
+    return false;
+}
+
+
+
+
+/******************************************************************************
+    EDITS
+******************************************************************************/
+
+/* Group the following edits into one transaction (e.g. an import). Batches
+   nest; only the outermost one commits. */
+void SqliteBackend::beginBatch()
+{
+    if (batchDepth++ == 0) {
+        batchFailed = false;
+        inTransaction = open() && database().transaction();
+    }
+}
+
+/* Commit the edits that worked; returns false if any of them failed */
+bool SqliteBackend::endBatch()
+{
+    if (batchDepth == 0 || --batchDepth > 0) return true;
+
+    if (inTransaction) {
+        inTransaction = false;
+        QSqlDatabase db = database();
+        if (!db.commit()) {
+            error = db.lastError().text();
+            return false;
+        }
+    }
+    return !batchFailed;
+}
+
+bool SqliteBackend::insertEntry(const AbstractEntry *entry)
+{
+    if (!open()) return false;
+
+    QSqlQuery query(database());
+    query.prepare(QString("INSERT INTO entries (%1) VALUES (%2)")
+                  .arg(Columns).arg(Placeholders));
+    bindEntry(query, entry);
+    if (exec(query)) return true;
+
+    batchFailed = true;
+    return false;
+}
+
+bool SqliteBackend::updateEntry(const AbstractEntry *entry)
+{
+    if (!open()) return false;
+
+    QSqlQuery query(database());
+    query.prepare("UPDATE entries SET name = :name, start_msecs = :start,"
+                  " end_msecs = :end, notes = :notes, added_msecs = :added,"
+                  " last_end_msecs = :lastEnd, frequency = :frequency,"
+                  " repeat_interval = :interval, repeat_count = :count,"
+                  " repeat_until = :until, tags = :tags WHERE id = :id");
+    bindEntry(query, entry);
+    if (exec(query)) return true;
+
+    batchFailed = true;
+    return false;
+}
+
+bool SqliteBackend::removeEntry(quint64 id)
+{
+    if (!open()) return false;
+
+    QSqlQuery query(database());
+    query.prepare("DELETE FROM entries WHERE id = :id");
+    query.bindValue(":id", qint64(id));
+    if (exec(query)) return true;
+
+    batchFailed = true;
+    return false;
+}
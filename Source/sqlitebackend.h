@@ -0,0 +1,65 @@
+#ifndef SQLITEBACKEND_H
+#define SQLITEBACKEND_H
+
+#include "storagebackend.h"
+
+class QSqlDatabase;
+class QSqlQuery;
+
+/* Stores a document as an SQLite database (.plandb) with one row per entry,
+   indexed on ID, name, start and end. Every edit is written as it's made, in
+   its own transaction (or the enclosing batch's), so there is nothing left
+   to save and no whole-file rewrite.
+
+   Recurring entries are stored as their first occurrence plus their rule,
+   and with the end of their last occurrence. The plan is loaded whole, as
+   from a .pla file, and searched in memory.
+
+   Opened read-only, the database is used as it is: it isn't created if
+   missing, upgraded from an older layout, or switched to another journal
+   mode, any of which would write to someone else's plan. */
+class SqliteBackend : public StorageBackend
+{
+    Q_DECLARE_TR_FUNCTIONS(SqliteBackend)
+
+public:
+    SqliteBackend(const QString &fileName, const StorageOptions &options,
+                  bool readOnly = false);
+    virtual ~SqliteBackend();
+
+    virtual QString fileName() const;
+    virtual bool    load(std::vector<AbstractEntry*> &entries);
+    virtual bool    save(const std::vector<AbstractEntry*> &entries);
+    virtual QString errorString() const;
+    virtual bool    loadTimes(qint64 from, qint64 to,
+                              std::vector<AbstractEntry*> &entries);
+
+    virtual bool isIncremental() const { return true; }
+    virtual void beginBatch();
+    virtual bool endBatch();
+    virtual bool insertEntry(const AbstractEntry *entry);
+    virtual bool updateEntry(const AbstractEntry *entry);
+    virtual bool removeEntry(quint64 id);
+
+private:
+    QSqlDatabase database() const;
+    bool open();
+    bool openReadOnly();
+    QString selectColumns() const;
+    bool exec(QSqlQuery &query);
+    void bindEntry(QSqlQuery &query, const AbstractEntry *entry) const;
+    AbstractEntry *entryFromRecord(const QSqlQuery &query) const;
+
+    QString name;
+    QString connection;
+    StorageOptions options;
+    bool readOnly;
+    int readVersion;        // of a database opened read-only
+    bool opened;
+    int batchDepth;
+    bool batchFailed;
+    bool inTransaction;
+    mutable QString error;
+};
+
+#endif // SQLITEBACKEND_H
@@ -0,0 +1,21 @@
+#include <QFileInfo>
+
+#include "storagebackend.h"
+#include "plafilebackend.h"
+#include "sqlitebackend.h"
+
+/* Pick the backend by extension: .plandb is a database, anything else .pla.
+   A .pla file is only ever written by save(), so needs no read-only mode. */
+StorageBackend *StorageBackend::create(const QString &fileName,
+                                       const StorageOptions &options,
+                                       bool readOnly)
+{
+    if (isDatabaseFile(fileName))
+        return new SqliteBackend(fileName, options, readOnly);
+    return new PlaFileBackend(fileName, options);
+}
+
+bool StorageBackend::isDatabaseFile(const QString &fileName)
+{
+    return QFileInfo(fileName).suffix().toLower() == "plandb";
+}
@@ -0,0 +1,63 @@
+#ifndef STORAGEBACKEND_H
+#define STORAGEBACKEND_H
+
+#include <QCoreApplication>
+#include <vector>
+
+#include "atomicfile.h"
+
+class AbstractEntry;
+
+// Settings that apply to whichever backend a document is stored with
+struct StorageOptions
+{
+    bool compressed;
+    AtomicFile::Durability durability;
+};
+
+/* Where a document's entries are kept. The main window only loads and saves
+   through this interface, so the storage can be swapped per file:
+   PlaFileBackend rewrites a .pla file on every save, while SqliteBackend
+   keeps a database that is updated one edit at a time.
+
+   Incremental backends are told about every edit as it happens (and the
+   document then never needs saving). Searches always run on the entries
+   in memory, which every backend loads in full.
+
+   A backend created read-only never writes to its file, or creates one
+   that's missing; it's for reading other people's plans. */
+class StorageBackend
+{
+    Q_DECLARE_TR_FUNCTIONS(StorageBackend)
+
+public:
+    static StorageBackend *create(const QString &fileName,
+                                  const StorageOptions &options,
+                                  bool readOnly = false);
+    static bool isDatabaseFile(const QString &fileName);
+
+    virtual ~StorageBackend() {}
+
+    virtual QString fileName() const = 0;
+    virtual bool    load(std::vector<AbstractEntry*> &entries) = 0;
+    virtual bool    save(const std::vector<AbstractEntry*> &entries) = 0;
+    virtual QString errorString() const = 0;
+
+    /* The entries that touch [from, to] with only their times, for callers
+       that only need to know when a plan is busy. Backends that can't read
+       part of an entry load them whole. */
+    virtual bool loadTimes(qint64 from, qint64 to,
+                           std::vector<AbstractEntry*> &entries)
+    { Q_UNUSED(from); Q_UNUSED(to); return load(entries); }
+
+    /* Per-edit writes, each its own transaction unless grouped between
+       beginBatch() and endBatch(). Entries are identified by ID. */
+    virtual bool isIncremental() const { return false; }
+    virtual void beginBatch() {}
+    virtual bool endBatch() { return true; }
+    virtual bool insertEntry(const AbstractEntry *) { return true; }
+    virtual bool updateEntry(const AbstractEntry *) { return true; }
+    virtual bool removeEntry(quint64) { return true; }
+};
+
+#endif // STORAGEBACKEND_H
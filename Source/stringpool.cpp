@@ -0,0 +1,55 @@
+#include "stringpool.h"
+#include "memoryusage.h"
+
+QString StringPool::intern(const QString &s)
+{
+    /* Strings that already came from the pool are recognized by their data
+       pointer, without hashing their (possibly long) contents again. */
+    QHash<const QChar*, int>::iterator used = uses.find(s.constData());
+    if (used != uses.end()) {
+        ++used.value();
+        return s;
+    }
+
+    QSet<QString>::const_iterator it = strings.constFind(s);
+    if (it != strings.constEnd()) {
+        ++uses[it->constData()];
+        return *it;
+    }
+
+    strings.insert(s);
+    uses.insert(s.constData(), 1);
+    return s;
+}
+
+// End a use of s, a string intern() returned; the last one frees it
+void StringPool::release(const QString &s)
+{
+    QHash<const QChar*, int>::iterator used = uses.find(s.constData());
+    if (used == uses.end() || --used.value() > 0) return;
+
+    uses.erase(used);
+    strings.remove(s);
+}
+
+// The interned copy of s, or a null string if there is none
+QString StringPool::lookup(const QString &s) const
+{
+    QSet<QString>::const_iterator it = strings.constFind(s);
+    if (it != strings.constEnd()) return *it;
+    return QString();
+}
+
+void StringPool::clear()
+{
+    strings.clear();
+    uses.clear();
+}
+
+int StringPool::size() const { return strings.size(); }
+
+// The pool's own sets; the strings' characters belong to their entries
+qint64 StringPool::memoryUsed() const
+{
+    return MemoryUsage::setBytes(strings) + MemoryUsage::hashBytes(uses);
+}
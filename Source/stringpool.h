@@ -0,0 +1,31 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+/* Keeps one shared copy of every distinct string handed to intern(), so
+   names and notes repeated across many entries are stored once. Two
+   interned strings are equal exactly when their constData() pointers are.
+
+   Each intern() is a use of the string, which release() ends; a string
+   leaves the pool with its last use, so notes that were edited or deleted
+   aren't kept. */
+class StringPool
+{
+
+public:
+    QString intern(const QString &s);
+    void    release(const QString &s);
+    QString lookup(const QString &s) const;
+    void    clear();
+    int     size() const;
+    qint64  memoryUsed() const;
+
+private:
+    QSet<QString>           strings;
+    QHash<const QChar*, int> uses;  // by constData() of each of strings
+};
+
+#endif // STRINGPOOL_H
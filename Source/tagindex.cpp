@@ -0,0 +1,54 @@
+#include "tagindex.h"
+#include "memoryusage.h"
+
+void TagIndex::add(int slot, const QStringList &tags)
+{
+    for (int i = 0; i < tags.size(); i++)
+        bitmaps[tags[i].toLower()].add(quint32(slot));
+}
+
+// Tags no entry has any more are forgotten
+void TagIndex::remove(int slot, const QStringList &tags)
+{
+    for (int i = 0; i < tags.size(); i++) {
+        QHash<QString, RoaringBitmap>::iterator it =
+                bitmaps.find(tags[i].toLower());
+        if (it == bitmaps.end()) continue;
+        it.value().remove(quint32(slot));
+        if (it.value().isEmpty()) bitmaps.erase(it);
+    }
+}
+
+// An entry with these tags moved from one slot to another
+void TagIndex::move(int from, int to, const QStringList &tags)
+{
+    remove(from, tags);
+    add(to, tags);
+}
+
+void TagIndex::retag(int slot, const QStringList &oldTags,
+                     const QStringList &newTags)
+{
+    if (oldTags == newTags) return;
+    remove(slot, oldTags);
+    add(slot, newTags);
+}
+
+void TagIndex::clear()
+{
+    bitmaps.clear();
+}
+
+RoaringBitmap TagIndex::entriesTagged(const QString &tag) const
+{
+    return bitmaps.value(tag.toLower());
+}
+
+qint64 TagIndex::memoryUsed() const
+{
+    qint64 bytes = MemoryUsage::hashBytes(bitmaps);
+    QHash<QString, RoaringBitmap>::const_iterator it;
+    for (it = bitmaps.constBegin(); it != bitmaps.constEnd(); it++)
+        bytes += MemoryUsage::stringBytes(it.key()) + it.value().memoryUsed();
+    return bytes;
+}
@@ -0,0 +1,31 @@
+#ifndef TAGINDEX_H
+#define TAGINDEX_H
+
+#include <QHash>
+#include <QStringList>
+
+#include "roaringbitmap.h"
+
+/* For each tag, the slots of the entries that have it, kept by slot in
+   PlannerWidget's entryVector like TimeColumns is, so filters are set
+   operations on bitmaps rather than a pass over the entries. Tags are
+   matched ignoring case. */
+class TagIndex
+{
+public:
+    void add(int slot, const QStringList &tags);
+    void remove(int slot, const QStringList &tags);
+    void move(int from, int to, const QStringList &tags);
+    void retag(int slot, const QStringList &oldTags,
+               const QStringList &newTags);
+    void clear();
+
+    RoaringBitmap entriesTagged(const QString &tag) const;
+    int    size() const { return bitmaps.size(); }
+    qint64 memoryUsed() const;
+
+private:
+    QHash<QString, RoaringBitmap> bitmaps;  // by tag, in lower case
+};
+
+#endif // TAGINDEX_H
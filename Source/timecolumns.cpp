@@ -0,0 +1,110 @@
+#include "timecolumns.h"
+#include "abstractentry.h"
+#include "memoryusage.h"
+#include "scankernels.h"
+
+// What a recurring entry's slot holds: no interval is that far back
+static const qint64 NeverStart = Q_INT64_C(0x7fffffffffffffff);
+static const qint64 NeverEnd = -NeverStart - 1;
+
+// Record entry's times in slot, which may be one past the last
+void TimeColumns::set(int slot, const AbstractEntry *entry)
+{
+    if (slot == int(starts.size())) {
+        starts.push_back(0);
+        ends.push_back(0);
+    }
+
+    if (entry->isRecurring()) {
+        starts[slot] = NeverStart;
+        ends[slot] = NeverEnd;
+        recurring.insert(slot);
+    }
+    else {
+        starts[slot] = entry->startMSecs();
+        ends[slot] = entry->endMSecs();
+        recurring.remove(slot);
+    }
+}
+
+void TimeColumns::remove(int slot)
+{
+    int last = int(starts.size()) - 1;
+    starts[slot] = starts[last];
+    ends[slot] = ends[last];
+    starts.pop_back();
+    ends.pop_back();
+
+    bool lastRecurring = recurring.remove(last);
+    recurring.remove(slot);
+    if (lastRecurring && slot != last) recurring.insert(slot);
+}
+
+void TimeColumns::clear()
+{
+    starts.clear();
+    ends.clear();
+    recurring.clear();
+}
+
+/* The first single entry's slot whose interval meets [from, to], or -1.
+   Scanned a block at a time, so an early match stops the scan early. */
+int TimeColumns::firstOverlapping(qint64 from, qint64 to) const
+{
+    quint64 mask[Block / 64];
+    std::vector<int> found;
+    int n = int(starts.size());
+    for (int i = 0; i < n && found.empty(); i += Block) {
+        int rows = qMin(int(Block), n - i);
+        Scan::overlapMask(&starts[i], &ends[i], rows, from, to, mask);
+        Scan::maskIndexes(mask, rows, found, i);
+    }
+    return found.empty() ? -1 : found.front();
+}
+
+// The slots of all single entries whose intervals meet [from, to]
+void TimeColumns::overlapping(qint64 from, qint64 to,
+                              std::vector<int> &rows) const
+{
+    if (starts.empty()) return;
+    std::vector<quint64> mask(Scan::maskWords(int(starts.size())));
+    Scan::overlapMask(&starts[0], &ends[0], int(starts.size()), from, to,
+                      &mask[0]);
+    Scan::maskIndexes(&mask[0], int(starts.size()), rows);
+}
+
+/* The same as a Scan mask with a bit per slot, for combining with other
+   sets of slots */
+void TimeColumns::overlapMask(qint64 from, qint64 to,
+                              std::vector<quint64> &mask) const
+{
+    mask.assign(Scan::maskWords(int(starts.size())), 0);
+    if (starts.empty()) return;
+    Scan::overlapMask(&starts[0], &ends[0], int(starts.size()), from, to,
+                      &mask[0]);
+}
+
+// How many single entries ended by msecs
+int TimeColumns::countEndedBy(qint64 msecs) const
+{
+    if (ends.empty()) return 0;
+
+    // Recurring entries' slots end at NeverEnd, so the count takes them in
+    return Scan::countAtMost(&ends[0], int(ends.size()), msecs)
+           - recurring.size();
+}
+
+void TimeColumns::endedBy(qint64 msecs, std::vector<int> &rows) const
+{
+    if (ends.empty()) return;
+    std::vector<quint64> mask(Scan::maskWords(int(ends.size())));
+    Scan::rangeMask(&ends[0], int(ends.size()), NeverEnd + 1, msecs,
+                    &mask[0]);
+    Scan::maskIndexes(&mask[0], int(ends.size()), rows);
+}
+
+qint64 TimeColumns::memoryUsed() const
+{
+    return MemoryUsage::vectorBytes(starts) + MemoryUsage::vectorBytes(ends)
+           + MemoryUsage::setBytes(recurring);
+}
@@ -0,0 +1,45 @@
+#ifndef TIMECOLUMNS_H
+#define TIMECOLUMNS_H
+
+#include <QSet>
+#include <vector>
+
+class AbstractEntry;
+
+/* Every single entry's start and end as plain columns of milliseconds,
+   kept by the entry's slot in PlannerWidget's entryVector, so scans of the
+   whole plan go through Scan's vector kernels rather than a virtual call
+   per entry. Slots move exactly as entryVector's do: remove() puts the
+   last slot in the removed one's place.
+
+   A recurring entry's slot holds times no scan matches; such slots are
+   listed apart, for their rules to be checked one at a time. */
+class TimeColumns
+{
+public:
+    void set(int slot, const AbstractEntry *entry);
+    void remove(int slot);
+    void clear();
+
+    int  firstOverlapping(qint64 from, qint64 to) const;
+    void overlapping(qint64 from, qint64 to, std::vector<int> &rows) const;
+    void overlapMask(qint64 from, qint64 to, std::vector<quint64> &mask) const;
+    int  countEndedBy(qint64 msecs) const;
+    void endedBy(qint64 msecs, std::vector<int> &rows) const;
+    const QSet<int> &recurringSlots() const { return recurring; }
+    int  size() const { return int(starts.size()); }
+
+    /* The raw columns; a recurring entry's slot starts after it ends */
+    const std::vector<qint64> &startColumn() const { return starts; }
+    const std::vector<qint64> &endColumn() const { return ends; }
+    qint64 memoryUsed() const;
+
+private:
+    enum { Block = 4096 };  // rows per scan in firstOverlapping()
+
+    std::vector<qint64> starts;
+    std::vector<qint64> ends;
+    QSet<int> recurring;
+};
+
+#endif // TIMECOLUMNS_H
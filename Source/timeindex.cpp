@@ -0,0 +1,278 @@
+#include <algorithm>
+
+#include "timeindex.h"
+#include "memoryusage.h"
+
+static const qint64 MSecsPerMinute = 60 * 1000;
+
+// Before any end and after any start, for "nothing there"
+static const qint64 Never = Q_INT64_C(-0x7FFFFFFFFFFFFFFF) - 1;
+static const qint64 Forever = Q_INT64_C(0x7FFFFFFFFFFFFFFF);
+
+/* Entries include both their start and end instants (see
+   PlannerWidget::DT_conflict_in_list()), so free time begins strictly after
+   a busy end; it's taken to begin on the next whole minute. */
+qint64 TimeIndex::freeAfter(qint64 busyEnd)
+{
+    qint64 minute = busyEnd / MSecsPerMinute;
+    if (busyEnd < 0 && busyEnd % MSecsPerMinute != 0) minute--;
+    return (minute + 1) * MSecsPerMinute;
+}
+
+// A node's priority, taken from its entry's ID so nothing needs seeding
+static quint32 priorityOf(quint64 id)
+{
+    id ^= id >> 33;
+    id *= Q_UINT64_C(0xFF51AFD7ED558CCD);
+    id ^= id >> 33;
+    return quint32(id);
+}
+
+TimeIndex::TimeIndex() : root(-1) {}
+
+void TimeIndex::build(const std::vector<AbstractEntry*> &entries)
+{
+    clear();
+    nodes.reserve(entries.size());
+    nodeById.reserve(int(entries.size()));
+    for (uint i = 0; i < entries.size(); i++) set(entries[i]);
+}
+
+// Add entry, or move it to its new times
+void TimeIndex::set(const AbstractEntry *entry)
+{
+    remove(entry->id());
+    if (entry->isRecurring()) {
+        recurring.insert(entry->id(), entry);
+        return;
+    }
+
+    Node node;
+    node.start = entry->startMSecs();
+    node.end = entry->endMSecs();
+    node.latestEnd = node.end;
+    node.id = entry->id();
+    node.priority = priorityOf(node.id);
+    node.left = node.right = -1;
+
+    int n;
+    if (freeNodes.empty()) {
+        n = int(nodes.size());
+        nodes.push_back(node);
+    }
+    else {
+        n = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[n] = node;
+    }
+    nodeById.insert(node.id, n);
+
+    int left, right;
+    split(root, node, left, right);
+    root = merge(merge(left, n), right);
+}
+
+void TimeIndex::remove(quint64 id)
+{
+    if (recurring.remove(id)) return;
+    QHash<quint64, int>::iterator it = nodeById.find(id);
+    if (it == nodeById.end()) return;
+
+    root = erase(root, it.value());
+    freeNodes.push_back(it.value());
+    nodeById.erase(it);
+}
+
+void TimeIndex::clear()
+{
+    nodes.clear();
+    freeNodes.clear();
+    root = -1;
+    nodeById.clear();
+    recurring.clear();
+}
+
+qint64 TimeIndex::memoryUsed() const
+{
+    return MemoryUsage::vectorBytes(nodes)
+           + MemoryUsage::vectorBytes(freeNodes)
+           + MemoryUsage::hashBytes(nodeById)
+           + MemoryUsage::hashBytes(recurring);
+}
+
+
+
+
+/******************************************************************************
+    TREAP
+******************************************************************************/
+
+// Ordered by start, then ID
+bool TimeIndex::before(const Node &a, const Node &b) const
+{
+    return a.start < b.start || (a.start == b.start && a.id < b.id);
+}
+
+void TimeIndex::update(int n)
+{
+    Node &node = nodes[n];
+    node.latestEnd = node.end;
+    if (node.left >= 0)
+        node.latestEnd = qMax(node.latestEnd, nodes[node.left].latestEnd);
+    if (node.right >= 0)
+        node.latestEnd = qMax(node.latestEnd, nodes[node.right].latestEnd);
+}
+
+// Join two trees, everything in a coming before everything in b
+int TimeIndex::merge(int a, int b)
+{
+    if (a < 0) return b;
+    if (b < 0) return a;
+    if (nodes[a].priority > nodes[b].priority) {
+        int right = merge(nodes[a].right, b);
+        nodes[a].right = right;
+        update(a);
+        return a;
+    }
+    int left = merge(a, nodes[b].left);
+    nodes[b].left = left;
+    update(b);
+    return b;
+}
+
+// Split the tree at n into the nodes before key and the rest
+void TimeIndex::split(int n, const Node &key, int &left, int &right)
+{
+    if (n < 0) {
+        left = right = -1;
+        return;
+    }
+    if (before(nodes[n], key)) {
+        int rest;
+        split(nodes[n].right, key, rest, right);
+        nodes[n].right = rest;
+        left = n;
+    }
+    else {
+        int rest;
+        split(nodes[n].left, key, left, rest);
+        nodes[n].left = rest;
+        right = n;
+    }
+    update(n);
+}
+
+// The tree at n without the node target
+int TimeIndex::erase(int n, int target)
+{
+    if (n == target) return merge(nodes[n].left, nodes[n].right);
+    if (before(nodes[target], nodes[n])) {
+        int left = erase(nodes[n].left, target);
+        nodes[n].left = left;
+    }
+    else {
+        int right = erase(nodes[n].right, target);
+        nodes[n].right = right;
+    }
+    update(n);
+    return n;
+}
+
+// The latest end of the single entries starting by t, or Never
+qint64 TimeIndex::latestEndBy(qint64 t) const
+{
+    qint64 latest = Never;
+    for (int n = root; n >= 0; ) {
+        const Node &node = nodes[n];
+        if (node.start > t) n = node.left;
+        else {
+            latest = qMax(latest, node.end);
+            if (node.left >= 0)
+                latest = qMax(latest, nodes[node.left].latestEnd);
+            n = node.right;
+        }
+    }
+    return latest;
+}
+
+// The first start of a single entry after t, or Forever
+qint64 TimeIndex::firstStartAfter(qint64 t) const
+{
+    qint64 first = Forever;
+    for (int n = root; n >= 0; ) {
+        const Node &node = nodes[n];
+        if (node.start > t) {
+            first = node.start;
+            n = node.left;
+        }
+        else n = node.right;
+    }
+    return first;
+}
+
+
+
+
+/******************************************************************************
+    FREE TIME
+******************************************************************************/
+
+/* The earliest places, up to maxSlots of them and each in a different gap,
+   where an entry lasting duration fits between from and to without
+   conflicting with any entry.
+
+   Something placed at cursor fits unless an interval starting by its end
+   reaches cursor, and then nothing fits before the latest such end either:
+   so from each cursor one lookup either finds a place or jumps past a
+   whole run of busy time, however many intervals make it up. */
+QList<Occurrence> TimeIndex::freeSlots(qint64 from, qint64 to,
+                                       qint64 duration, int maxSlots) const
+{
+    QList<Occurrence> found;
+
+    // Occurrences of recurring entries that touch the window, by start
+    std::vector<std::pair<qint64, qint64> > repeats;
+    QDateTime fromDT = QDateTime::fromMSecsSinceEpoch(from);
+    QDateTime toDT = QDateTime::fromMSecsSinceEpoch(to);
+    QHash<quint64, const AbstractEntry*>::const_iterator it;
+    for (it = recurring.constBegin(); it != recurring.constEnd(); it++) {
+        QList<Occurrence> occurrences = it.value()->occurrences(fromDT, toDT);
+        for (int j = 0; j < occurrences.size(); j++)
+            repeats.push_back(std::make_pair(
+                        occurrences[j].first.toMSecsSinceEpoch(),
+                        occurrences[j].second.toMSecsSinceEpoch()));
+    }
+    std::sort(repeats.begin(), repeats.end());
+
+    // Their starts, and the latest end among each prefix of them
+    std::vector<qint64> repeatStarts, repeatEnds;
+    for (uint j = 0; j < repeats.size(); j++) {
+        repeatStarts.push_back(repeats[j].first);
+        repeatEnds.push_back(j == 0 ? repeats[j].second
+                                    : qMax(repeatEnds[j - 1],
+                                           repeats[j].second));
+    }
+
+    qint64 cursor = from;
+    while (cursor + duration <= to && found.size() < maxSlots) {
+        qint64 reach = cursor + duration;
+        uint j = std::upper_bound(repeatStarts.begin(), repeatStarts.end(),
+                                  reach) - repeatStarts.begin();
+        qint64 busyEnd = latestEndBy(reach);
+        if (j > 0) busyEnd = qMax(busyEnd, repeatEnds[j - 1]);
+
+        if (busyEnd >= cursor) {
+            cursor = freeAfter(busyEnd);
+            continue;
+        }
+        found.append(Occurrence(QDateTime::fromMSecsSinceEpoch(cursor),
+                     QDateTime::fromMSecsSinceEpoch(reach)));
+
+        // The next place is past the busy time that ends this gap, if any
+        qint64 next = firstStartAfter(reach);
+        if (j < repeatStarts.size()) next = qMin(next, repeatStarts[j]);
+        if (next > to) break;
+        cursor = next;
+    }
+    return found;
+}
@@ -0,0 +1,61 @@
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <vector>
+#include "abstractentry.h"
+
+/* Single entries ordered by start in a treap (a binary search tree kept
+   balanced by random priorities), each node holding the latest end in its
+   subtree. So the latest end among everything starting by any instant is
+   found in O(log n), and free time by jumping from one such end to the
+   next: finding k gaps costs O(k log n) plus the occurrences of recurring
+   entries, which are kept aside and only expanded over the window asked
+   about.
+
+   Once built, the index is kept up to date one entry at a time, each in
+   O(log n), instead of being rebuilt after every change. */
+class TimeIndex
+{
+public:
+    TimeIndex();
+
+    void build(const std::vector<AbstractEntry*> &entries);
+    void set(const AbstractEntry *entry);
+    void remove(quint64 id);
+    void clear();
+
+    QList<Occurrence> freeSlots(qint64 from, qint64 to, qint64 duration,
+                                int maxSlots) const;
+
+    static qint64 freeAfter(qint64 busyEnd);
+    qint64 memoryUsed() const;
+
+private:
+    struct Node {
+        qint64 start;
+        qint64 end;
+        qint64 latestEnd;   // of this node and those below it
+        quint64 id;         // breaks ties between equal starts
+        quint32 priority;   // above those of the nodes below it
+        int left;
+        int right;
+    };
+
+    bool before(const Node &a, const Node &b) const;
+    void update(int n);
+    int  merge(int a, int b);
+    void split(int n, const Node &key, int &left, int &right);
+    int  erase(int n, int target);
+    qint64 latestEndBy(qint64 t) const;
+    qint64 firstStartAfter(qint64 t) const;
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;         // in nodes, for reuse
+    int root;                           // -1 if empty
+    QHash<quint64, int> nodeById;
+    QHash<quint64, const AbstractEntry*> recurring;
+};
+
+#endif // TIMEINDEX_H
@@ -0,0 +1,139 @@
+#include "trace.h"
+
+#ifdef PLANNER_TRACING
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QTextStream>
+#include <QThreadStorage>
+
+namespace
+{
+    enum { Capacity = 1 << 16 };   // events kept; a power of two
+
+    struct Event
+    {
+        QAtomicInt sequence;    // 0 while being written, else index + 1
+        const char *name;
+        char phase;             // 'X' for a timed scope, 'C' for a counter
+        int thread;
+        qint64 start;           // nanoseconds since the first event
+        qint64 duration;
+        qint64 value;           // entry count or counter value; -1 if none
+    };
+
+    Event events[Capacity];
+    QAtomicInt nextIndex;
+    QAtomicInt nextThread;
+    QThreadStorage<int*> threadIds;
+
+    QElapsedTimer &clock()
+    {
+        static QElapsedTimer timer;
+        static bool started = (timer.start(), true);
+        Q_UNUSED(started);
+        return timer;
+    }
+
+    // Small per-thread numbers, for the trace viewer's rows
+    int threadId()
+    {
+        if (!threadIds.hasLocalData())
+            threadIds.setLocalData(new int(nextThread.fetchAndAddRelaxed(1)));
+        return *threadIds.localData();
+    }
+
+    /* Claim the next slot and fill it in. The sequence number is cleared
+       first and set last, so a reader can tell a slot that changed under
+       it. Only the slot index is shared between writers. */
+    void record(const char *name, char phase, qint64 start, qint64 duration,
+                qint64 value)
+    {
+        int index = nextIndex.fetchAndAddRelaxed(1);
+        Event &e = events[index & (Capacity - 1)];
+        e.sequence.fetchAndStoreAcquire(0);
+        e.name = name;
+        e.phase = phase;
+        e.thread = threadId();
+        e.start = start;
+        e.duration = duration;
+        e.value = value;
+        e.sequence.fetchAndStoreRelease(index + 1);
+    }
+
+    QString jsonString(const char *s)
+    {
+        QString text = QString::fromLatin1(s);
+        text.replace('\\', "\\\\");
+        text.replace('"', "\\\"");
+        return '"' + text + '"';
+    }
+}
+
+qint64 Trace::now() { return clock().nsecsElapsed(); }
+
+void Trace::complete(const char *name, qint64 startNSecs, qint64 endNSecs,
+                     qint64 count)
+{
+    record(name, 'X', startNSecs, endNSecs - startNSecs, count);
+}
+
+void Trace::counter(const char *name, qint64 value)
+{
+    record(name, 'C', now(), 0, value);
+}
+
+/* Write the buffered events as a Chrome trace. Events still being written
+   (or overwritten) while this runs are left out. */
+bool Trace::writeJson(const QString &fileName, QString *error)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+    for (int i = 0; i < Capacity; i++) {
+        Event &e = events[i];
+        int sequence = e.sequence.fetchAndAddAcquire(0);
+        if (sequence == 0) continue;
+        Event copy;
+        copy.name = e.name;
+        copy.phase = e.phase;
+        copy.thread = e.thread;
+        copy.start = e.start;
+        copy.duration = e.duration;
+        copy.value = e.value;
+        if (e.sequence.fetchAndAddAcquire(0) != sequence) continue;
+
+        // Timestamps are in microseconds
+        out << (first ? "\n" : ",\n")
+            << "{\"name\":" << jsonString(copy.name)
+            << ",\"cat\":\"planner\",\"ph\":\"" << copy.phase
+            << "\",\"pid\":1,\"tid\":" << copy.thread
+            << ",\"ts\":" << QString::number(copy.start / 1000.0, 'f', 3);
+        if (copy.phase == 'X')
+            out << ",\"dur\":" << QString::number(copy.duration / 1000.0,
+                                                 'f', 3);
+        if (copy.phase == 'C')
+            out << ",\"args\":{\"value\":" << copy.value << '}';
+        else if (copy.value >= 0)
+            out << ",\"args\":{\"entries\":" << copy.value << '}';
+        out << '}';
+        first = false;
+    }
+    out << "\n]}\n";
+    out.flush();
+
+    if (file.error() != QFile::NoError) {
+        if (error) *error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+#endif // PLANNER_TRACING
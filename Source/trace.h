@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+
+/* Timing of Planner's own operations, for finding where time goes. Built
+   only with "qmake CONFIG+=tracing", which defines PLANNER_TRACING;
+   otherwise the macros below compile to nothing.
+
+   TRACE_SCOPE(name) times the rest of the enclosing block, and
+   TRACE_COUNT(n) attaches the number of entries it dealt with.
+   TRACE_COUNTER(name, value) records a value over time. For a span that
+   outlives one block (such as startup's phases), keep TRACE_NOW() when it
+   begins and call TRACE_SPAN(name, thatTime) when it ends. Names must be
+   string literals (only the pointer is kept).
+
+   Events go into a fixed-size ring buffer that any thread can write to
+   without locking; once it's full, the oldest events are overwritten.
+   Trace::writeJson() saves them in Chrome's trace_event format, for
+   chrome://tracing or Perfetto. */
+
+#ifdef PLANNER_TRACING
+
+#include <QElapsedTimer>
+
+namespace Trace
+{
+    void complete(const char *name, qint64 startNSecs, qint64 endNSecs,
+                  qint64 count);
+    void counter(const char *name, qint64 value);
+    qint64 now();
+    bool writeJson(const QString &fileName, QString *error = 0);
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char *name)
+            : name(name), start(now()), count(-1) {}
+        ~Scope() { complete(name, start, now(), count); }
+
+        void setCount(qint64 n) { count = n; }
+
+    private:
+        const char *name;
+        qint64 start;
+        qint64 count;
+    };
+}
+
+#define TRACE_SCOPE(name) Trace::Scope traceScope(name)
+#define TRACE_COUNT(n) traceScope.setCount(n)
+#define TRACE_COUNTER(name, value) Trace::counter(name, value)
+#define TRACE_NOW() Trace::now()
+#define TRACE_SPAN(name, startNSecs) \
+    Trace::complete(name, startNSecs, Trace::now(), -1)
+
+#else
+
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_COUNT(n) do {} while (0)
+#define TRACE_COUNTER(name, value) do {} while (0)
+#define TRACE_NOW() Q_INT64_C(0)
+#define TRACE_SPAN(name, startNSecs) do {} while (0)
+
+#endif // PLANNER_TRACING
+
+#endif // TRACE_H